@@ -1,13 +1,14 @@
 ifeq ($(MAKECMDGOALS),debug)
 	CFLAGS += -O0 -g3
 else
-	CFLAGS += -O3 -fno-strict-aliasing
+	CFLAGS += -O3 -fno-strict-aliasing -DRTP_LOG_MIN_LEVEL=2
 endif
+#note: release build doesn't contain RTP_DEBUG log messages (see RTP_LOG_MIN_LEVEL in log.h).
 #note: -fno-strict-aliasing optimilization turned off because of warnings in rtp_network.c:read_from_sock()
 # and rtp_network.c:rtp_packet_filter().
-all: RtpStore
+all: RtpStore RtpLogDump
 
-debug: RtpStore
+debug: RtpStore RtpLogDump
 
 RtpStore: $(C_OBJ) $(LIBS)
 	@echo 'Building target: $@'
@@ -16,6 +17,39 @@ RtpStore: $(C_OBJ) $(LIBS)
 	@echo 'Finished building target: $@'
 	@echo ' '
 
+RtpLogDump: $(bin)/rtp_logdump.o $(bin)/log_format.o
+	@echo 'Building target: $@'
+	@echo 'Invoking: GCC C Linker'
+	$(CC) -o"$(bin)/$(logdump)" $(bin)/rtp_logdump.o $(bin)/log_format.o
+	@echo 'Finished building target: $@'
+	@echo ' '
+
+bench: RtpBench RtpLoadGen
+
+RtpBench: $(C_OBJ) $(bin)/rtp_bench.o
+	@echo 'Building target: $@'
+	@echo 'Invoking: GCC C Linker'
+	$(CC) -o"$(bin)/$(bench)" $(bin)/rtp_bench.o $(C_OBJ) $(LIBS)
+	@echo 'Finished building target: $@'
+	@echo ' '
+
+RtpLoadGen: $(C_OBJ) $(bin)/rtp_loadgen.o
+	@echo 'Building target: $@'
+	@echo 'Invoking: GCC C Linker'
+	$(CC) -o"$(bin)/$(loadgen)" $(bin)/rtp_loadgen.o $(C_OBJ) $(LIBS)
+	@echo 'Finished building target: $@'
+	@echo ' '
+
+check: RtpCheck
+	$(bin)/$(check)
+
+RtpCheck: $(C_OBJ) $(bin)/rtp_check.o
+	@echo 'Building target: $@'
+	@echo 'Invoking: GCC C Linker'
+	$(CC) -o"$(bin)/$(check)" $(bin)/rtp_check.o $(C_OBJ) $(LIBS)
+	@echo 'Finished building target: $@'
+	@echo ' '
+
 $(bin)/%.o: $(srcdir)/%.c
 	@echo 'Building file: $<'
 	@echo 'Invoking: GCC C Compiler'
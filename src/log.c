@@ -26,32 +26,43 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include "rtp_foutput.h"
+#include "rtp_task.h"
 #include "log.h"
+#include "log_format.h"
 
+#define HEADER_LEN 100                      //length of header of log message
 
-//makro that prints log to string log_msg (without variable parameters)
-//log_msg - *char
-//log_level - rtp_log_level_t
-//time - * char
-//msec - (miliseconds) int
-//date - * char
-//message - * char
-//code - * char (function, where was rtp_print_log() called)
-#define FORMAT_LOG(log_msg, log_level, time, msec, date, message, code) sprintf(log_msg, "%s %s,%d [RtpStore:%s()] %s - %s",                        \
-                                                                    date, time, msec, code, strlog_levels[(int) (log_level)], message);
+//Count of records in log ring. Must be power of 2.
+#define LOG_RING_SLOTS 4096
 
-#define HEADER_LEN 100                      //length of header of log message
+//Maximum length of text (or encoded arguments) of log message stored in record.
+#define LOG_TEXT_LEN 200
+
+//Count of strings (format strings and names of functions) defined in binary log file.
+#define LOGBIN_STRINGS 1024
 
-//Array position of pipe descriptors
-#define PIPE_READ 0
-#define PIPE_WRITE 1
+//Maximum count of records handled by log thread in one batch.
+#define LOG_BATCH 64
+
+//Time in microseconds, that log thread sleeps when log ring is empty.
+#define LOG_POLL_TIME 10000
 
 #define MAX_FSIZE_UNBOUNDED 0               //maximum size of logfile is unbounded
 
-static const char *strlog_levels[] = {"", "DEBUG", "INFO", "", "WARN", "", "", "", "ERROR"};
+//Count of datagrams of remote log sent by one sendmmsg().
+#define REMOTE_BATCH 16
+
+//Limits of size of datagram of remote log.
+#define REMOTE_MTU_MIN 256
+#define REMOTE_MTU_MAX 9000
+
+//Index of log level in per-level arrays (levels are bits 0 - 3).
+#define LEVEL_INDEX(log_level) (__builtin_ctz(log_level) & 3)
+
 //bit array of enabled log levels
 static rtp_log_level_t log_levels = RTP_OFF;
 static rtp_log_level_t remote_log_levels = RTP_OFF;
+rtp_log_level_t __rtp_log_mask = RTP_OFF;  //log_levels | remote_log_levels, checked by rtp_print_log
 
 static FILE *flog = NULL;           //output file, where log is written.
 static int roll_backup_maxnum = 0;  //max number suffix of log files
@@ -59,69 +70,120 @@ static int roll_backup_num = 0;     //current maximum number suffix of log files
 static off_t max_fsize = 0;     //maximum size of log file
 static off_t cur_fsize = 0;     //current size of log file
 static char *flog_name = NULL;      //name of log file
-
-enum log_thread_state_t {RUNNING, ENDING};
-static volatile enum log_thread_state_t log_thread_state = RUNNING;
+static size_t flog_pending = 0;     //size of data written to log file, that were not flushed yet
+static uint64_t flog_first = 0;     //time of the oldest data, that were not flushed yet
+static uint64_t flog_synced = 0;    //time of last fdatasync() of log file
+
+static unsigned int flush_size = RTP_LOG_FLUSH_SIZE_DEFAULT;   //flush threshold in bytes
+static unsigned int flush_time = RTP_LOG_FLUSH_TIME_DEFAULT;   //flush threshold in miliseconds
+static unsigned int sync_interval = RTP_LOG_SYNC_OFF;          //fdatasync() interval in miliseconds
+
+/* Rotation of log file: log thread renames log file to <logfile name>.0 and opens new log
+ * file, background task closes old log file and shifts rollbacks. When rotation is still
+ * running, log file grows over quota until it is done (at most twice the quota). Background task syncs log file every
+ * sync_interval, when it is turned on. */
+static struct rtp_task rotate_task = {.state = RTP_TASK_IDLE};
+static FILE *rotate_flog = NULL;    //rotated log file closed by rotate_task
+static struct rtp_task sync_task = {.state = RTP_TASK_IDLE};
+static int sync_fd = -1;            //duplicate of descriptor of log file synced by sync_task
+static rtp_log_format_t log_format = RTP_LOG_TEXT;  //format of log messages
+
+//strings defined in binary log file, open addressing table indexed by hash of pointer
+static const char *bin_strings[LOGBIN_STRINGS];
+static uint32_t bin_ids[LOGBIN_STRINGS];
+static uint32_t bin_nstrings = 0;
+static int bin_header = 1;          //1 if header of binary log file must be written
+
+static volatile int log_thread_running = 0;
 static pthread_t *log_thread = NULL;    //logging thread.
 
 static int sockfd = -1;             //file deskriptor of socket, where logs are sent.
-static int pipefd[2];                       //file descriptors of pipe.
 static struct sockaddr_in addr;
-
-//Structure containing informations about a log message.
-struct log_head {
-    unsigned int log_len;               //length of log message
+static int remote_closing = 0;      //1 while log thread should send remaining logs and close socket
+
+/* Lines of remote log are gathered into datagrams of size at most remote_mtu. Datagram
+ * contains lines terminated by '\n' followed by '\0'. Datagrams are sent by one sendmmsg()
+ * when all REMOTE_BATCH datagrams are filled or when the oldest line waits longer than
+ * remote_flush_time. Every level has token bucket limiting rate of lines sent to remote
+ * log, suppressed lines are counted and reported. Used only by log thread. */
+
+static unsigned int remote_mtu = RTP_REMOTE_LOG_MTU_DEFAULT;               //maximum size of datagram
+static unsigned int remote_flush_time = RTP_REMOTE_LOG_FLUSH_DEFAULT;      //in miliseconds
+static unsigned int remote_rate = RTP_REMOTE_LOG_RATE_DEFAULT;             //lines per second per level
+
+static char remote_buf[REMOTE_BATCH][REMOTE_MTU_MAX];   //datagrams being filled
+static size_t remote_len[REMOTE_BATCH];                 //lengths of datagrams
+static int remote_count = 0;                            //count of datagrams with data
+static uint64_t remote_first = 0;                       //time of the oldest line in datagrams
+
+static uint64_t remote_tokens[4];           //tokens of buckets in thousandths of line
+static uint64_t remote_refill[4];           //time of last refill of buckets
+static uint64_t remote_suppressed[4];       //count of suppressed lines per level
+
+/* Log messages are passed to log thread by bounded lock-free multi-producer/single-consumer
+ * ring of preallocated records. Every record has sequence number: it equals to position of
+ * record when record is free, position + 1 when record is filled. Producer claims record
+ * by moving head of ring, log thread takes records from tail of ring. When ring is full,
+ * message is dropped and counted. Producers don't allocate memory and don't call system
+ * calls. */
+
+//Record of log ring.
+struct log_record {
+    uint32_t seq;                       //sequence number of record
     rtp_log_level_t log_level;          //level of log message
-};
-
-//Puts log message into pipe with given loggin level.
-static inline int put_log(char *log, rtp_log_level_t log_level)
+    struct timeval tv;                  //time of log message
+    const char *func;                   //function, where rtp_print_log() was called
+    const char *fmt;                    //format string, NULL if text is already formatted
+    uint16_t args_len;                  //length of arguments encoded in text
+    char text[LOG_TEXT_LEN];            //formatted log message or encoded arguments
+} __attribute__((aligned(64)));
+
+static struct log_record log_ring[LOG_RING_SLOTS];      //log ring
+static uint32_t ring_head __attribute__((aligned(64))) = 0; //position of next claimed record
+static uint32_t ring_tail __attribute__((aligned(64))) = 0; //position of next handled record
+static uint64_t log_dropped = 0;                        //count of dropped log messages
+static uint64_t log_dropped_reported = 0;               //count of dropped messages already logged
+
+//Claims free record of log ring. Returns NULL when ring is full.
+static inline struct log_record *claim_record(uint32_t *pos)
 {
-    struct log_head lh = {
-        .log_len = strlen(log) + 1,
-        .log_level = log_level
-    };
-
-    /* Part, where log message and log are joined in a single variable tmp.
-     * They are joined because we need to call write() only once (This is so
-     * because separate writing header and log message to pipe can be interrupted
-     * by another thread).*/
-    uint8_t *tmp = (uint8_t *) malloc(sizeof(lh) + lh.log_len * sizeof(uint8_t));
-    memcpy(tmp, (void *) &lh, sizeof(lh));
-    memcpy((void *) (tmp + sizeof(lh)), (void *) log, lh.log_len);
-
-    if(write(pipefd[PIPE_WRITE], tmp, sizeof(lh) + lh.log_len * sizeof(uint8_t)) == -1)
-        goto ON_ERROR;
-
-    free(tmp);
-    return 0;
-
-    ON_ERROR:
-    free(tmp);
-    return -1;
-
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    while(1) {
+        struct log_record *rec = &log_ring[head & (LOG_RING_SLOTS - 1)];
+        int32_t dif = (int32_t) (__atomic_load_n(&(rec->seq), __ATOMIC_ACQUIRE) - head);
+        if(dif == 0) {
+            if(__atomic_compare_exchange_n(&ring_head, &head, head + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pos = head;
+                return rec;
+            }
+        } else if(dif < 0) {                            //record wasn't handled by log thread yet
+            __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        } else
+            head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    }
 }
 
-//Gets header (contains length of log message and logging level) of log message from a pipe.
-static inline int get_log_header(unsigned int *len, rtp_log_level_t *log_level)
+//Passes filled record claimed at position pos to log thread.
+static inline void commit_record(struct log_record *rec, uint32_t pos)
 {
-    struct log_head lh = {
-        .log_len = 0,
-        .log_level = RTP_OFF
-    };
-    if(TEMP_FAILURE_RETRY(read(pipefd[PIPE_READ], (void *) &lh, sizeof(lh))) == -1)
-        return -1;
+    __atomic_store_n(&(rec->seq), pos + 1, __ATOMIC_RELEASE);
+}
 
-    *log_level = lh.log_level;
-    *len = lh.log_len;
-    return 0;
+//Initializes empty log ring. Called when there are no producers.
+static void init_ring(void)
+{
+    uint32_t i;
+    for(i = 0; i < LOG_RING_SLOTS; i++)
+        log_ring[i].seq = i;
+    ring_head = 0;
+    ring_tail = 0;
 }
 
-//Gets log message from a pipe. (get_log_header needs to by called first to get length of
-//the message
-static inline int get_log(char *log, size_t len)
+//Publishes levels enabled in logging to file or to remote destination to rtp_print_log.
+static inline void update_log_mask(void)
 {
-    return TEMP_FAILURE_RETRY(read(pipefd[PIPE_READ], (void *) log, len));
+    __atomic_store_n(&__rtp_log_mask, log_levels | remote_log_levels, __ATOMIC_RELEASE);
 }
 
 //Adds suffix number after filename in form:<string>.<number>
@@ -155,51 +217,129 @@ static inline int get_flogsize_num(off_t *flog_size, int *roll_backup_num)
     return 0;
 }
 
-//Shifts rollbacks.
+//Shifts rollbacks: <logfile name>.i is renamed to <logfile name>.i+1 for i < max_shift_num.
 //max_shift_num - maximum number suffix of files
 //fnamesize - size of name of rollback files
 static inline void shift_rollbacks(int max_shift_num, int fnamesize)
 {
     int i;
-    for(i = max_shift_num - 1; i >= 1; i--) {
+    for(i = max_shift_num - 1; i >= 0; i--) {
         char foldname[fnamesize];
         char fnewname[fnamesize];
         add_suffix(foldname, flog_name, i);
         add_suffix(fnewname, flog_name, i + 1);
         rename(foldname, fnewname);
     }
-    char fname[fnamesize];
-    add_suffix(fname, flog_name, 1);
-    rename(flog_name, fname);
 }
 
-//Creates next rollback in form:<logfile name>.i+1, where previous form was:<logfile name>.i.
-//The most actual logfile is in form:<logfile name>. When is reached maximum count of rollbacks
-//then last rollback(with the biggist number) is erased, and the rest are shifted adding 1 to
-//number.New rollback is created in form <logfile name> and it is opened and writing to it is
-//beginned.
-static void create_new_rollback(void)
+//Background task closing rotated log file <logfile name>.0 and shifting rollbacks to form
+//<logfile name>.i+1, where previous form was <logfile name>.i. When is reached maximum count
+//of rollbacks then last rollback (with the biggist number) is erased.
+static void rotate_logfile(struct rtp_task *task)
 {
-    cur_fsize = 0;
-    if(flog == stdout || flog == stderr)
-        return;
+    if(sync_interval != RTP_LOG_SYNC_OFF)
+        fdatasync(fileno(rotate_flog));
+    fclose(rotate_flog);
+    rotate_flog = NULL;
 
-    TEMP_FAILURE_RETRY(fclose(flog));
-    flog = NULL;
-
-    int fnamesize = strlen(flog_name) + 5;
-    char fname[fnamesize];
-    if(roll_backup_num < roll_backup_maxnum) {                  //create next rollback
+    int fnamesize = strlen(flog_name) + 12;
+    if(roll_backup_num < roll_backup_maxnum)                    //create next rollback
         roll_backup_num++;
-        shift_rollbacks(roll_backup_num, fnamesize);
-    } else {                                                    //delete last rollback and shit rest
+    else {                                                      //delete last rollback
+        char fname[fnamesize];
         add_suffix(fname, flog_name, roll_backup_maxnum);
         remove(fname);
-        shift_rollbacks(roll_backup_maxnum, fnamesize);
     }
+    shift_rollbacks(roll_backup_num, fnamesize);
+}
+
+//Background task syncing data of log file to disk.
+static void sync_logfile(struct rtp_task *task)
+{
+    fdatasync(sync_fd);
+    close(sync_fd);
+    sync_fd = -1;
+}
+
+//Sets buffering of log file, it is flushed by log thread.
+static inline void set_logfile_buffer(FILE *file)
+{
+    if(file != stdout && file != stderr)
+        setvbuf(file, NULL, _IOFBF, flush_size > BUFSIZ ? flush_size : BUFSIZ);
+}
+
+//Writes data of log file buffered by stdio.
+static inline void flush_logfile(void)
+{
+    if(flog != NULL && flog_pending > 0)
+        TEMP_FAILURE_RETRY(fflush(flog));
+    flog_pending = 0;
+}
+
+//Creates next rollback. Log file is renamed to form <logfile name>.0 and new log file
+//<logfile name> is opened. Old log file is closed and rollbacks are shifted by background
+//task (see rotate_logfile()).
+static void create_new_rollback(void)
+{
+    if(flog == stdout || flog == stderr) {
+        cur_fsize = 0;
+        return;
+    }
+    if(!rtp_task_done(&rotate_task)) {      //previous rotation is not done yet
+        if(cur_fsize < 2 * max_fsize)
+            return;
+        rtp_task_wait(&rotate_task);    //log file doesn't grow over twice the quota
+    }
+
+    flush_logfile();
+    char fname[strlen(flog_name) + 12];
+    add_suffix(fname, flog_name, 0);
+    if(rename(flog_name, fname) == -1)
+        return;
+
+    FILE *file;
     do {
-        flog = fopen(flog_name, "w");
-    } while(flog == NULL && errno == EINTR);
+        file = fopen(flog_name, "w");
+    } while(file == NULL && errno == EINTR);
+    if(file == NULL) {                  //logging continues to old file
+        rename(fname, flog_name);
+        return;
+    }
+    set_logfile_buffer(file);
+
+    rotate_flog = flog;
+    flog = file;
+    cur_fsize = 0;
+    bin_header = 1;
+    rtp_task_submit(&rotate_task);
+}
+
+//Accounts data of size len written to log file. Data are flushed, when flush size is reached.
+static inline void logfile_written(size_t len)
+{
+    if(flog_pending == 0)
+        flog_first = rtp_clock_ms();
+    flog_pending += len;
+    if(flog_pending >= flush_size)
+        flush_logfile();
+}
+
+//Flushes log file, when the oldest data wait for flush time, and syncs it every sync interval.
+static void logfile_flush_timed(void)
+{
+    if(flog == NULL)
+        return;
+    uint64_t now = rtp_clock_ms();
+    if(flog_pending > 0 && now - flog_first >= flush_time)
+        flush_logfile();
+
+    if(sync_interval != RTP_LOG_SYNC_OFF && now - flog_synced >= sync_interval
+       && flog != stdout && flog != stderr && rtp_task_done(&sync_task)) {
+        flush_logfile();
+        flog_synced = now;
+        if((sync_fd = dup(fileno(flog))) != -1)
+            rtp_task_submit_sync(&sync_task);
+    }
 }
 
 //Writes logstr to file.
@@ -211,118 +351,340 @@ static inline void write_logfile(char *logstr)
             create_new_rollback();
     }
     if(flog != NULL) {
-        fprintf(flog, "%s", logstr);
-        TEMP_FAILURE_RETRY(fflush(flog));
+        size_t len = strlen(logstr);
+        if(fwrite(logstr, 1, len, flog) == len)
+            logfile_written(len);
     }
 }
 
-//Creates new log message.
-//\param log_level - level of logging
-//\param func - name of function, where where rtp_print_log() was called
-//\param message - desired message to print
-//\returns log message
-static char *create_log(rtp_log_level_t log_level, char *func, char *message)
+//Writes data of size len to binary log file.
+static inline void write_logbin_data(const void *data, size_t len)
 {
-    char *log_msg = (char *) malloc(sizeof(char) * (strlen(message) + HEADER_LEN));
-
-    struct tm *now;
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    now = localtime(&tv.tv_sec);
-    int msecs = tv.tv_usec / 1000;                          //miliseconds
+    if(flog != NULL && fwrite(data, 1, len, flog) == len) {
+        cur_fsize += len;
+        logfile_written(len);
+    }
+}
 
-    char time[10];
-    char date[12];
-    strftime(time, sizeof(time), "%H:%M:%S", now);          //format:H:M:S (hod)
-    strftime(date, sizeof(date), "%F", now);                //format:Y-M-D (ISO8601)
-    FORMAT_LOG(log_msg, log_level, time, msecs, date, message, func);
+//Returns ID of string str defined in binary log file. String is defined when it is
+//used first time. Returns -1 when table of strings is full.
+static int64_t logbin_string(const char *str)
+{
+    uint32_t i = (uint32_t) (((uintptr_t) str * 0x9E3779B97F4A7C15ULL) >> 54) & (LOGBIN_STRINGS - 1);
+    uint32_t n;
+    for(n = 0; n < LOGBIN_STRINGS; n++, i = (i + 1) & (LOGBIN_STRINGS - 1)) {
+        if(bin_strings[i] == str)
+            return bin_ids[i];
+        if(bin_strings[i] == NULL)
+            break;
+    }
+    if(n == LOGBIN_STRINGS || bin_nstrings == LOGBIN_STRINGS * 3 / 4)
+        return -1;
 
-    return log_msg;
+    size_t len = strlen(str);
+    rtp_logbin_string_t def = {
+        .type = RTP_LOGBIN_STRING,
+        .reserved = 0,
+        .len = len > UINT16_MAX ? UINT16_MAX : len,
+        .id = bin_nstrings
+    };
+    write_logbin_data(&def, sizeof(def));
+    write_logbin_data(str, def.len);
+    bin_strings[i] = str;
+    bin_ids[i] = bin_nstrings;
+    return bin_nstrings++;
 }
 
-//Loggs given message string logstr of logging level log_level.
-//Message can be logged in 2 ways, depending whethever they are turned on (see API in log.h):
-//1. Written to a log_file
-//2. Sended by UDP protocol to remote host.
-static inline void log_msg(char *logstr, rtp_log_level_t log_level)
+//Writes record to binary log file. Formatting of message is left to decoder.
+static void write_logbin(const struct log_record *rec)
 {
-    if((log_levels & log_level) == log_level)
-        write_logfile(logstr);                      //printing log to file
-    if(((remote_log_levels & log_level) == log_level)) {
-                                            //sending log by network to remote host
-        int retval = TEMP_FAILURE_RETRY(sendto(sockfd, (void *) logstr, strlen(logstr) + 1,
-                                        MSG_DONTWAIT, (struct sockaddr *) &addr, sizeof(addr)));
-
-        //if sending log failed
-        if(retval == -1 && (log_levels & RTP_WARN) == log_level) {
-            char dmsg[55];
-            sprintf(dmsg, "Sending log by network failed: %s\n", strerror(errno));
-            char *msg = create_log(RTP_WARN, "__rtp_print_log", dmsg);
-            write_logfile(msg);
-            if(msg != NULL)
-                free(msg);
-        } //if sending log succeed
-        else if((log_levels & RTP_DEBUG) == log_level) {
-            char dmsg[50];
-            sprintf(dmsg, "Sending log by network with size: %d\n", retval);
-            char *msg = create_log(RTP_DEBUG, "__rtp_print_log", dmsg);
-            write_logfile(msg);
-            if(msg != NULL)
-                free(msg);
+    if(max_fsize != MAX_FSIZE_UNBOUNDED && cur_fsize >= max_fsize)
+        create_new_rollback();
+    if(flog == NULL)
+        return;
+
+    if(bin_header) {                            //new file, strings must be defined again
+        rtp_logbin_hdr_t hdr = {
+            .bom = RTP_LOGBIN_BOM,
+            .reserved = 0
+        };
+        memcpy(hdr.magic, RTP_LOGBIN_MAGIC, sizeof(hdr.magic));
+        write_logbin_data(&hdr, sizeof(hdr));
+        memset(bin_strings, 0, sizeof(bin_strings));
+        bin_nstrings = 0;
+        bin_header = 0;
+    }
+
+    int64_t func = logbin_string(rec->func);
+    int64_t fmt = rec->fmt != NULL ? logbin_string(rec->fmt) : 0;
+    rtp_logbin_msg_t msg = {
+        .type = RTP_LOGBIN_MESSAGE,
+        .level = (uint8_t) rec->log_level,
+        .len = rec->args_len,
+        .usec = rec->tv.tv_usec,
+        .sec = rec->tv.tv_sec,
+        .func = func == -1 ? 0 : func,
+        .fmt = fmt == -1 ? 0 : fmt
+    };
+
+    char text[RTP_LOG_MSG_LEN];
+    const char *data = rec->text;
+    if(rec->fmt == NULL || func == -1 || fmt == -1) {   //text is written, when strings can't be defined
+        if(rec->fmt != NULL) {
+            rtp_log_decode(text, sizeof(text), rec->fmt, rec->text, rec->args_len);
+            data = text;
         }
+        msg.type = RTP_LOGBIN_TEXT;
+        msg.len = strlen(data);
     }
+    write_logbin_data(&msg, sizeof(msg));
+    write_logbin_data(data, msg.len);
 }
 
-//Set O_NONBLOCK flag to file descriptor fd
-static inline int set_noblock_fd(int fd)
+//Creates log message of log thread with current time in record rec.
+static inline void create_own_log(struct log_record *rec, rtp_log_level_t log_level, const char *message)
 {
-    int flags = 0;
-    if((flags = fcntl(fd, F_GETFL)) != -1) {
-        if(fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1)
-            return 0;
-    }
-    return -1;
+    gettimeofday(&(rec->tv), NULL);
+    rec->log_level = log_level;
+    rec->func = "__rtp_print_log";
+    rec->fmt = NULL;
+    rec->args_len = 0;
+    snprintf(rec->text, sizeof(rec->text), "%s", message);
 }
 
-static inline int handle_log(void)
+//Writes message of record rec to log file.
+static inline void write_record(const struct log_record *rec, const char *logstr)
 {
-        rtp_log_level_t log_level = RTP_OFF;
-        unsigned int msg_len = 0;
+    if(log_format == RTP_LOG_BINARY)
+        write_logbin(rec);
+    else
+        write_logfile((char *) logstr);
+}
 
-        int retval = get_log_header(&msg_len, &log_level);
-        int err = errno;
-        if(retval == -1 && err == EAGAIN)
-            return -1;
+//Sends all gathered datagrams of remote log.
+static void remote_flush(void)
+{
+    struct mmsghdr msgs[REMOTE_BATCH];
+    struct iovec iov[REMOTE_BATCH];
+    int i;
+    for(i = 0; i < remote_count; i++) {
+        iov[i].iov_base = remote_buf[i];
+        iov[i].iov_len = remote_len[i] + 1;          //with terminating '\0'
+        memset(&(msgs[i].msg_hdr), 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_name = &addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+        msgs[i].msg_hdr.msg_iov = &(iov[i]);
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-        char *msg = (char *) malloc(sizeof(char) * msg_len);
-        if(get_log(msg, msg_len) != -1) {
-            log_msg(msg, log_level);
+    int sent = 0;
+    while(sent < remote_count) {
+        int retval = TEMP_FAILURE_RETRY(sendmmsg(sockfd, msgs + sent, remote_count - sent, MSG_DONTWAIT));
+        if(retval == -1) {
+            //datagrams, that were not sent, are lost
+            if((log_levels & RTP_WARN) == RTP_WARN) {
+                char dmsg[100];
+                snprintf(dmsg, sizeof(dmsg), "Sending log by network failed, %d datagrams lost: %s\n",
+                         remote_count - sent, strerror(errno));
+                struct log_record own;
+                char logstr[sizeof(dmsg) + HEADER_LEN];
+                create_own_log(&own, RTP_WARN, dmsg);
+                rtp_log_line(logstr, sizeof(logstr), RTP_WARN, &(own.tv), own.func, own.text);
+                write_record(&own, logstr);
+            }
+            break;
         }
-        if(msg != NULL)
-            free(msg);
+        sent += retval;
+    }
+    remote_count = 0;
+}
+
+//Sends gathered datagrams of remote log, when the oldest line waits for flush time.
+static inline void remote_flush_timed(void)
+{
+    if(remote_count > 0 && rtp_clock_ms() - remote_first >= remote_flush_time)
+        remote_flush();
+}
+
+//Appends line logstr to datagrams of remote log.
+static void remote_append(const char *logstr)
+{
+    size_t len = strlen(logstr);
+    if(len > remote_mtu - 1)                        //line is truncated to one datagram
+        len = remote_mtu - 1;
+
+    if(remote_count == 0 || remote_len[remote_count - 1] + len + 1 > remote_mtu) {
+        if(remote_count == REMOTE_BATCH)
+            remote_flush();
+        if(remote_count == 0)
+            remote_first = rtp_clock_ms();
+        remote_len[remote_count++] = 0;
+    }
+    char *dgram = remote_buf[remote_count - 1];
+    memcpy(dgram + remote_len[remote_count - 1], logstr, len);
+    remote_len[remote_count - 1] += len;
+    dgram[remote_len[remote_count - 1]] = '\0';
+
+    if(remote_flush_time == 0)
+        remote_flush();
+}
+
+//Takes token from bucket of level log_level. Returns 1 if line can be sent, 0 otherwise.
+static inline int remote_take_token(rtp_log_level_t log_level)
+{
+    if(remote_rate == RTP_REMOTE_LOG_RATE_UNBOUNDED)
+        return 1;
+
+    int i = LEVEL_INDEX(log_level);
+    uint64_t now = rtp_clock_ms();
+    uint64_t burst = (uint64_t) remote_rate * 1000;    //bucket holds one second of lines
+    remote_tokens[i] += (now - remote_refill[i]) * remote_rate;
+    if(remote_tokens[i] > burst)
+        remote_tokens[i] = burst;
+    remote_refill[i] = now;
+
+    if(remote_tokens[i] < 1000)
         return 0;
+    remote_tokens[i] -= 1000;
+    return 1;
 }
 
-//clean-up handler of log thread.
-static void on_cancel(void *data)
+//Adds line logstr of level log_level to remote log, unless rate of level is exceeded.
+static void remote_add(rtp_log_level_t log_level, const char *logstr)
 {
-    log_thread_state = ENDING;
-    set_noblock_fd(pipefd[PIPE_READ]);
-    int ret_val = 0;
-    do {
-        ret_val = handle_log();
-    } while(ret_val == 0);
+    int i = LEVEL_INDEX(log_level);
+    if(!remote_take_token(log_level)) {
+        remote_suppressed[i]++;
+        return;
+    }
+    if(remote_suppressed[i] > 0) {                  //reporting suppressed lines first
+        char dmsg[80];
+        sprintf(dmsg, "%llu log messages suppressed by rate limit of remote log\n",
+                (unsigned long long) remote_suppressed[i]);
+        struct log_record own;
+        char ownstr[sizeof(dmsg) + HEADER_LEN];
+        create_own_log(&own, log_level, dmsg);
+        rtp_log_line(ownstr, sizeof(ownstr), log_level, &(own.tv), own.func, own.text);
+        remote_append(ownstr);
+        remote_suppressed[i] = 0;
+    }
+    remote_append(logstr);
+}
+
+//Initializes empty datagrams and full buckets of remote log.
+static void remote_init(void)
+{
+    int i;
+    remote_count = 0;
+    for(i = 0; i < 4; i++) {
+        remote_tokens[i] = (uint64_t) remote_rate * 1000;
+        remote_refill[i] = rtp_clock_ms();
+        remote_suppressed[i] = 0;
+    }
+}
+
+//Loggs message of record rec.
+//Message can be logged in 2 ways, depending whethever they are turned on (see API in log.h):
+//1. Written to a log_file
+//2. Sended by UDP protocol to remote host (gathered into datagrams, see remote_add()).
+static inline void log_msg(const struct log_record *rec)
+{
+    rtp_log_level_t log_level = rec->log_level;
+    int to_file = (log_levels & log_level) == log_level;
+    int to_remote = (remote_log_levels & log_level) == log_level;
+    if(to_file && log_format == RTP_LOG_BINARY) {
+        write_logbin(rec);                          //formatted by decoder
+        to_file = 0;
+    }
+    if(!to_file && !to_remote)
+        return;
+
+    //message with deferred formatting is formatted now
+    char message[RTP_LOG_MSG_LEN];
+    const char *text = rec->text;
+    if(rec->fmt != NULL) {
+        rtp_log_decode(message, sizeof(message), rec->fmt, rec->text, rec->args_len);
+        text = message;
+    }
+    char logstr[RTP_LOG_MSG_LEN + HEADER_LEN];
+    rtp_log_line(logstr, sizeof(logstr), log_level, &(rec->tv), rec->func, text);
+
+    if(to_file)
+        write_logfile(logstr);                      //printing log to file
+    if(to_remote)
+        remote_add(log_level, logstr);
+}
+
+//Logs count of messages dropped since last report, when log ring was full.
+static inline void report_dropped(void)
+{
+    uint64_t dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+    if(dropped == log_dropped_reported)
+        return;
+
+    char dmsg[80];
+    sprintf(dmsg, "%llu log messages dropped, log ring was full\n",
+            (unsigned long long) (dropped - log_dropped_reported));
+    struct log_record own;
+    create_own_log(&own, RTP_WARN, dmsg);
+    log_msg(&own);
+    log_dropped_reported = dropped;
+}
+
+//Handles at most LOG_BATCH records of log ring. Returns count of handled records.
+static int drain_ring(void)
+{
+    int count;
+    for(count = 0; count < LOG_BATCH; count++) {
+        struct log_record *rec = &log_ring[ring_tail & (LOG_RING_SLOTS - 1)];
+        if(__atomic_load_n(&(rec->seq), __ATOMIC_ACQUIRE) != ring_tail + 1)
+            break;                                      //record is not filled yet
+        log_msg(rec);
+        __atomic_store_n(&(rec->seq), ring_tail + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+        ring_tail++;
+    }
+    return count;
 }
 
-//Handler of logging thread. It reads logs from pipe log them by function log_msg().
+//Sends gathered datagrams of remote log and closes its socket.
+static void remote_close(void)
+{
+    if(sockfd == -1)
+        return;
+    if(remote_count > 0)
+        remote_flush();
+    close(sockfd);
+    sockfd = -1;
+}
+
+//Handler of logging thread. It takes logs from log ring and logs them by function log_msg().
 //parameter attr is not used. It returns nothing.
 static void *rtp_log_thread(void *attr)
 {
-    pthread_cleanup_push(on_cancel, NULL)
-    while(1) {
-        handle_log();
+    while(log_thread_running) {
+        if(__atomic_load_n(&remote_closing, __ATOMIC_ACQUIRE)) {
+            while(drain_ring() > 0)                     //logs remaining in ring are sent
+                ;
+            remote_close();
+            remote_log_levels = RTP_OFF;
+            __atomic_store_n(&remote_closing, 0, __ATOMIC_RELEASE);
+        }
+        int count = drain_ring();
+        logfile_flush_timed();
+        if(sockfd != -1)
+            remote_flush_timed();
+        if(count == 0) {
+            report_dropped();
+            usleep(LOG_POLL_TIME);
+        }
     }
-    pthread_cleanup_pop(1);
+
+    while(drain_ring() > 0)                             //the last logs
+        ;
+    report_dropped();
+    flush_logfile();
+    if(sockfd != -1 && remote_count > 0)
+        remote_flush();
     return NULL;
 }
 
@@ -336,12 +698,8 @@ static int rtp_log_thread_init(void)
     } else
         goto ON_ERROR;
 
-    if(pipe(pipefd) == -1)
-        goto ON_ERROR;
-    if(set_noblock_fd(pipefd[PIPE_WRITE]) == -1)
-        goto ON_ERROR;
-
-    log_thread_state = RUNNING;
+    init_ring();
+    log_thread_running = 1;
 
     int res = -1;                           //rozlisovat chybove cisla
     pthread_attr_t thread_attr;
@@ -372,7 +730,12 @@ int rtp_init_log(const char *flog_path, rtp_log_level_t levels, unsigned int max
         flog = fopen(flog_path, "a");
         if(flog == NULL)
             return -1;
+        set_logfile_buffer(flog);
     }
+    flog_pending = 0;
+    flog_synced = rtp_clock_ms();
+    rotate_task.run = rotate_logfile;
+    sync_task.run = sync_logfile;
 
     if(rb_count <= 0)
         return -1;
@@ -384,11 +747,13 @@ int rtp_init_log(const char *flog_path, rtp_log_level_t levels, unsigned int max
 
     if(get_flogsize_num(&cur_fsize, &roll_backup_num) == -1)
         return -1;
+    bin_header = 1;
 
     if(remote_log_levels == RTP_OFF)
         rtp_log_thread_init();
 
     log_levels = levels;        //Must be last, to wait for all inicialization job is done.
+    update_log_mask();
 
     return 0;
 }
@@ -408,85 +773,126 @@ int rtp_init_remote_log(const char *ip, uint16_t port, rtp_log_level_t levels)
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = in_addr;
+    remote_init();
 
     if(log_levels == RTP_OFF)
         rtp_log_thread_init();
 
     remote_log_levels = levels;
+    update_log_mask();
     return 0;
 }
 
 void __rtp_print_log(rtp_log_level_t log_level, char *func, char *message, ...)
 {
-    if(log_level == RTP_OFF && remote_log_levels == RTP_OFF)
+    //omiting logs that dont belong to enabled log level
+    if((__atomic_load_n(&__rtp_log_mask, __ATOMIC_RELAXED) & log_level) == 0)
         return;
 
     if(message == NULL) return;
 
-    char *log_msg = NULL;
-
-    //omiting logs that dont belong to enabled log level
-    if(((remote_log_levels | log_levels) & log_level) != 0)
-        log_msg = create_log(log_level, func, message);
-    else
+    uint32_t pos;
+    struct log_record *rec = claim_record(&pos);
+    if(rec == NULL)                                 //log ring is full
         return;
 
+    gettimeofday(&(rec->tv), NULL);
+    rec->log_level = log_level;
+    rec->func = func;
+
     va_list args;                                   //list of variables to print
     va_start(args, message);
-    char logstr[strlen(log_msg) + 50];
-    vsprintf(logstr, log_msg, args);                // adding variables into string
+    if(log_format == RTP_LOG_TEXT) {
+        rec->fmt = NULL;
+        int len = vsnprintf(rec->text, sizeof(rec->text), message, args);
+        if(len >= (int) sizeof(rec->text))         //truncated message keeps end of line
+            rec->text[sizeof(rec->text) - 2] = '\n';
+    } else {                                        //formatted by log thread or decoder
+        rec->fmt = message;
+        rec->args_len = rtp_log_encode(rec->text, sizeof(rec->text), message, args);
+    }
     va_end(args);
 
-    put_log(logstr, log_level);
+    commit_record(rec, pos);
+}
 
-    if(log_msg != NULL) {
-        free((void *) log_msg);
-        log_msg = NULL;
-    }
+int rtp_set_log_options(unsigned int size, unsigned int timeout, unsigned int interval)
+{
+    if(size == 0)
+        return -1;
+    flush_size = size;
+    flush_time = timeout;
+    sync_interval = interval;
+    return 0;
 }
 
-//Close pipe, cancel thread and wait for thread ending.
+int rtp_set_remote_log_options(unsigned int mtu, unsigned int timeout, unsigned int rate)
+{
+    if(mtu < REMOTE_MTU_MIN || mtu > REMOTE_MTU_MAX)
+        return -1;
+    remote_mtu = mtu;
+    remote_flush_time = timeout;
+    remote_rate = rate;
+    return 0;
+}
+
+void rtp_set_log_format(rtp_log_format_t format)
+{
+    log_format = format;
+}
+
+uint64_t rtp_log_dropped(void)
+{
+    return __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+}
+
+//Stops log thread and waits for its ending. Logs remaining in ring are handled.
 static inline void rtp_close_log_thread()
 {
-    void *foo = NULL;
     if(log_thread == NULL)
         return;
 
-    pthread_cancel(*log_thread);
-    pthread_join(*log_thread, &foo);
+    log_thread_running = 0;
+    pthread_join(*log_thread, NULL);
 
     free(log_thread);
     log_thread = NULL;
-
-    close(pipefd[PIPE_WRITE]);
-    close(pipefd[PIPE_READ]);
 }
 
 void rtp_close_remote_log(void)
 {
-    //must be first, because of turning off writing logs to the pipe
     if(remote_log_levels == RTP_OFF) return;
-    remote_log_levels = RTP_OFF;
 
-    if(log_levels == RTP_OFF)
+    //logs remaining in ring are sent before remote logging is turned off, socket is used
+    //by log thread, so it is closed by log thread while logging to file keeps it running
+    if(log_levels == RTP_OFF) {
         rtp_close_log_thread();
-
-    if(sockfd != -1) {
-        close(sockfd);
-        sockfd = -1;
+        remote_close();
+        remote_log_levels = RTP_OFF;
+    } else {
+        __atomic_store_n(&remote_closing, 1, __ATOMIC_RELEASE);
+        while(__atomic_load_n(&remote_closing, __ATOMIC_ACQUIRE))
+            usleep(LOG_POLL_TIME);
     }
+    update_log_mask();
 }
 
 void rtp_close_log(void)
 {
-    //must be first, because of turning off writing logs to the pipe
     if(log_levels == RTP_OFF) return;
-    log_levels = RTP_OFF;
 
+    //logs remaining in ring are written before logging to file is turned off
     if(remote_log_levels == RTP_OFF)
         rtp_close_log_thread();
+    log_levels = RTP_OFF;
+    update_log_mask();
 
+    rtp_task_wait(&rotate_task);
+    rtp_task_wait(&sync_task);
+    flush_logfile();
     if(flog != NULL && flog != stdout && flog != stderr) {
+        if(sync_interval != RTP_LOG_SYNC_OFF)
+            fdatasync(fileno(flog));
         fclose(flog);
         flog = NULL;
     }
@@ -29,15 +29,48 @@ int rtp_init_log(const char *flog_path, rtp_log_level_t levels, unsigned int max
  */
 int rtp_init_remote_log(const char *ip, uint16_t port, rtp_log_level_t levels);
 
+/**
+ * Minimum level of log messages compiled in (numeric value of rtp_log_level_t, e.g. 2
+ * for RTP_INFO). Calls of rtp_print_log() with lower constant level compile to nothing.
+ */
+#ifndef RTP_LOG_MIN_LEVEL
+#define RTP_LOG_MIN_LEVEL 0
+#endif
+
+/**
+ * Bit array of levels enabled in logging to file or to remote destination. This variable
+ * shouldn't be used, it is checked by makro rtp_print_log.
+ */
+extern rtp_log_level_t __rtp_log_mask;
+
+/**
+ * Sets options of logging to file (see rtp_store_logconfig()). Must be called before
+ * rtp_init_log().
+ * \returns 0 on success and -1 on error.
+ */
+int rtp_set_log_options(unsigned int flush_size, unsigned int flush_time, unsigned int sync_interval);
+
+/**
+ * Sets options of logging to remote location (see rtp_store_remote_logconfig()).
+ * Must be called before rtp_init_remote_log().
+ * \returns 0 on success and -1 on error.
+ */
+int rtp_set_remote_log_options(unsigned int mtu, unsigned int flush_time, unsigned int rate);
+
 /**
  * Prints log message. Takes same addtional parameters and text modifiers
- * (%d, %s ...) to print variables as printf().
+ * (%d, %s ...) to print variables as printf(). Arguments are not evaluated, when level
+ * of message is not enabled.
  * \param rtp_log_level_t log_level Level of logging message.
  * \param char *message String of desired logging message.
  */
 #ifdef __GNUC__
-#define rtp_print_log(log_level, message, ...) __rtp_print_log(log_level, (char *)__FUNCTION__, \
-                                                               message, ##__VA_ARGS__)
+#define rtp_print_log(log_level, message, ...)                                              \
+    do {                                                                                    \
+        if((log_level) >= RTP_LOG_MIN_LEVEL                                                 \
+           && __builtin_expect((__atomic_load_n(&__rtp_log_mask, __ATOMIC_RELAXED) & (log_level)) != 0, 0)) \
+            __rtp_print_log(log_level, (char *)__FUNCTION__, message, ##__VA_ARGS__);      \
+    } while(0)
 #endif
 
 /**
@@ -50,6 +83,17 @@ int rtp_init_remote_log(const char *ip, uint16_t port, rtp_log_level_t levels);
  */
 void __rtp_print_log(rtp_log_level_t log_level, char *func, char *message, ...);
 
+/**
+ * Sets format of log messages (see rtp_log_format_t). Must be called before logging
+ * is initialized.
+ */
+void rtp_set_log_format(rtp_log_format_t format);
+
+/**
+ * Returns count of log messages dropped because log ring was full.
+ */
+uint64_t rtp_log_dropped(void);
+
 /**
  * Closes logging to remote destination.
  */
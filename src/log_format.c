@@ -0,0 +1,341 @@
+/*
+ * log_format.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "log_format.h"
+
+#define SPEC_LEN 32                         //maximum length of rebuilt conversion specification
+#define FIELD_LEN 8                         //maximum length of flags, width and precision
+
+static const char *strlog_levels[] = {"", "DEBUG", "INFO", "", "WARN", "", "", "", "ERROR"};
+
+//Length modifiers of conversion specification.
+typedef enum {LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_BIG_L, LEN_J, LEN_Z, LEN_T} spec_length_t;
+
+//Classes of arguments of conversion specification.
+typedef enum {ARG_NONE, ARG_INT, ARG_LONG, ARG_DOUBLE, ARG_STRING, ARG_ERRNO, ARG_PTR, ARG_COUNT, ARG_UNKNOWN} arg_class_t;
+
+//Conversion specification parsed from format string.
+struct conv_spec {
+    char flags[FIELD_LEN];                  //flags
+    char width[FIELD_LEN];                  //width, empty if not given or given by argument
+    char prec[FIELD_LEN];                   //precision (without '.')
+    int width_arg;                          //1 if width is given by argument ('*')
+    int prec_arg;                           //1 if precision is given by argument ('*')
+    int has_prec;                           //1 if precision is given
+    spec_length_t length;                   //length modifier
+    char conv;                              //conversion specifier
+};
+
+//Copies characters of p, that are in set accept, into field. Returns pointer after them.
+static const char *parse_field(const char *p, const char *accept, char *field)
+{
+    size_t n = 0;
+    while(*p != '\0' && strchr(accept, *p) != NULL) {
+        if(n < FIELD_LEN - 1)
+            field[n++] = *p;
+        p++;
+    }
+    field[n] = '\0';
+    return p;
+}
+
+//Parses conversion specification starting after '%'. Returns pointer after it.
+static const char *parse_spec(const char *p, struct conv_spec *spec)
+{
+    p = parse_field(p, "-+ #0'", spec->flags);
+
+    spec->width_arg = *p == '*';
+    if(spec->width_arg) {
+        spec->width[0] = '\0';
+        p++;
+    } else
+        p = parse_field(p, "0123456789", spec->width);
+
+    spec->has_prec = *p == '.';
+    spec->prec_arg = 0;
+    spec->prec[0] = '\0';
+    if(spec->has_prec) {
+        p++;
+        spec->prec_arg = *p == '*';
+        if(spec->prec_arg)
+            p++;
+        else
+            p = parse_field(p, "0123456789", spec->prec);
+    }
+
+    spec->length = LEN_NONE;
+    switch(*p) {
+    case 'h':
+        spec->length = p[1] == 'h' ? LEN_HH : LEN_H;
+        p += p[1] == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        spec->length = p[1] == 'l' ? LEN_LL : LEN_L;
+        p += p[1] == 'l' ? 2 : 1;
+        break;
+    case 'q': spec->length = LEN_LL; p++; break;
+    case 'L': spec->length = LEN_BIG_L; p++; break;
+    case 'j': spec->length = LEN_J; p++; break;
+    case 'z': spec->length = LEN_Z; p++; break;
+    case 't': spec->length = LEN_T; p++; break;
+    }
+
+    spec->conv = *p;
+    return *p != '\0' ? p + 1 : p;
+}
+
+//Returns class of argument of conversion specification.
+static arg_class_t arg_class(const struct conv_spec *spec)
+{
+    switch(spec->conv) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        return spec->length == LEN_NONE || spec->length == LEN_H || spec->length == LEN_HH ? ARG_INT : ARG_LONG;
+    case 'c':
+        return spec->length == LEN_NONE ? ARG_INT : ARG_UNKNOWN;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        return ARG_DOUBLE;
+    case 's':
+        return spec->length == LEN_NONE ? ARG_STRING : ARG_UNKNOWN;
+    case 'm':
+        return ARG_ERRNO;
+    case 'p':
+        return ARG_PTR;
+    case 'n':
+        return ARG_COUNT;
+    case '%':
+        return ARG_NONE;
+    default:
+        return ARG_UNKNOWN;
+    }
+}
+
+//Appends value of size len to encoded arguments. Returns 0 on success, -1 if it doesn't fit.
+static inline int put_value(char *args, size_t size, size_t *pos, const void *value, size_t len)
+{
+    if(*pos + len > size)
+        return -1;
+    memcpy(args + *pos, value, len);
+    *pos += len;
+    return 0;
+}
+
+//Appends string (truncated to fit) to encoded arguments. Returns 0 on success, -1 otherwise.
+static inline int put_string(char *args, size_t size, size_t *pos, const char *str)
+{
+    if(str == NULL)
+        str = "(null)";
+    if(*pos + sizeof(uint16_t) > size)
+        return -1;
+    size_t len = strlen(str);
+    if(len > size - *pos - sizeof(uint16_t))
+        len = size - *pos - sizeof(uint16_t);
+    uint16_t slen = (uint16_t) len;
+    put_value(args, size, pos, &slen, sizeof(slen));
+    return put_value(args, size, pos, str, len);
+}
+
+size_t rtp_log_encode(char *args, size_t size, const char *fmt, va_list ap)
+{
+    size_t pos = 0;
+    int err = errno;                        //for %m
+    const char *p = fmt;
+    while((p = strchr(p, '%')) != NULL) {
+        struct conv_spec spec;
+        p = parse_spec(p + 1, &spec);
+
+        int64_t value;
+        if(spec.width_arg) {
+            value = va_arg(ap, int);
+            if(put_value(args, size, &pos, &value, sizeof(value)) == -1)
+                break;
+        }
+        if(spec.prec_arg) {
+            value = va_arg(ap, int);
+            if(put_value(args, size, &pos, &value, sizeof(value)) == -1)
+                break;
+        }
+
+        int retval = 0;
+        switch(arg_class(&spec)) {
+        case ARG_INT:
+            value = va_arg(ap, int);
+            retval = put_value(args, size, &pos, &value, sizeof(value));
+            break;
+        case ARG_LONG:
+            switch(spec.length) {
+            case LEN_L: value = va_arg(ap, long); break;
+            case LEN_J: value = va_arg(ap, intmax_t); break;
+            case LEN_Z: value = va_arg(ap, size_t); break;
+            case LEN_T: value = va_arg(ap, ptrdiff_t); break;
+            default: value = va_arg(ap, long long); break;
+            }
+            retval = put_value(args, size, &pos, &value, sizeof(value));
+            break;
+        case ARG_DOUBLE: {
+            double dvalue = spec.length == LEN_BIG_L ? (double) va_arg(ap, long double) : va_arg(ap, double);
+            retval = put_value(args, size, &pos, &dvalue, sizeof(dvalue));
+            break;
+        }
+        case ARG_STRING:
+            retval = put_string(args, size, &pos, va_arg(ap, const char *));
+            break;
+        case ARG_ERRNO:
+            retval = put_string(args, size, &pos, strerror(err));
+            break;
+        case ARG_PTR:
+            value = (int64_t) (intptr_t) va_arg(ap, void *);
+            retval = put_value(args, size, &pos, &value, sizeof(value));
+            break;
+        case ARG_COUNT:
+            (void) va_arg(ap, void *);      //%n is ignored
+            break;
+        case ARG_NONE:
+            break;
+        case ARG_UNKNOWN:
+            retval = -1;
+            break;
+        }
+        if(retval == -1)
+            break;
+    }
+    return pos;
+}
+
+//Takes value of size len from encoded arguments. Returns 0 on success, -1 if there are no more.
+static inline int get_value(const char *args, size_t len, size_t *pos, void *value, size_t size)
+{
+    if(*pos + size > len)
+        return -1;
+    memcpy(value, args + *pos, size);
+    *pos += size;
+    return 0;
+}
+
+//Appends formatted text to out. Keeps out terminated by \0.
+#define APPEND(out, size, n, ...) do {                                          \
+        if((n) < (size)) {                                                      \
+            int _len = snprintf((out) + (n), (size) - (n), __VA_ARGS__);        \
+            if(_len > 0) (n) += (size_t) _len;                                  \
+        }                                                                       \
+    } while(0)
+
+size_t rtp_log_decode(char *out, size_t size, const char *fmt, const char *args, size_t len)
+{
+    size_t n = 0;
+    size_t pos = 0;
+    const char *p = fmt;
+    out[0] = '\0';
+    while(*p != '\0') {
+        const char *pct = strchr(p, '%');
+        size_t lit = pct != NULL ? (size_t) (pct - p) : strlen(p);
+        APPEND(out, size, n, "%.*s", (int) lit, p);
+        if(pct == NULL)
+            break;
+
+        struct conv_spec spec;
+        p = parse_spec(pct + 1, &spec);
+        arg_class_t class = arg_class(&spec);
+        if(class == ARG_NONE) {
+            APPEND(out, size, n, "%%");
+            continue;
+        }
+        if(class == ARG_COUNT)
+            continue;
+
+        //conversion specification is rebuilt with width and precision taken from arguments
+        int64_t width = 0;
+        int64_t prec = 0;
+        if((spec.width_arg && get_value(args, len, &pos, &width, sizeof(width)) == -1)
+           || (spec.prec_arg && get_value(args, len, &pos, &prec, sizeof(prec)) == -1))
+            goto TRUNCATED;
+        char cspec[SPEC_LEN];
+        int slen = sprintf(cspec, "%%%s", spec.flags);
+        if(spec.width_arg)
+            slen += sprintf(cspec + slen, "%d", (int) width);
+        else
+            slen += sprintf(cspec + slen, "%s", spec.width);
+        if(spec.has_prec && spec.prec_arg)
+            slen += sprintf(cspec + slen, ".%d", (int) prec);
+        else if(spec.has_prec)
+            slen += sprintf(cspec + slen, ".%s", spec.prec);
+
+        int64_t value;
+        switch(class) {
+        case ARG_INT:
+            if(get_value(args, len, &pos, &value, sizeof(value)) == -1)
+                goto TRUNCATED;
+            sprintf(cspec + slen, "%s%c", spec.length == LEN_HH ? "hh" : spec.length == LEN_H ? "h" : "", spec.conv);
+            APPEND(out, size, n, cspec, (int) value);
+            break;
+        case ARG_LONG:
+            if(get_value(args, len, &pos, &value, sizeof(value)) == -1)
+                goto TRUNCATED;
+            sprintf(cspec + slen, "ll%c", spec.conv);
+            APPEND(out, size, n, cspec, (long long) value);
+            break;
+        case ARG_DOUBLE: {
+            double dvalue;
+            if(get_value(args, len, &pos, &dvalue, sizeof(dvalue)) == -1)
+                goto TRUNCATED;
+            sprintf(cspec + slen, "%c", spec.conv);
+            APPEND(out, size, n, cspec, dvalue);
+            break;
+        }
+        case ARG_STRING:
+        case ARG_ERRNO: {
+            uint16_t str_len;
+            if(get_value(args, len, &pos, &str_len, sizeof(str_len)) == -1 || pos + str_len > len)
+                goto TRUNCATED;
+            char str[str_len + 1];
+            memcpy(str, args + pos, str_len);
+            str[str_len] = '\0';
+            pos += str_len;
+            sprintf(cspec + slen, "s");
+            APPEND(out, size, n, cspec, str);
+            break;
+        }
+        case ARG_PTR:
+            if(get_value(args, len, &pos, &value, sizeof(value)) == -1)
+                goto TRUNCATED;
+            sprintf(cspec + slen, "p");
+            APPEND(out, size, n, cspec, (void *) (intptr_t) value);
+            break;
+        default:
+            goto TRUNCATED;
+        }
+    }
+    return n < size ? n : size - 1;
+
+    TRUNCATED:                              //arguments didn't fit into record
+    APPEND(out, size, n, "...\n");
+    return n < size ? n : size - 1;
+}
+
+size_t rtp_log_line(char *out, size_t size, rtp_log_level_t log_level, const struct timeval *tv,
+                    const char *func, const char *message)
+{
+    struct tm now;
+    localtime_r(&(tv->tv_sec), &now);
+    int msecs = tv->tv_usec / 1000;                         //miliseconds
+
+    char time[10];
+    char date[12];
+    strftime(time, sizeof(time), "%H:%M:%S", &now);         //format:H:M:S (hod)
+    strftime(date, sizeof(date), "%F", &now);               //format:Y-M-D (ISO8601)
+
+    const char *level = (unsigned int) log_level < sizeof(strlog_levels) / sizeof(strlog_levels[0])
+                        ? strlog_levels[(int) log_level] : "";
+    int len = snprintf(out, size, "%s %s,%d [RtpStore:%s()] %s - %s", date, time, msecs, func, level, message);
+    if(len < 0)
+        return 0;
+    return (size_t) len < size ? (size_t) len : size - 1;
+}
@@ -0,0 +1,108 @@
+/*
+ * log_format.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef LOG_FORMAT_H_
+#define LOG_FORMAT_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "rtp_store.h"
+
+/**
+ * Module of formatting of log messages. Shared by logging thread and decoder of binary
+ * log files (rtplogdump).
+ *
+ * When formatting is deferred, caller of rtp_print_log() stores only pointer to format
+ * string and raw values of arguments encoded by rtp_log_encode(). Message is formatted
+ * later by rtp_log_decode(). Integers are encoded as 8 bytes, floating point numbers as
+ * double, pointers as 8 bytes and strings as 2 bytes of length followed by characters.
+ */
+
+/*
+ * binary log file format
+ *
+ * The file starts with rtp_logbin_hdr_t. It is followed by records starting with one
+ * byte of type. Record RTP_LOGBIN_STRING (rtp_logbin_string_t followed by len characters)
+ * defines string (format string or function name) referred by id in following records.
+ * Record RTP_LOGBIN_MESSAGE (rtp_logbin_msg_t followed by len bytes of encoded arguments)
+ * is log message with deferred formatting, record RTP_LOGBIN_TEXT (rtp_logbin_msg_t
+ * followed by len characters, fmt is unused) is already formatted log message. Header
+ * may appear again (e.g. when file was appended), definitions of strings are reset then.
+ * Fields are in byte order of host, that wrote the file (see bom).
+ */
+
+#define RTP_LOGBIN_MAGIC "RTPLOGB1"
+#define RTP_LOGBIN_BOM 0x01020304
+
+#define RTP_LOGBIN_STRING 'S'
+#define RTP_LOGBIN_MESSAGE 'M'
+#define RTP_LOGBIN_TEXT 'T'
+
+typedef struct {
+	char magic[8];				/**< RTP_LOGBIN_MAGIC*/
+	uint32_t bom;				/**< RTP_LOGBIN_BOM in byte order of file*/
+	uint32_t reserved;			/**< 0*/
+} rtp_logbin_hdr_t;
+
+typedef struct {
+	uint8_t type;				/**< RTP_LOGBIN_STRING*/
+	uint8_t reserved;			/**< 0*/
+	uint16_t len;				/**< length of string*/
+	uint32_t id;				/**< ID of string*/
+} rtp_logbin_string_t;
+
+typedef struct {
+	uint8_t type;				/**< RTP_LOGBIN_MESSAGE or RTP_LOGBIN_TEXT*/
+	uint8_t level;				/**< level of log message*/
+	uint16_t len;				/**< length of encoded arguments or text*/
+	uint32_t usec;				/**< microseconds of time of log message*/
+	int64_t sec;				/**< seconds of time of log message*/
+	uint32_t func;				/**< ID of name of function, where message was logged*/
+	uint32_t fmt;				/**< ID of format string*/
+} rtp_logbin_msg_t;
+
+/**
+ * Maximum length of log message formatted by rtp_log_decode().
+ */
+#define RTP_LOG_MSG_LEN 1024
+
+/**
+ * Encodes arguments of format string fmt.
+ * \param args (out) Buffer where arguments are encoded.
+ * \param size Size of buffer args.
+ * \param fmt Format string (as for printf()).
+ * \param ap Arguments of format string.
+ * \return Length of encoded arguments. Arguments, that don't fit into buffer, are omitted.
+ */
+size_t rtp_log_encode(char *args, size_t size, const char *fmt, va_list ap);
+
+/**
+ * Formats message from format string and arguments encoded by rtp_log_encode().
+ * \param out (out) Formatted message, always terminated by \0.
+ * \param size Size of buffer out.
+ * \param fmt Format string.
+ * \param args Encoded arguments.
+ * \param len Length of encoded arguments.
+ * \return Length of formatted message.
+ */
+size_t rtp_log_decode(char *out, size_t size, const char *fmt, const char *args, size_t len);
+
+/**
+ * Formats line of log file: date, time, function, level and message.
+ * \param out (out) Formatted line, always terminated by \0.
+ * \param size Size of buffer out.
+ * \param log_level Level of log message.
+ * \param tv Time of log message.
+ * \param func Function, where message was logged.
+ * \param message Log message.
+ * \return Length of formatted line.
+ */
+size_t rtp_log_line(char *out, size_t size, rtp_log_level_t log_level, const struct timeval *tv,
+                    const char *func, const char *message);
+
+#endif /* LOG_FORMAT_H_ */
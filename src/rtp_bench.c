@@ -0,0 +1,492 @@
+/*
+ * rtp_bench.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rtp_store.h"
+#include "log.h"
+#include "rtp_stream_thread.h"
+#include "rtp_network.h"
+#include "rtp_foutput.h"
+#include "rtp_registry.h"
+#include "rtp_writer.h"
+
+/**
+ * rtpbench - microbenchmarks of ingest path. Measures ns/packet and packets/sec of
+ * rtp_parse_header(), rtp_packet_handler(), rtp_write_packet(), read_from_sock() and
+ * __rtp_print_log() on synthetic RTP, RTCP and VAT packets. VAT packets are measured by
+ * rtp_parse_header() only, rtp_packet_filter() rejects them. read_from_sock() is measured
+ * with datagrams received directly into queue of stream (recv_direct) and copied from
+ * receive buffers (recv_copy). Packets are stored by running RtpStore (writers
+ * write them to file), so write strategies can be compared by options. Queue of stream
+ * blocks by default, so every packet is stored, dropped packets are reported.
+ * Usage: rtpbench [-n packets] [-l log messages] [-r repetitions] [-f csv|json] [-d directory]
+ *                 [-P port] [-w writers] [-q queue size] [-p block|drop|oldest]
+ *                 [-o output buffer] [-i flush interval] [-D (O_DIRECT output)]
+ */
+
+#define PACKET_POOL 256                 //count of different packets, that are iterated
+#define LOG_BURST 3072                  //count of log messages logged between pauses (fit into log ring)
+#define LOG_PAUSE 15000                 //pause in microseconds, when log thread drains ring
+#define MAX_REPS 64                     //maximum count of repetitions
+
+//Synthetic packet.
+struct bench_packet {
+    const char *name;                   //name of packet in results
+    int len;                            //length of packet (without rtpdump header)
+    int is_rtcp;                        //1 for RTCP packet
+    int version;                        //version of RTP (0 for VAT)
+    int payload_type;                   //payload type of RTP packet, packet type of RTCP
+    rtp_session_type_t type;            //session of packet
+};
+
+static const struct bench_packet bench_packets[] = {
+    {"rtp-audio", 172, 0, 2, 0, RTP_AUDIO},         //G.711, 20 ms
+    {"rtp-video", 1200, 0, 2, 96, RTP_VIDEO},       //H.264 fragment
+    {"rtcp", 80, 1, 2, 200, RTP_AUDIO},             //SR + SDES
+    {"vat", 168, 0, 0, 0, RTP_AUDIO}                //VAT audio, 20 ms
+};
+
+#define BENCH_PACKETS (sizeof(bench_packets) / sizeof(bench_packets[0]))
+
+//Result of one benchmark.
+struct bench_result {
+    const char *bench;                  //name of benchmark
+    const char *packet;                 //name of packet or log format
+    int size;                           //size of packet in bytes
+    long count;                         //count of packets (messages) in one repetition
+    double ns_best;                     //the best time of repetitions in ns/packet
+    double ns_median;                   //median time of repetitions in ns/packet
+    uint64_t dropped;                   //count of packets (messages) dropped by queue (log ring)
+};
+
+//options of benchmark
+static long packets = 1000000;
+static long messages = 100000;
+static int reps = 5;
+static int json = 0;
+static const char *dir = "/tmp";
+static uint16_t port = 41000;
+static struct rtp_store_config config;
+
+static int results_count = 0;
+static volatile uint64_t sink = 0;      //consumes results, so they are not optimized out
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static const char *policy_name(rtp_queue_policy_t policy)
+{
+    switch(policy) {
+    case RTP_QUEUE_DROP_OLDEST: return "oldest";
+    case RTP_QUEUE_BLOCK: return "block";
+    default: return "drop";
+    }
+}
+
+//Prints result of benchmark res.
+static void print_result(const struct bench_result *res)
+{
+    double pps = res->ns_median > 0 ? 1e9 / res->ns_median : 0;
+    if(json)
+        printf("%s  {\"bench\": \"%s\", \"packet\": \"%s\", \"size\": %d, \"packets\": %ld, \"reps\": %d, "
+               "\"ns_per_packet\": %.2f, \"ns_per_packet_best\": %.2f, \"packets_per_sec\": %.0f, "
+               "\"dropped\": %llu, \"writers\": %u, \"queue_size\": %u, \"queue_policy\": \"%s\", "
+               "\"output_buffer\": %u, \"flush_interval\": %u, \"direct_io\": %d}",
+               results_count > 0 ? ",\n" : "", res->bench, res->packet, res->size, res->count, reps,
+               res->ns_median, res->ns_best, pps, (unsigned long long) res->dropped, config.writers,
+               config.queue_size, policy_name(config.queue_policy), config.output_buffer,
+               config.flush_interval, config.direct_io);
+    else {
+        if(results_count == 0)
+            printf("bench,packet,size,packets,reps,ns_per_packet,ns_per_packet_best,packets_per_sec,"
+                   "dropped,writers,queue_size,queue_policy,output_buffer,flush_interval,direct_io\n");
+        printf("%s,%s,%d,%ld,%d,%.2f,%.2f,%.0f,%llu,%u,%u,%s,%u,%u,%d\n", res->bench, res->packet,
+               res->size, res->count, reps, res->ns_median, res->ns_best, pps,
+               (unsigned long long) res->dropped, config.writers, config.queue_size,
+               policy_name(config.queue_policy), config.output_buffer, config.flush_interval,
+               config.direct_io);
+    }
+    results_count++;
+    fflush(stdout);
+}
+
+//Sets best and median time of result res from times of repetitions.
+static void set_times(struct bench_result *res, double *times)
+{
+    qsort(times, reps, sizeof(double), cmp_double);
+    res->ns_best = times[0];
+    res->ns_median = times[reps / 2];
+}
+
+//Fills packet data of type bp with sequence number seq.
+static void fill_packet(char *data, const struct bench_packet *bp, uint16_t seq)
+{
+    memset(data, 0, bp->len);
+    uint32_t ts = htonl(seq * (bp->type == RTP_VIDEO ? 3000 : 160));
+    uint32_t ssrc = htonl(bp->type == RTP_VIDEO ? 0x1000 : 0x2000);
+    if(bp->is_rtcp) {
+        data[0] = (char) 0x80;                      //version 2, no reception reports
+        data[1] = (char) bp->payload_type;
+        uint16_t length = htons(6);                 //length of SR in 32-bit words - 1
+        memcpy(data + 2, &length, 2);
+        memcpy(data + 4, &ssrc, 4);
+    } else if(bp->version == 0) {
+        data[0] = 0;                                //version 0, no speaker ids
+        data[1] = 0;                                //audio format
+        memcpy(data + 4, &ts, 4);
+    } else {
+        data[0] = (char) (bp->version << 6);
+        data[1] = (char) bp->payload_type;
+        uint16_t nseq = htons(seq);
+        memcpy(data + 2, &nseq, 2);
+        memcpy(data + 4, &ts, 4);
+        memcpy(data + 8, &ssrc, 4);
+    }
+}
+
+//Sets sequence number and timestamp of RTP packet of type bp.
+static inline void set_seq(char *data, const struct bench_packet *bp, uint16_t seq)
+{
+    if(bp->is_rtcp || bp->version != 2)
+        return;
+    uint16_t nseq = htons(seq);
+    uint32_t ts = htonl(seq * (bp->type == RTP_VIDEO ? 3000 : 160));
+    memcpy(data + 2, &nseq, 2);
+    memcpy(data + 4, &ts, 4);
+}
+
+//Returns count of packets dropped by queue of stream.
+static uint64_t stream_dropped(struct rtp_stream *stream)
+{
+    return rtp_get_stream_info(stream).queue.dropped;
+}
+
+//Waits until writer wrote all packets queued by previous repetitions.
+static void wait_written(struct rtp_stream *stream)
+{
+    rtp_writer_notify(stream->writer);
+    struct rtp_queue_stats queue = rtp_get_stream_info(stream).queue;
+    while(queue.written < queue.queued) {
+        usleep(LOG_PAUSE);
+        queue = rtp_get_stream_info(stream).queue;
+    }
+}
+
+//Warns that time of benchmark res includes packets dropped by queue.
+static void warn_dropped(const struct bench_result *res)
+{
+    if(res->dropped > 0)
+        fprintf(stderr, "rtpbench: %s %s: %llu packets dropped by queue, time includes dropping "
+                        "(use -p block or larger -q)\n", res->bench, res->packet,
+                (unsigned long long) res->dropped);
+}
+
+static void bench_parse_header(const struct bench_packet *bp, RD_buffer_t *pool)
+{
+    struct bench_result res = {"parse_header", bp->name, bp->len, packets, 0, 0, 0};
+    double times[MAX_REPS];
+    int i, r;
+    for(i = 0; i < PACKET_POOL; i++)
+        fill_packet(pool[i].p.data, bp, i);
+
+    for(r = 0; r < reps; r++) {
+        uint64_t sum = 0;
+        uint64_t start = now_ns();
+        long n;
+        for(n = 0; n < packets; n++)
+            sum += rtp_parse_header(pool[n & (PACKET_POOL - 1)].p.data);
+        times[r] = (double) (now_ns() - start) / packets;
+        sink += sum;
+    }
+    set_times(&res, times);
+    print_result(&res);
+}
+
+static void bench_packet_handler(const struct bench_packet *bp, struct rtp_recv_batch *batch,
+                                 struct rtp_stream *stream)
+{
+    struct bench_result res = {"packet_handler", bp->name, bp->len, packets, 0, 0, 0};
+    double times[MAX_REPS];
+    unsigned int i;
+    int r;
+    uint16_t seq = 0;
+    for(i = 0; i < batch->size; i++) {
+        fill_packet(batch->packets[i].p.data, bp, 0);
+        batch->msgs[i].msg_hdr.msg_controllen = 0;  //arrival time is taken by gettimeofday()
+        batch->msgs[i].msg_len = bp->len;
+    }
+
+    uint64_t dropped = stream_dropped(stream);
+    for(r = 0; r < reps; r++) {
+        wait_written(stream);                       //writers drain queue
+        uint64_t start = now_ns();
+        long n;
+        for(n = 0; n < packets; n += batch->size) {
+            for(i = 0; i < batch->size; i++)
+                set_seq(batch->packets[i].p.data, bp, seq++);
+            rtp_packet_handler(bp->is_rtcp, batch, batch->size, bp->type, stream);
+            rtp_writer_notify(stream->writer);      //as worker does after each batch
+        }
+        times[r] = (double) (now_ns() - start) / n;
+    }
+    res.dropped = stream_dropped(stream) - dropped;
+    set_times(&res, times);
+    print_result(&res);
+    warn_dropped(&res);
+}
+
+static void bench_write_packet(const struct bench_packet *bp, RD_buffer_t *pool, struct rtp_stream *stream)
+{
+    struct bench_result res = {"write_packet", bp->name, bp->len, packets, 0, 0, 0};
+    double times[MAX_REPS];
+    int i, r;
+    for(i = 0; i < PACKET_POOL; i++) {
+        fill_packet(pool[i].p.data, bp, i);
+        pool[i].p.hdr.length = htons(bp->len + sizeof(pool[i].p.hdr));
+        pool[i].p.hdr.plen = bp->is_rtcp ? 0 : htons(bp->len);
+        pool[i].p.hdr.offset = htonl(i * 20);
+    }
+
+    uint64_t dropped = stream_dropped(stream);
+    uint16_t seq = 0;
+    for(r = 0; r < reps; r++) {
+        wait_written(stream);
+        uint64_t start = now_ns();
+        long n;
+        for(n = 0; n < packets; n++) {
+            RD_buffer_t *packet = &pool[n & (PACKET_POOL - 1)];
+            set_seq(packet->p.data, bp, seq++);
+            rtp_write_packet(bp->type, packet, bp->len + sizeof(packet->p.hdr), stream, 0);
+            if((n & (PACKET_POOL - 1)) == PACKET_POOL - 1)
+                rtp_writer_notify(stream->writer);
+        }
+        times[r] = (double) (now_ns() - start) / packets;
+    }
+    res.dropped = stream_dropped(stream) - dropped;
+    set_times(&res, times);
+    print_result(&res);
+    warn_dropped(&res);
+}
+
+static void bench_read_from_sock(const struct bench_packet *bp, int direct, RD_buffer_t *pool,
+                                 struct rtp_recv_batch *batch, struct rtp_stream *stream)
+{
+    struct bench_result res = {direct ? "recv_direct" : "recv_copy", bp->name, bp->len, packets, 0, 0, 0};
+    double times[MAX_REPS];
+    unsigned int count = batch->size < PACKET_POOL ? batch->size : PACKET_POOL;
+    struct mmsghdr msgs[count];
+    struct iovec iovs[count];
+    unsigned int i;
+    int r;
+
+    //socket of endpoint is not watched by worker, datagrams are read by benchmark only
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    int rcvbuf = 4 * 1024 * 1024;
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    if(rx == -1 || tx == -1 || setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == -1
+       || bind(rx, (struct sockaddr *) &addr, sizeof(addr)) == -1
+       || getsockname(rx, (struct sockaddr *) &addr, &addr_len) == -1
+       || connect(tx, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "rtpbench: opening sockets of receive benchmark failed\n");
+        goto ON_ERROR;
+    }
+    struct rtp_endpoint ep = {rx, bp->is_rtcp, 0, bp->type, stream};
+
+    memset(msgs, 0, sizeof(msgs));
+    for(i = 0; i < count; i++) {
+        fill_packet(pool[i].p.data, bp, 0);
+        iovs[i].iov_base = pool[i].p.data;
+        iovs[i].iov_len = bp->len;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    config.direct_recv = direct;
+    rtp_net_init(&config);
+    uint64_t dropped = stream_dropped(stream);
+    uint16_t seq = 0;
+    for(r = 0; r < reps; r++) {
+        wait_written(stream);                       //records of previous benchmarks are written
+        uint64_t elapsed = 0;
+        long n;
+        for(n = 0; n < packets; n += count) {
+            for(i = 0; i < count; i++)
+                set_seq(pool[i].p.data, bp, seq++);
+            if(sendmmsg(tx, msgs, count, 0) != (int) count)
+                break;
+            uint64_t start = now_ns();
+            read_from_sock(&ep, batch);
+            elapsed += now_ns() - start;
+        }
+        times[r] = n > 0 ? (double) elapsed / n : 0;
+        rtp_writer_notify(stream->writer);
+    }
+    res.dropped = stream_dropped(stream) - dropped;
+    set_times(&res, times);
+    print_result(&res);
+    warn_dropped(&res);
+
+    ON_ERROR:
+    if(rx != -1)
+        close(rx);
+    if(tx != -1)
+        close(tx);
+}
+
+static void bench_print_log(const char *name, rtp_log_format_t format, const char *log_path)
+{
+    struct bench_result res = {"print_log", name, 0, messages, 0, 0, 0};
+    double times[MAX_REPS];
+    int r;
+
+    rtp_store_logclose();
+    rtp_store_logformat(format);
+    if(rtp_store_loginit(log_path, RTP_ALL, MAX_FSIZE_QUOTA_UNBOUNDED, 1) == -1) {
+        fprintf(stderr, "rtpbench: opening log file %s failed\n", log_path);
+        return;
+    }
+
+    uint64_t dropped = rtp_log_dropped();
+    for(r = 0; r < reps; r++) {
+        uint64_t elapsed = 0;
+        long n = 0;
+        while(n < messages) {
+            uint64_t start = now_ns();
+            int i;
+            for(i = 0; i < LOG_BURST && n < messages; i++, n++)
+                __rtp_print_log(RTP_INFO, "bench_print_log", "Packet seq=%d len=%d ssrc=%u %s\n",
+                                (int) (n & 0xffff), 172, 0x2000u, "rtp-audio");
+            elapsed += now_ns() - start;
+            usleep(LOG_PAUSE);
+        }
+        times[r] = (double) elapsed / messages;
+    }
+    res.dropped = rtp_log_dropped() - dropped;
+    set_times(&res, times);
+    print_result(&res);
+
+    rtp_store_logclose();
+    rtp_store_logformat(RTP_LOG_TEXT);
+    rtp_store_loginit(log_path, RTP_WARN | RTP_ERROR, MAX_FSIZE_QUOTA_UNBOUNDED, 1);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-n packets] [-l log messages] [-r repetitions] [-f csv|json]\n"
+                    "       [-d directory] [-P port] [-w writers] [-q queue size] [-p block|drop|oldest]\n"
+                    "       [-o output buffer MB] [-i flush interval ms] [-D (O_DIRECT output)]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    rtp_store_config_init(&config);
+    config.queue_policy = RTP_QUEUE_BLOCK;          //times of write path, not of dropping
+    int opt;
+    while((opt = getopt(argc, argv, "n:l:r:f:d:P:w:q:p:o:i:D")) != -1) {
+        switch(opt) {
+        case 'n': packets = atol(optarg); break;
+        case 'l': messages = atol(optarg); break;
+        case 'r': reps = atoi(optarg); break;
+        case 'f': json = strcmp(optarg, "json") == 0; break;
+        case 'd': dir = optarg; break;
+        case 'P': port = (uint16_t) atoi(optarg); break;
+        case 'w': config.writers = atoi(optarg); break;
+        case 'q': config.queue_size = atoi(optarg); break;
+        case 'p':
+            if(strcmp(optarg, "oldest") == 0)
+                config.queue_policy = RTP_QUEUE_DROP_OLDEST;
+            else if(strcmp(optarg, "block") == 0)
+                config.queue_policy = RTP_QUEUE_BLOCK;
+            else
+                config.queue_policy = RTP_QUEUE_DROP_NEWEST;
+            break;
+        case 'o': config.output_buffer = atoi(optarg); break;
+        case 'i': config.flush_interval = atoi(optarg); break;
+        case 'D': config.direct_io = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if(packets <= 0 || messages <= 0 || reps <= 0 || reps > MAX_REPS)
+        usage(argv[0]);
+    packets = (packets + PACKET_POOL - 1) & ~((long) PACKET_POOL - 1);
+
+    char log_path[4096], out_path[4096], seek_path[4096];
+    snprintf(log_path, sizeof(log_path), "%s/rtpbench.log", dir);
+    snprintf(out_path, sizeof(out_path), "%s/rtpbench.rtp", dir);
+    snprintf(seek_path, sizeof(seek_path), "%s/rtpbench.rtp.sidx", dir);
+    rtp_store_loginit(log_path, RTP_WARN | RTP_ERROR, MAX_FSIZE_QUOTA_UNBOUNDED, 1);
+
+    if(rtp_store_init_config(&config) == -1) {
+        fprintf(stderr, "rtpbench: initialization of RtpStore failed\n");
+        return 1;
+    }
+    struct rtp_stream_config scfg;
+    rtp_stream_config_init(&scfg);
+    rtp_stream_id_t id = rtp_store_create_stream_config("127.0.0.1", port, port + 2, out_path, &scfg);
+    struct rtp_stream *stream = id == -1 ? NULL : rtp_registry_get(id);
+    struct rtp_recv_batch batch;
+    RD_buffer_t *pool = (RD_buffer_t *) malloc(PACKET_POOL * sizeof(RD_buffer_t));
+    if(stream == NULL || pool == NULL || rtp_recv_batch_init(&batch, config.recv_batch) == -1) {
+        fprintf(stderr, "rtpbench: creating stream failed (see %s)\n", log_path);
+        return 1;
+    }
+
+    if(json)
+        printf("[\n");
+    unsigned int i;
+    for(i = 0; i < BENCH_PACKETS; i++)
+        if(!bench_packets[i].is_rtcp)
+            bench_parse_header(&bench_packets[i], pool);
+    for(i = 0; i < BENCH_PACKETS; i++)
+        if(bench_packets[i].version == 2)           //rtp_packet_filter() rejects other versions
+            bench_packet_handler(&bench_packets[i], &batch, stream);
+    for(i = 0; i < BENCH_PACKETS; i++)
+        if(bench_packets[i].version == 2)
+            bench_write_packet(&bench_packets[i], pool, stream);
+    for(i = 0; i < BENCH_PACKETS; i++) {
+        if(bench_packets[i].version == 2 && !bench_packets[i].is_rtcp) {
+            bench_read_from_sock(&bench_packets[i], 0, pool, &batch, stream);
+            bench_read_from_sock(&bench_packets[i], 1, pool, &batch, stream);
+        }
+    }
+    bench_print_log("text", RTP_LOG_TEXT, log_path);
+    bench_print_log("deferred", RTP_LOG_DEFERRED, log_path);
+    bench_print_log("binary", RTP_LOG_BINARY, log_path);
+    if(json)
+        printf("\n]\n");
+
+    rtp_registry_put(id);
+    rtp_store_close_stream(id);
+    rtp_store_close();
+    rtp_recv_batch_free(&batch);
+    free(pool);
+    unlink(out_path);
+    unlink(seek_path);
+    unlink(log_path);
+    return 0;
+}
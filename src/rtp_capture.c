@@ -0,0 +1,353 @@
+/*
+ * rtp_capture.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>                             //if_nametoindex()
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>                     //ETH_P_IP
+#include <linux/filter.h>
+#include "rtp_store.h"
+#include "rtp_capture.h"
+#include "log.h"
+
+//Geometry of ring. Block is retired after BLOCK_TIMEOUT miliseconds even if it is not full.
+#define RING_SIZE (16 << 20)
+#define MAX_BLOCK_SIZE (1 << 20)
+#define BLOCK_TIMEOUT 2
+#define FRAME_SIZE 2048
+
+//Length of captured part of datagram (maximum size of IP datagram).
+#define SNAP_LEN 0xffff
+
+//Maximum count of ports of one address checked by one part of filter (offsets of jumps are 8 bits).
+#define MAX_GROUP_PORTS 200
+
+#define KEY(addr, port) (((uint64_t) (addr) << 16) | (port))
+#define KEY_ADDR(key) ((uint32_t) ((key) >> 16))
+#define KEY_PORT(key) ((uint16_t) ((key) & 0xffff))
+#define TOMBSTONE UINT64_MAX               //key of removed entry of hash table
+
+//Attaches filter of count instructions code to packet socket. Returns 0 on success, -1 otherwise.
+static int attach_filter(struct rtp_capture *capture, struct sock_filter *code, unsigned int count)
+{
+    struct sock_fprog prog = {
+        .len = count,
+        .filter = code
+    };
+    if(setsockopt(capture->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        rtp_print_log(RTP_ERROR, "Attaching filter to packet socket failed(%s)\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//Compares registered sockets by address and port.
+static int entry_cmp(const void *a, const void *b)
+{
+    uint64_t ka = ((const struct rtp_capture_entry *) a)->key;
+    uint64_t kb = ((const struct rtp_capture_entry *) b)->key;
+    return ka < kb ? -1 : ka > kb;
+}
+
+//Builds filter accepting unfragmented UDP datagrams sent to registered sockets (entries
+//must be sorted) and attaches it. Returns 0 on success, -1 otherwise.
+static int update_filter(struct rtp_capture *capture)
+{
+    //packet socket of type SOCK_DGRAM filters data starting with IP header
+    struct sock_filter head[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),                  //protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),                  //flags and fragment offset
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x3fff, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0)                  //length of IP header
+    };
+    struct sock_filter code[BPF_MAXINSNS];
+    memcpy(code, head, sizeof(head));
+    unsigned int n = sizeof(head) / sizeof(head[0]);
+    unsigned int i = 0;
+    while(i < capture->nentries) {                              //group of ports of one address
+        uint32_t addr = KEY_ADDR(capture->entries[i].key);
+        unsigned int k = 1;
+        while(i + k < capture->nentries && k < MAX_GROUP_PORTS && KEY_ADDR(capture->entries[i + k].key) == addr)
+            k++;
+        if(n + k + 5 > BPF_MAXINSNS) {                          //group and the last instruction
+            rtp_print_log(RTP_ERROR, "Filter of packet socket is too long for %u sockets\n", capture->nentries);
+            return -1;
+        }
+
+        if(addr != htonl(INADDR_ANY)) {
+            code[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 16);    //destination address
+            code[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(addr), 0, k + 2);
+        }
+        code[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2);         //destination port
+        unsigned int j;
+        for(j = 0; j < k; j++)
+            code[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(KEY_PORT(capture->entries[i + j].key)),
+                                                      k - 1 - j, j == k - 1 ? 1 : 0);
+        code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SNAP_LEN);
+        i += k;
+    }
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+
+    return attach_filter(capture, code, n);
+}
+
+//Returns slot of key in hash table.
+static inline unsigned int slot(const struct rtp_capture *capture, uint64_t key)
+{
+    return (unsigned int) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & capture->table_mask;
+}
+
+//Rebuilds hash table of registered sockets. Returns 0 on success, -1 otherwise.
+static int update_table(struct rtp_capture *capture)
+{
+    unsigned int size = 64;
+    while(size < 2 * capture->nentries)
+        size *= 2;
+
+    struct rtp_capture_entry *table = (struct rtp_capture_entry *) calloc(size, sizeof(struct rtp_capture_entry));
+    if(table == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of capture table failed\n");
+        return -1;
+    }
+    free(capture->table);
+    capture->table = table;
+    capture->table_mask = size - 1;
+
+    unsigned int i;
+    capture->wildcards = 0;
+    for(i = 0; i < capture->nentries; i++) {
+        unsigned int s = slot(capture, capture->entries[i].key);
+        while(table[s].ep != NULL)
+            s = (s + 1) & capture->table_mask;
+        table[s] = capture->entries[i];
+        if(KEY_ADDR(capture->entries[i].key) == htonl(INADDR_ANY))
+            capture->wildcards++;
+    }
+    return 0;
+}
+
+//Returns endpoint of socket bound to address and port, NULL if socket is not registered.
+static inline struct rtp_endpoint *lookup(const struct rtp_capture *capture, uint64_t key)
+{
+    unsigned int s = slot(capture, key);
+    while(capture->table[s].ep != NULL) {
+        if(capture->table[s].key == key)
+            return capture->table[s].ep;
+        s = (s + 1) & capture->table_mask;
+    }
+    return NULL;
+}
+
+int rtp_capture_init(struct rtp_capture *capture, const char *ifname, unsigned int block_size)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->map = MAP_FAILED;
+
+    unsigned int ifindex = if_nametoindex(ifname);
+    if(ifindex == 0) {
+        rtp_print_log(RTP_ERROR, "Interface %s of capture not found\n", ifname);
+        return -1;
+    }
+
+    //protocol is set by bind(), after filter and ring are ready
+    capture->fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(capture->fd == -1) {
+        rtp_print_log(RTP_ERROR, "Packet socket failed(%s)\n", strerror(errno));
+        return -1;
+    }
+
+    int version = TPACKET_V3;
+    if(setsockopt(capture->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        rtp_print_log(RTP_ERROR, "Setting TPACKET_V3 failed(%s)\n", strerror(errno));
+        goto ON_ERROR;
+    }
+    if(update_table(capture) == -1 || update_filter(capture) == -1)
+        goto ON_ERROR;
+
+    unsigned int page = (unsigned int) sysconf(_SC_PAGESIZE);
+    if(block_size > MAX_BLOCK_SIZE)
+        block_size = MAX_BLOCK_SIZE;
+    block_size = block_size < page ? page : block_size / page * page;
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size;
+    req.tp_block_nr = RING_SIZE / block_size;
+    req.tp_frame_size = FRAME_SIZE;
+    req.tp_frame_nr = (block_size / FRAME_SIZE) * req.tp_block_nr;
+    req.tp_retire_blk_tov = BLOCK_TIMEOUT;
+    if(setsockopt(capture->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        rtp_print_log(RTP_ERROR, "Setting ring of packet socket failed(%s)\n", strerror(errno));
+        goto ON_ERROR;
+    }
+    capture->block_size = req.tp_block_size;
+    capture->block_nr = req.tp_block_nr;
+    capture->map_size = (size_t) req.tp_block_size * req.tp_block_nr;
+    capture->map = (char *) mmap(NULL, capture->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED,
+                                 capture->fd, 0);
+    if(capture->map == MAP_FAILED)              //locking of pages is not permitted
+        capture->map = (char *) mmap(NULL, capture->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, 0);
+    if(capture->map == MAP_FAILED) {
+        rtp_print_log(RTP_ERROR, "Mapping ring of packet socket failed(%s)\n", strerror(errno));
+        goto ON_ERROR;
+    }
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_IP);
+    addr.sll_ifindex = (int) ifindex;
+    if(bind(capture->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        rtp_print_log(RTP_ERROR, "Binding packet socket to %s failed(%s)\n", ifname, strerror(errno));
+        goto ON_ERROR;
+    }
+
+    rtp_print_log(RTP_DEBUG, "Capture on interface %s opened\n", ifname);
+    return 0;
+
+    ON_ERROR:
+    rtp_capture_free(capture);
+    return -1;
+}
+
+void rtp_capture_free(struct rtp_capture *capture)
+{
+    if(capture->map != MAP_FAILED)
+        munmap(capture->map, capture->map_size);
+    if(capture->fd != -1)
+        close(capture->fd);
+    free(capture->entries);
+    free(capture->table);
+    capture->map = MAP_FAILED;
+    capture->fd = -1;
+    capture->entries = NULL;
+    capture->table = NULL;
+    capture->nentries = 0;
+}
+
+int rtp_capture_add(struct rtp_capture *capture, uint32_t addr, uint16_t port, struct rtp_endpoint *ep)
+{
+    struct rtp_capture_entry *entries = (struct rtp_capture_entry *)
+            realloc(capture->entries, (capture->nentries + 1) * sizeof(struct rtp_capture_entry));
+    if(entries == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of capture entries failed\n");
+        return -1;
+    }
+    capture->entries = entries;
+    entries[capture->nentries].key = KEY(addr, htons(port));
+    entries[capture->nentries].ep = ep;
+    capture->nentries++;
+    qsort(entries, capture->nentries, sizeof(struct rtp_capture_entry), entry_cmp);
+
+    if(update_table(capture) == -1 || update_filter(capture) == -1) {
+        rtp_capture_remove(capture, ep);
+        return -1;
+    }
+    return 0;
+}
+
+void rtp_capture_remove(struct rtp_capture *capture, struct rtp_endpoint *ep)
+{
+    unsigned int i;
+    for(i = 0; i < capture->nentries; i++) {
+        if(capture->entries[i].ep == ep)
+            break;
+    }
+    if(i == capture->nentries)
+        return;
+
+    uint64_t key = capture->entries[i].key;
+    memmove(&(capture->entries[i]), &(capture->entries[i + 1]),
+            (capture->nentries - i - 1) * sizeof(struct rtp_capture_entry));
+    capture->nentries--;
+    update_filter(capture);
+
+    //worker_mutex is held around this call and rtp_capture_next(), so table is just rebuilt;
+    //if rebuilding fails, entry of kept old table is replaced by key, that never matches
+    if(update_table(capture) == -1) {
+        unsigned int s = slot(capture, key);
+        while(capture->table[s].ep != NULL && capture->table[s].ep != ep)
+            s = (s + 1) & capture->table_mask;
+        if(capture->table[s].ep == ep)
+            capture->table[s].key = TOMBSTONE;
+    }
+}
+
+//Returns block number i of ring.
+static inline struct tpacket_block_desc *block_desc(struct rtp_capture *capture, unsigned int i)
+{
+    return (struct tpacket_block_desc *) (capture->map + (size_t) i * capture->block_size);
+}
+
+int rtp_capture_next(struct rtp_capture *capture, struct rtp_capture_packet *packet)
+{
+    while(1) {
+        if(capture->remaining == 0) {
+            struct tpacket_block_desc *desc = block_desc(capture, capture->block);
+            if(capture->held) {                 //all packets of block handled, block is given back
+                __atomic_store_n(&(desc->hdr.bh1.block_status), TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+                capture->block = (capture->block + 1) % capture->block_nr;
+                capture->held = 0;
+                desc = block_desc(capture, capture->block);
+            }
+            if(!(__atomic_load_n(&(desc->hdr.bh1.block_status), __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+                return 0;
+            capture->held = 1;
+            capture->remaining = desc->hdr.bh1.num_pkts;
+            capture->next = (char *) desc + desc->hdr.bh1.offset_to_first_pkt;
+            continue;
+        }
+
+        struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) capture->next;
+        capture->next += hdr->tp_next_offset;
+        capture->remaining--;
+
+        //filter accepted only unfragmented UDP datagrams
+        unsigned char *ip = (unsigned char *) hdr + hdr->tp_net;
+        unsigned int ihl = (ip[0] & 0x0f) * 4;
+        if(hdr->tp_snaplen < ihl + 8)
+            continue;
+        unsigned char *udp = ip + ihl;
+        uint32_t daddr;
+        uint16_t dport, ulen;
+        memcpy(&daddr, ip + 16, sizeof(daddr));
+        memcpy(&dport, udp + 2, sizeof(dport));
+        memcpy(&ulen, udp + 4, sizeof(ulen));
+
+        struct rtp_endpoint *ep = lookup(capture, KEY(daddr, dport));
+        if(ep == NULL && capture->wildcards > 0)
+            ep = lookup(capture, KEY(htonl(INADDR_ANY), dport));
+        if(ep == NULL || ntohs(ulen) < 8)       //socket removed after packet was captured
+            continue;
+
+        packet->ep = ep;
+        packet->data = (char *) udp + 8;
+        packet->len = ntohs(ulen) - 8;
+        if(packet->len > hdr->tp_snaplen - ihl - 8)
+            packet->len = hdr->tp_snaplen - ihl - 8;
+        packet->tstamp.tv_sec = hdr->tp_sec;
+        packet->tstamp.tv_nsec = hdr->tp_nsec;
+        return 1;
+    }
+}
+
+unsigned int rtp_capture_drops(struct rtp_capture *capture)
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if(getsockopt(capture->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0)
+        return 0;
+    return stats.tp_drops;
+}
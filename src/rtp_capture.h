@@ -0,0 +1,111 @@
+/*
+ * rtp_capture.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_CAPTURE_H_
+#define RTP_CAPTURE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <linux/if_packet.h>
+#include "rtp_stream_thread.h"
+
+/**
+ * Module of packet capture. UDP datagrams of many sockets are received from one AF_PACKET
+ * socket with TPACKET_V3 ring mapped into memory. Kernel fills whole blocks of ring, so
+ * datagrams are handled in batches without copying. Filter of socket (classic BPF) accepts
+ * only datagrams sent to addresses and ports of registered sockets.
+ */
+
+/**
+ * Structure that represents registered socket of capture.
+ */
+struct rtp_capture_entry {
+	uint64_t key;							/**< address and port (network order) of socket*/
+	struct rtp_endpoint *ep;				/**< endpoint of socket*/
+};
+
+/**
+ * Structure that represents packet socket with TPACKET_V3 ring.
+ */
+struct rtp_capture {
+	int fd;									/**< packet socket*/
+	char *map;								/**< mapped ring*/
+	size_t map_size;						/**< size of mapped ring*/
+	unsigned int block_size;				/**< size of block of ring*/
+	unsigned int block_nr;					/**< count of blocks of ring*/
+	unsigned int block;						/**< index of the next block handled*/
+	int held;								/**< 1 while block is handled, 0 otherwise*/
+	unsigned int remaining;					/**< count of packets of block not handled yet*/
+	char *next;								/**< the next packet of block*/
+
+	struct rtp_capture_entry *entries;		/**< registered sockets*/
+	unsigned int nentries;					/**< count of registered sockets*/
+	unsigned int wildcards;					/**< count of sockets bound to INADDR_ANY*/
+	struct rtp_capture_entry *table;		/**< hash table of registered sockets*/
+	unsigned int table_mask;				/**< mask of index of hash table*/
+};
+
+/**
+ * Structure that represents datagram returned by capture.
+ */
+struct rtp_capture_packet {
+	struct rtp_endpoint *ep;				/**< endpoint of socket, which datagram was sent to*/
+	char *data;								/**< data of datagram, UDP header preceeds them*/
+	unsigned int len;						/**< size of data*/
+	struct timespec tstamp;					/**< arrival time of datagram*/
+};
+
+/**
+ * Opens packet socket on interface and maps its ring. Capture accepts no datagram until
+ * socket is registered.
+ * \param capture Capture that will be initialized.
+ * \param ifname Name of interface.
+ * \param block_size Requested size of block of ring. All datagrams of block are handled at
+ *        once, so it should not exceed size of queue of stream.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_capture_init(struct rtp_capture *capture, const char *ifname, unsigned int block_size);
+
+/**
+ * Closes packet socket and frees capture.
+ * \param capture Capture that will be freed.
+ */
+void rtp_capture_free(struct rtp_capture *capture);
+
+/**
+ * Registers socket into capture. Datagrams sent to address and port of socket are returned
+ * with its endpoint.
+ * \param capture Capture.
+ * \param addr Address (network order), which socket is bound to, INADDR_ANY matches any address.
+ * \param port Port of socket.
+ * \param ep Endpoint of socket.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_capture_add(struct rtp_capture *capture, uint32_t addr, uint16_t port, struct rtp_endpoint *ep);
+
+/**
+ * Unregisters socket of endpoint from capture. Must not run concurrently with rtp_capture_next().
+ * \param capture Capture.
+ * \param ep Endpoint of socket.
+ */
+void rtp_capture_remove(struct rtp_capture *capture, struct rtp_endpoint *ep);
+
+/**
+ * Returns the next datagram of registered socket. Block of ring is given back to kernel,
+ * when the next datagram after its last one is requested, so data of datagram are valid
+ * until the next call.
+ * \param capture Capture.
+ * \param packet Datagram returned.
+ * \return 1 when datagram was returned, 0 when ring has no more datagrams.
+ */
+int rtp_capture_next(struct rtp_capture *capture, struct rtp_capture_packet *packet);
+
+/**
+ * Returns count of datagrams dropped by kernel since the last call, because ring was full.
+ */
+unsigned int rtp_capture_drops(struct rtp_capture *capture);
+
+#endif /* RTP_CAPTURE_H_ */
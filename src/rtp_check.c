@@ -0,0 +1,231 @@
+/*
+ * rtp_check.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include "rtp_store.h"
+#include "rtp.h"
+#include "rtp_ssrc.h"
+#include "rtp_seek.h"
+
+/**
+ * rtpcheck - checks of self-contained parts of RtpStore, which edge cases are not hit by
+ * ordinary recording: validation of sequence numbers of RTP sources (wrap around, probation,
+ * restart of source, duplicates and reordering) and lookups in seek index (before the first
+ * entry, exact and between entries, after the last entry). Prints failed checks and exits
+ * with 1 when some check failed.
+ * Usage: rtpcheck [-d directory]
+ */
+
+#define SSRC 0x1234abcd                 //identifier of source of checked packets
+
+static unsigned int checks = 0;         //count of run checks
+static unsigned int failed = 0;         //count of failed checks
+
+//Counts check named name of line, prints it when value is not equal to expected.
+static void check_equal(const char *name, int line, long long value, long long expected)
+{
+    checks++;
+    if(value == expected)
+        return;
+    failed++;
+    printf("rtpcheck:%d: %s is %lld, expected %lld\n", line, name, value, expected);
+}
+
+#define CHECK(value, expected) check_equal(#value, __LINE__, (long long) (value), (long long) (expected))
+
+//Passes RTP packet of source SSRC with sequence number seq to table.
+static void feed(struct rtp_ssrc_table *table, uint16_t seq)
+{
+    unsigned char data[12];
+    memset(data, 0, sizeof(data));
+    data[0] = 0x80;                     //version 2, payload type 0 (PCMU)
+    uint16_t nseq = htons(seq);
+    uint32_t ts = htonl((uint32_t) seq * 160);
+    uint32_t ssrc = htonl(SSRC);
+    memcpy(data + 2, &nseq, sizeof(nseq));
+    memcpy(data + 4, &ts, sizeof(ts));
+    memcpy(data + 8, &ssrc, sizeof(ssrc));
+    rtp_ssrc_update(table, (const char *) data, sizeof(data), seq * 0.02, 0);
+}
+
+//Returns statistics of source SSRC in table.
+static struct rtp_source_stats source_stats(struct rtp_ssrc_table *table)
+{
+    struct rtp_source_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    CHECK(rtp_ssrc_stats(table, &stats, 1), 1);
+    CHECK(stats.ssrc, SSRC);
+    return stats;
+}
+
+static void check_ssrc(void)
+{
+    struct rtp_stream_config config;
+    rtp_stream_config_init(&config);
+    struct rtp_ssrc_table table;
+    rtp_ssrc_init(&table, &config);
+    struct rtp_source_stats s;
+
+    //source is valid after MIN_SEQUENTIAL packets in sequence
+    feed(&table, 65530);
+    s = source_stats(&table);
+    CHECK(s.valid, 0);
+    feed(&table, 65532);                //out of sequence, probation starts again
+    s = source_stats(&table);
+    CHECK(s.valid, 0);
+    feed(&table, 65533);
+    s = source_stats(&table);
+    CHECK(s.valid, 1);
+    CHECK(s.received, 1);
+
+    //sequence number wraps around
+    uint16_t seq;
+    for(seq = 65534; seq != 10; seq++)
+        feed(&table, seq);
+    s = source_stats(&table);
+    CHECK(s.ext_max_seq, RTP_SEQ_MOD + 9);
+    CHECK(s.expected, 13);
+    CHECK(s.received, 13);
+    CHECK(s.lost, 0);
+
+    //duplicate within window, reordered packet and loss
+    feed(&table, 5);
+    feed(&table, 12);
+    feed(&table, 11);
+    feed(&table, 11);
+    feed(&table, 15);
+    s = source_stats(&table);
+    CHECK(s.duplicates, 2);
+    CHECK(s.reordered, 1);
+    CHECK(s.ext_max_seq, RTP_SEQ_MOD + 15);
+    CHECK(s.expected, 19);
+    CHECK(s.received, 16);
+    CHECK(s.lost, 3);
+
+    //the very large jump is ignored, unless the next packet follows it (source restarted)
+    feed(&table, 30000);
+    s = source_stats(&table);
+    CHECK(s.ext_max_seq, RTP_SEQ_MOD + 15);
+    CHECK(s.received, 16);
+    feed(&table, 30001);
+    s = source_stats(&table);
+    CHECK(s.valid, 1);
+    CHECK(s.ext_max_seq, 30001);
+    CHECK(s.expected, 1);
+    CHECK(s.received, 1);
+    feed(&table, 30004);
+    s = source_stats(&table);
+    CHECK(s.expected, 4);
+    CHECK(s.lost, 2);
+}
+
+//Writes seek index <file_path>.sidx with count entries with offsets and positions.
+//Returns 0 on success, -1 otherwise.
+static int write_index(const char *file_path, const uint32_t *offsets, const uint64_t *positions,
+                       unsigned int count)
+{
+    char fname[strlen(file_path) + SEEK_SUFFIX_LEN];
+    sprintf(fname, "%s.sidx", file_path);
+    FILE *f = fopen(fname, "wb");
+    if(f == NULL)
+        return -1;
+
+    RD_seek_hdr_t hdr;
+    memcpy(hdr.magic, RTPSEEK_MAGIC, sizeof(hdr.magic));
+    hdr.flags = htonl(RTPSEEK_SEGMENTED);
+    hdr.entry_size = htonl(sizeof(RD_seek_entry_t));
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    unsigned int i;
+    for(i = 0; i < count; i++) {
+        RD_seek_entry_t entry;
+        entry.offset = htonl(offsets[i]);
+        entry.segment = htonl(i / 2);
+        entry.position = htobe64(positions[i]);
+        ok &= fwrite(&entry, sizeof(entry), 1, f) == 1;
+    }
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+//Checks, that lookup of offset in index finds entry with offset and position.
+static void check_find(struct rtp_seek_index *index, uint32_t offset, uint32_t found, uint64_t position)
+{
+    struct rtp_seek_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    CHECK(rtp_seek_find(index, offset, &entry), 0);
+    CHECK(entry.offset, found);
+    CHECK(entry.position, position);
+}
+
+static void check_seek(const char *dir)
+{
+    static const uint32_t offsets[] = {100, 200, 200, 300, 400};
+    static const uint64_t positions[] = {16, 1000, 2000, 3000, 4000};
+    char file_path[strlen(dir) + 16];
+    sprintf(file_path, "%s/rtpcheck.rtp", dir);
+    struct rtp_seek_entry entry;
+
+    if(write_index(file_path, offsets, positions, 5) == -1) {
+        CHECK(write_index(file_path, offsets, positions, 5), 0);
+        return;
+    }
+    struct rtp_seek_index *index = rtp_seek_open(file_path);
+    CHECK(index != NULL, 1);
+    if(index != NULL) {
+        CHECK(rtp_seek_segmented(index), 1);
+        check_find(index, 0, 100, 16);              //before the first entry
+        check_find(index, 100, 100, 16);            //the first entry
+        check_find(index, 199, 100, 16);
+        check_find(index, 200, 200, 2000);          //the last of entries with equal offset
+        check_find(index, 250, 200, 2000);
+        check_find(index, 400, 400, 4000);          //the last entry
+        check_find(index, UINT32_MAX, 400, 4000);   //after the last entry
+        rtp_seek_close(index);
+    }
+
+    write_index(file_path, offsets + 1, positions + 1, 1);
+    index = rtp_seek_open(file_path);
+    CHECK(index != NULL, 1);
+    if(index != NULL) {
+        check_find(index, 0, 200, 1000);
+        check_find(index, 1000, 200, 1000);
+        rtp_seek_close(index);
+    }
+
+    write_index(file_path, offsets, positions, 0);
+    index = rtp_seek_open(file_path);
+    CHECK(index != NULL, 1);
+    CHECK(rtp_seek_find(index, 100, &entry), -1);   //empty index
+    rtp_seek_close(index);
+
+    char fname[strlen(file_path) + SEEK_SUFFIX_LEN];
+    sprintf(fname, "%s.sidx", file_path);
+    unlink(fname);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = "/tmp";
+    int opt;
+    while((opt = getopt(argc, argv, "d:")) != -1) {
+        switch(opt) {
+        case 'd': dir = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-d directory]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    check_ssrc();
+    check_seek(dir);
+    printf("rtpcheck: %u of %u checks passed\n", checks - failed, checks);
+    return failed > 0 ? 1 : 0;
+}
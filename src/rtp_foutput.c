@@ -5,45 +5,592 @@
  *      Author: Matus Valo
  *      E-mail: matusvalo@gmail.com
  */
+#define _GNU_SOURCE         //fallocate()
+
 #include <sys/time.h>
-#include <stdio.h>
+#include <stdio.h>                              //snprintf()
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>                             //strerror()
 #include <time.h>
-#include <unistd.h>                             //fdatasync()
+#include <unistd.h>                             //fdatasync(), pwrite64()
+#include <endian.h>                             //htobe64()
 #include "rtp_foutput.h"
 #include "rtp_store.h"
+#include "rtp_ring.h"
+#include "rtp_task.h"
+#include "rtp_seqlock.h"
 #include "log.h"
 
-//Opens new file for writing RTP stream into.
-static inline int open_file(struct rtp_stream *stream)
+#define SEGMENT_SUFFIX_LEN 24                   //maximum length of ".<n>.irtp"
+#define INDEX_LINE_LEN 128                      //maximum length of line of index file
+#define PENDING_SYNCS 4                         //initial capacity of segment files waiting for sync
+#define SYNC_RETRY 10                           //time in miliseconds to retry sync, while previous one runs
+
+//Size of output buffer of stream in bytes.
+static size_t obuf_size = RTP_OUTPUT_BUFFER_DEFAULT * 1024 * 1024;
+//Maximum time in miliseconds, that data stay in output buffer.
+static unsigned int flush_interval = RTP_FLUSH_INTERVAL_DEFAULT;
+//Output files are written with O_DIRECT.
+static int direct_io = 0;
+//Alignment of position, size and memory of writes with O_DIRECT.
+static size_t direct_align = 4096;
+
+void rtp_foutput_init(const struct rtp_store_config *config)
 {
-    FILE *output = fopen64(stream->file_name, "w");             //for support files larger then 2 GB
-    rtp_print_log(RTP_DEBUG, "Opening output file for stream. File name : %s \n", stream->file_name);
-    if (output == NULL) {                                       //for fopen64, must be compiled with -D_LARGEFILE64_SOURCE
-        rtp_print_log(RTP_ERROR, "Opening file:%s, failed:%s\n", stream->file_name, strerror(errno));
+    obuf_size = (size_t) (config->output_buffer > 0 ? config->output_buffer : 1) * 1024 * 1024;
+    flush_interval = config->flush_interval;
+    direct_io = config->direct_io;
+    direct_align = sysconf(_SC_PAGESIZE);
+}
+
+//Allocates output buffer of stream. With O_DIRECT, output buffer is split into two staging
+//buffers, one is filled while the other one is written by background task.
+static inline int alloc_output(struct rtp_stream *stream)
+{
+    //buffer is aligned to pages, so kernel copies whole pages to page cache
+    size_t size = stream->direct ? obuf_size / 2 : obuf_size;
+    void *obuf = NULL;
+    void *spare = NULL;
+    int err = posix_memalign(&obuf, direct_align, size);
+    if(err == 0 && stream->direct)
+        err = posix_memalign(&spare, direct_align, size);
+    if(err != 0) {
+        rtp_print_log(RTP_ERROR, "Allocating output buffer failed:%s\n", strerror(err));
+        free(obuf);
         return -1;
     }
 
-    stream->output_file = output;
-
+    stream->obuf = (char *) obuf;
+    stream->obuf_spare = (char *) spare;
+    stream->obuf_len = 0;
+    stream->obuf_flushed = 0;
+    stream->obuf_since = 0;
+    stream->output_offset = 0;
+    stream->flush_seek_len = 0;
     return 0;
 }
 
+//Opens new file for writing RTP stream into, with O_DIRECT when direct is 1 and file
+//system supports it. Returns file descriptor on success, -1 otherwise.
+static inline int open_file(const char *file_name, int direct)
+{
+    //for support files larger then 2 GB, must be compiled with -D_LARGEFILE64_SOURCE
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int output = open64(file_name, flags | (direct ? O_DIRECT : 0), 0666);
+    if(output == -1 && direct && errno == EINVAL) {
+        rtp_print_log(RTP_WARN, "File system of file:%s doesn't support O_DIRECT\n", file_name);
+        output = open64(file_name, flags, 0666);
+    }
+    rtp_print_log(RTP_DEBUG, "Opening output file for stream. File name : %s \n", file_name);
+    if (output == -1)
+        rtp_print_log(RTP_ERROR, "Opening file:%s, failed:%s\n", file_name, strerror(errno));
+    return output;
+}
+
+//Opens segment file with number segment_no and preallocates it. Returns file descriptor
+//on success, -1 otherwise.
+static int open_segment(struct rtp_stream *stream, unsigned int segment_no)
+{
+    char fname[strlen(stream->file_name) + SEGMENT_SUFFIX_LEN];
+    sprintf(fname, "%s.%u.irtp", stream->file_name, segment_no);
+
+    int fd = open_file(fname, stream->direct);
+    if(fd == -1 || stream->max_fsize_quota == MAX_FSIZE_QUOTA_UNBOUNDED)
+        return fd;
+
+    //size of file is kept, so unused space can be released when segment is closed
+    if(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, stream->max_fsize_quota) == -1 && errno != EOPNOTSUPP)
+        rtp_print_log(RTP_WARN, "Preallocating file:%s, failed:%s\n", fname, strerror(errno));
+    return fd;
+}
+
+//Background task, that opens segment file following current segment file.
+static void open_next_segment(struct rtp_task *task)
+{
+    struct rtp_stream *stream = rtp_container_of(task, struct rtp_stream, segment_task);
+    stream->next_fd = open_segment(stream, stream->segment_no + 1);
+}
+
+//Writes count entries of seek index of stream to seek index file.
+static void write_seek_entries(struct rtp_stream *stream, const struct rtp_seek_entry *seek, unsigned int count)
+{
+    RD_seek_entry_t entries[RTP_SEEK_BUF_ENTRIES];
+    unsigned int i;
+    for(i = 0; i < count; i++) {
+        entries[i].offset = htonl(seek[i].offset);
+        entries[i].segment = htonl(seek[i].segment);
+        entries[i].position = htobe64(seek[i].position);
+    }
+
+    ssize_t len = count * sizeof(RD_seek_entry_t);
+    if(write(stream->seek_fd, entries, len) != len)
+        rtp_print_log(RTP_WARN, "Writing seek index of file:%s, failed:%s\n", stream->file_name, strerror(errno));
+}
+
+//Returns count of buffered entries of seek index of stream, which point to data before
+//position end of current file.
+static inline unsigned int seek_ready(struct rtp_stream *stream, off64_t end)
+{
+    unsigned int count = 0;
+    while(count < stream->seek_len && (off64_t) stream->seek_buf[count].position < end)
+        count++;
+    return count;
+}
+
+//Writes the first count buffered entries of seek index of stream to seek index file.
+static void write_seek(struct rtp_stream *stream, unsigned int count)
+{
+    if(stream->direct)                                  //entries written by background task come first
+        rtp_task_wait(&(stream->flush_task));
+    write_seek_entries(stream, stream->seek_buf, count);
+    stream->seek_len -= count;
+    memmove(stream->seek_buf, stream->seek_buf + count, stream->seek_len * sizeof(stream->seek_buf[0]));
+}
+
+//Background task, that writes staging buffer of stream with O_DIRECT and then entries of seek
+//index pointing to its data.
+static void write_staging(struct rtp_task *task)
+{
+    struct rtp_stream *stream = rtp_container_of(task, struct rtp_stream, flush_task);
+    size_t done = 0;
+    while(done < stream->flush_len) {
+        ssize_t wlen = pwrite64(stream->output_fd, stream->obuf_spare + done, stream->flush_len - done,
+                                stream->flush_offset + done);
+        if(wlen == -1) {
+            if(errno == EINTR)
+                continue;
+            rtp_print_log(RTP_WARN, "Writing packets to file failed:%s\n", strerror(errno));
+            break;
+        }
+        done += wlen;
+    }
+
+    if(stream->flush_seek_len > 0) {
+        write_seek_entries(stream, stream->flush_seek, stream->flush_seek_len);
+        stream->flush_seek_len = 0;
+    }
+}
+
+//Hands content of output buffer of stream to background task writing it with O_DIRECT and
+//continues with spare staging buffer. The last incomplete block is written padded by zeros.
+//Unless final, it is kept at start of buffer and rewritten with following data. Final write
+//is waited for and padding is cut off file, so file has the same content as without O_DIRECT.
+static void flush_direct(struct rtp_stream *stream, int final)
+{
+    rtp_task_wait(&(stream->flush_task));
+
+    size_t len = stream->obuf_len;
+    size_t tail = len & (direct_align - 1);
+    size_t padded = (len + direct_align - 1) & ~(direct_align - 1);
+    off64_t start = stream->output_offset - stream->obuf_flushed;  //position of buffer in file
+    char *buf = stream->obuf;
+    memset(buf + len, 0, padded - len);
+
+    //only entries pointing into handed data travel with them, the rest waits for next flush
+    unsigned int ready = seek_ready(stream, start + len);
+    memcpy(stream->flush_seek, stream->seek_buf, ready * sizeof(stream->seek_buf[0]));
+    stream->flush_seek_len = ready;
+    stream->seek_len -= ready;
+    memmove(stream->seek_buf, stream->seek_buf + ready, stream->seek_len * sizeof(stream->seek_buf[0]));
+    stream->flush_len = padded;
+    stream->flush_offset = start;
+    stream->obuf = stream->obuf_spare;
+    stream->obuf_spare = buf;
+    stream->output_offset = start + len;
+    stream->obuf_len = 0;
+    stream->obuf_flushed = 0;
+    if(!final && tail > 0) {
+        memcpy(stream->obuf, buf + len - tail, tail);
+        stream->obuf_len = tail;
+        stream->obuf_flushed = tail;
+    }
+    rtp_task_submit(&(stream->flush_task));
+
+    if(final) {
+        rtp_task_wait(&(stream->flush_task));
+        if(ftruncate64(stream->output_fd, stream->output_offset) == -1)
+            rtp_print_log(RTP_WARN, "Truncating output file failed:%s\n", strerror(errno));
+    }
+}
+
+//Writes content of output buffer of stream to file, first done bytes of it are already written.
+//Returns 0 on success, -1 when writing failed.
+static int write_output(struct rtp_stream *stream, size_t done)
+{
+    int retval = 0;
+    while(done < stream->obuf_len) {
+        ssize_t wlen = pwrite64(stream->output_fd, stream->obuf + done, stream->obuf_len - done,
+                                stream->output_offset + done);
+        if(wlen == -1) {
+            if(errno == EINTR)
+                continue;
+            rtp_print_log(RTP_WARN, "Writing packets to file failed:%s\n", strerror(errno));
+            retval = -1;
+            break;
+        }
+        done += wlen;
+    }
+
+    //entries are written after data they point to, all of them when data were not written
+    unsigned int ready = stream->seek_len;
+    if(done == stream->obuf_len)
+        ready = seek_ready(stream, stream->output_offset + done);
+    stream->output_offset += done;
+    stream->obuf_len = 0;
+    if(ready > 0)
+        write_seek(stream, ready);
+    return retval;
+}
+
+//Writes content of output buffer of stream to file.
+static int flush_output(struct rtp_stream *stream)
+{
+    if(stream->direct) {
+        flush_direct(stream, 0);
+        return 0;
+    }
+    return write_output(stream, 0);
+}
+
+//Returns 1 when stream has durability policy, 0 otherwise.
+static inline int sync_enabled(struct rtp_stream *stream)
+{
+    return stream->sync_interval != 0 || stream->sync_bytes != 0;
+}
+
+//Publishes position in segment file, up to which data of stream were synced to disk.
+static inline void set_durable(struct rtp_stream *stream, unsigned int segment, off64_t offset)
+{
+    rtp_seq_write_begin(&(stream->durable_seq));
+    stream->durable_segment = segment;
+    stream->durable_offset = offset;
+    rtp_seq_write_end(&(stream->durable_seq));
+}
+
+//Background task syncing data of output file of stream to disk.
+static void sync_output(struct rtp_task *task)
+{
+    struct rtp_stream *stream = rtp_container_of(task, struct rtp_stream, sync_task);
+    if(stream->direct)                                  //data are written by flush_task
+        rtp_task_wait(&(stream->flush_task));
+    if(fdatasync(stream->sync_fd) == -1)
+        rtp_print_log(RTP_WARN, "Syncing output file failed:%s\n", strerror(errno));
+    else
+        set_durable(stream, stream->sync_segment, stream->sync_target);
+    close(stream->sync_fd);
+    stream->sync_fd = -1;
+}
+
+//Hands sync of written data of output file of stream to background task. Previous sync
+//must be done.
+static void submit_sync(struct rtp_stream *stream, uint64_t now)
+{
+    stream->sync_fd = dup(stream->output_fd);          //file may be closed before sync
+    if(stream->sync_fd == -1) {                         //data are not counted as synced, next try
+        rtp_print_log(RTP_WARN, "Duplicating output file descriptor failed:%s\n", strerror(errno));
+        return;
+    }
+    stream->sync_last = now;
+    stream->sync_offset = stream->output_offset;
+    stream->sync_segment = stream->segment_no;
+    stream->sync_target = stream->output_offset;
+    rtp_task_submit_sync(&(stream->sync_task));
+}
+
+//Hands sync of the oldest completed segment file waiting for it to background task. Previous
+//sync must be done.
+static void submit_pending(struct rtp_stream *stream)
+{
+    stream->sync_fd = stream->pending[0].fd;
+    stream->sync_segment = stream->pending[0].segment;
+    stream->sync_target = stream->pending[0].target;
+    stream->pending_len--;
+    memmove(stream->pending, stream->pending + 1, stream->pending_len * sizeof(stream->pending[0]));
+    rtp_task_submit_sync(&(stream->sync_task));
+}
+
+//Syncs current segment file of stream whole, before it is closed by rotation. While previous
+//sync runs, segment waits for sync in pending and it is submitted by rtp_sync_stream_output().
+static void sync_completed_segment(struct rtp_stream *stream)
+{
+    if(stream->pending_len == 0 && rtp_task_done(&(stream->sync_task))) {
+        submit_sync(stream, rtp_clock_ms());
+        return;
+    }
+
+    if(stream->pending_len == stream->pending_size) {
+        unsigned int size = stream->pending_size == 0 ? PENDING_SYNCS : 2 * stream->pending_size;
+        struct rtp_pending_sync *pending = (struct rtp_pending_sync *)
+                realloc(stream->pending, size * sizeof(struct rtp_pending_sync));
+        if(pending == NULL) {                           //segments are synced in order by writer
+            rtp_print_log(RTP_ERROR, "Malloc of pending syncs failed\n");
+            while(stream->pending_len > 0) {
+                rtp_task_wait(&(stream->sync_task));
+                submit_pending(stream);
+            }
+            rtp_task_wait(&(stream->sync_task));
+            submit_sync(stream, rtp_clock_ms());
+            return;
+        }
+        stream->pending = pending;
+        stream->pending_size = size;
+    }
+
+    struct rtp_pending_sync *entry = &(stream->pending[stream->pending_len]);
+    entry->fd = dup(stream->output_fd);                 //file is closed before sync
+    if(entry->fd == -1) {
+        rtp_print_log(RTP_WARN, "Duplicating output file descriptor failed:%s\n", strerror(errno));
+        return;
+    }
+    entry->segment = stream->segment_no;
+    entry->target = stream->output_offset;
+    stream->pending_len++;
+}
+
+//Writes all data of output buffer of stream to file, so file is complete.
+static void finish_output(struct rtp_stream *stream)
+{
+    if(stream->direct)
+        flush_direct(stream, 1);
+    else if(stream->obuf_len > 0)
+        flush_output(stream);
+}
+
+//Appends data of size len to output buffer of stream. Full buffer is written to file.
+static inline void append_output(struct rtp_stream *stream, const char *data, size_t len)
+{
+    size_t size = stream->direct ? obuf_size / 2 : obuf_size;
+    if(stream->obuf_len == stream->obuf_flushed)
+        stream->obuf_since = rtp_clock_ms();
+
+    while(len > 0) {
+        size_t part = size - stream->obuf_len;
+        if(part > len)
+            part = len;
+        memcpy(stream->obuf + stream->obuf_len, data, part);
+        stream->obuf_len += part;
+        data += part;
+        len -= part;
+        if(stream->obuf_len == size)
+            flush_output(stream);
+    }
+}
+
+//Appends line describing current segment file to index file.
+static void write_index(struct rtp_stream *stream)
+{
+    char line[INDEX_LINE_LEN + strlen(stream->file_name)];
+    int len = sprintf(line, "%u %u %u %u %lld %s.%u.irtp\n", stream->segment_no,
+                      stream->segment_first, stream->segment_last, stream->segment_records,
+                      (long long) stream->segment_size, stream->file_name, stream->segment_no);
+    if(write(stream->index_fd, line, len) != len)
+        rtp_print_log(RTP_WARN, "Writing index file:%s, failed:%s\n", stream->file_name, strerror(errno));
+}
+
+//Closes current segment file, releases its unused preallocated space and writes it into index.
+static int close_segment(struct rtp_stream *stream)
+{
+    if(stream->output_fd == -1)
+        return 0;
+
+    if(stream->max_fsize_quota != MAX_FSIZE_QUOTA_UNBOUNDED
+       && ftruncate64(stream->output_fd, stream->output_offset) == -1)
+        rtp_print_log(RTP_WARN, "Truncating segment file failed:%s\n", strerror(errno));
+    write_index(stream);
+    int retval = close(stream->output_fd);
+    stream->output_fd = -1;
+    return retval;
+}
+
+//Starts new segment file. Buffered data of current segment are written first, next
+//segment file should be already opened by background task.
+static void rotate_segment(struct rtp_stream *stream)
+{
+    finish_output(stream);
+    if(sync_enabled(stream))                            //completed segment is synced whole
+        sync_completed_segment(stream);
+    rtp_task_wait(&(stream->segment_task));
+    close_segment(stream);
+
+    stream->segment_no++;
+    stream->output_fd = stream->next_fd;
+    stream->next_fd = -1;
+    if(stream->output_fd == -1)                         //opening in background failed, next try
+        stream->output_fd = open_segment(stream, stream->segment_no);
+    stream->output_offset = 0;
+    stream->sync_offset = 0;
+    stream->segment_size = 0;
+    stream->segment_records = 0;
+    rtp_print_log(RTP_DEBUG, "Segment %u of stream started\n", stream->segment_no);
+
+    rtp_task_submit(&(stream->segment_task));
+    stream->segment_size += stream->segment_hdr_len;
+    append_output(stream, stream->segment_hdr, stream->segment_hdr_len);
+}
+
+//Returns 1 when record with offset (in miliseconds) and size doesn't fit into current segment.
+static inline int segment_full(struct rtp_stream *stream, uint32_t offset, uint32_t size)
+{
+    if(stream->segment_records == 0)
+        return 0;
+    if(stream->max_fsize_quota != MAX_FSIZE_QUOTA_UNBOUNDED
+       && stream->segment_size + size > stream->max_fsize_quota)
+        return 1;
+    return stream->max_segment_time != 0 && offset - stream->segment_first >= stream->max_segment_time;
+}
+
+//Adds entry of seek index for record with offset (in miliseconds) when it is the first
+//record of segment or seek interval or seek packets elapsed since the last entry.
+static inline void update_seek(struct rtp_stream *stream, uint32_t offset)
+{
+    stream->seek_count++;
+    if(stream->segment_records > 0
+       && !(stream->seek_interval != 0 && (int32_t) (offset - stream->seek_last) >= (int32_t) stream->seek_interval)
+       && !(stream->seek_packets != 0 && stream->seek_count > stream->seek_packets))
+        return;
+
+    //offsets of audio and video packets may be slightly out of order, entries must be sorted
+    if((int32_t) (offset - stream->seek_last) < 0)
+        offset = stream->seek_last;
+
+    struct rtp_seek_entry *entry = &(stream->seek_buf[stream->seek_len++]);
+    entry->offset = offset;
+    entry->segment = stream->segment_no;
+    entry->position = stream->segment_size;
+    stream->seek_last = offset;
+    stream->seek_count = 1;
+}
+
+//Appends records of size len to output buffer, starts new segment file where segment is full.
+//Skipped space of ring between records is left out.
+static void append_records(struct rtp_stream *stream, const char *data, uint32_t len)
+{
+    int plain = stream->index_fd == -1 && stream->seek_fd == -1;    //data are neither segmented nor indexed
+    uint32_t pos = 0;
+    uint32_t start = 0;                                 //start of records not appended yet
+    while(pos < len) {
+        uint32_t size = rtp_ring_rec_size(data + pos);
+        if(data[pos] == RING_SKIP) {                    //space of ring not filled by datagram
+            if(pos > start)
+                append_output(stream, data + start, pos - start);
+            pos += size;
+            start = pos;
+            continue;
+        }
+        if(plain) {
+            pos += size;
+            continue;
+        }
+
+        RD_packet_t hdr;
+        memcpy(&hdr, data + pos + 1, sizeof(hdr));
+        uint32_t offset = ntohl(hdr.offset);
+        if(segment_full(stream, offset, size)) {
+            if(pos > start)
+                append_output(stream, data + start, pos - start);
+            rotate_segment(stream);
+            start = pos;
+        }
+        if(stream->seek_fd != -1)
+            update_seek(stream, offset);
+        if(stream->segment_records == 0)
+            stream->segment_first = offset;
+        stream->segment_last = offset;
+        stream->segment_records++;
+        stream->segment_size += size;
+        pos += size;
+        if(stream->seek_len == RTP_SEEK_BUF_ENTRIES) {  //entries are written after data they point to
+            append_output(stream, data + start, pos - start);
+            start = pos;
+            flush_output(stream);
+        }
+    }
+    if(pos > start)
+        append_output(stream, data + start, pos - start);
+}
+
 //Closes output file given by struct stream.
 static inline int close_file(struct rtp_stream *stream)
 {
-    rtp_print_log(RTP_DEBUG, "Output file (FD=%d) on stream closed\n", stream->output_file);
-    if(stream->output_file != NULL)
-        return fclose(stream->output_file);
+    int retval = 0;
+    rtp_print_log(RTP_DEBUG, "Output file (FD=%d) on stream closed\n", stream->output_fd);
+    if(stream->output_fd != -1 && stream->obuf != NULL)
+        finish_output(stream);
+    rtp_task_wait(&(stream->sync_task));
+    while(stream->pending_len > 0) {
+        submit_pending(stream);
+        rtp_task_wait(&(stream->sync_task));
+    }
+    free(stream->pending);
+    stream->pending = NULL;
+    stream->pending_size = 0;
+    if(sync_enabled(stream) && stream->output_fd != -1) {
+        if(fdatasync(stream->output_fd) == -1)
+            rtp_print_log(RTP_WARN, "Syncing output file failed:%s\n", strerror(errno));
+        else
+            set_durable(stream, stream->segment_no, stream->output_offset);
+    }
+
+    if(stream->index_fd != -1) {
+        rtp_task_wait(&(stream->segment_task));
+        if(stream->next_fd != -1) {                     //segment opened in advance is not used
+            char fname[strlen(stream->file_name) + SEGMENT_SUFFIX_LEN];
+            sprintf(fname, "%s.%u.irtp", stream->file_name, stream->segment_no + 1);
+            close(stream->next_fd);
+            unlink(fname);
+            stream->next_fd = -1;
+        }
+        retval = close_segment(stream);
+        if(sync_enabled(stream) && fdatasync(stream->index_fd) == -1)
+            rtp_print_log(RTP_WARN, "Syncing index file:%s, failed:%s\n", stream->file_name, strerror(errno));
+        close(stream->index_fd);
+        stream->index_fd = -1;
+    } else if(stream->output_fd != -1)
+        retval = close(stream->output_fd);
+
+    if(stream->seek_fd != -1) {
+        if(stream->seek_len > 0)
+            write_seek(stream, stream->seek_len);
+        if(sync_enabled(stream) && fdatasync(stream->seek_fd) == -1)
+            rtp_print_log(RTP_WARN, "Syncing seek index of file:%s, failed:%s\n", stream->file_name, strerror(errno));
+        close(stream->seek_fd);
+        stream->seek_fd = -1;
+    }
+
+    free(stream->obuf);
+    free(stream->obuf_spare);
+    stream->obuf = NULL;
+    stream->obuf_spare = NULL;
+    return retval;
+}
+
+//Opens seek index file <file_name>.sidx and writes its header. Returns 0 on success, -1 otherwise.
+static int open_seek(struct rtp_stream *stream, const struct rtp_stream_config *config)
+{
+    char fname[strlen(stream->file_name) + SEEK_SUFFIX_LEN];
+    sprintf(fname, "%s.sidx", stream->file_name);
+    stream->seek_fd = open_file(fname, 0);
+    if(stream->seek_fd == -1)
+        return -1;
+
+    RD_seek_hdr_t hdr;
+    memcpy(hdr.magic, RTPSEEK_MAGIC, sizeof(hdr.magic));
+    hdr.flags = htonl(config->max_fsize_quota != MAX_FSIZE_QUOTA_UNBOUNDED || config->max_segment_time != 0
+                      ? RTPSEEK_SEGMENTED : 0);
+    hdr.entry_size = htonl(sizeof(RD_seek_entry_t));
+    if(write(stream->seek_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        rtp_print_log(RTP_ERROR, "Writing seek index:%s, failed:%s\n", fname, strerror(errno));
+        return -1;
+    }
     return 0;
 }
 
-int rtp_create_stream_output(struct rtp_stream *stream, char *file_path)
+int rtp_create_stream_output(struct rtp_stream *stream, char *file_path, const struct rtp_stream_config *config)
 {
     if(file_path == NULL) {
         rtp_print_log(RTP_ERROR, "file_path=NULL\n");
@@ -57,44 +604,296 @@ int rtp_create_stream_output(struct rtp_stream *stream, char *file_path)
     }
 
     strcpy(stream->file_name, file_path);
+    stream->max_fsize_quota = config->max_fsize_quota;
+    stream->max_segment_time = config->max_segment_time * 1000;
+    stream->segment_no = 0;
+    stream->segment_size = 0;
+    stream->segment_records = 0;
+    stream->segment_hdr_len = 0;
+    stream->segment_task.run = open_next_segment;
+    stream->segment_task.state = RTP_TASK_IDLE;
+    stream->flush_task.run = write_staging;
+    stream->flush_task.state = RTP_TASK_IDLE;
+    stream->sync_task.run = sync_output;
+    stream->sync_task.state = RTP_TASK_IDLE;
+    stream->sync_interval = config->sync_interval;
+    stream->sync_bytes = config->sync_bytes;
+    stream->sync_last = rtp_clock_ms();
+    stream->sync_offset = 0;
+    stream->sync_fd = -1;
+    stream->pending = NULL;
+    stream->pending_len = 0;
+    stream->pending_size = 0;
+
+    stream->seek_interval = config->seek_interval;
+    stream->seek_packets = config->seek_packets;
+    stream->seek_last = 0;
+    stream->seek_count = 0;
+    stream->seek_len = 0;
+    if((stream->seek_interval != 0 || stream->seek_packets != 0) && open_seek(stream, config) == -1)
+        return -1;
+
+    stream->direct = direct_io;
+    if(stream->max_fsize_quota == MAX_FSIZE_QUOTA_UNBOUNDED && stream->max_segment_time == 0) {
+        stream->output_fd = open_file(stream->file_name, stream->direct);
+        if(stream->output_fd == -1)
+            return -1;
+    } else {
+        stream->index_fd = open_file(stream->file_name, 0);
+        if(stream->index_fd == -1)
+            return -1;
+        stream->output_fd = open_segment(stream, 0);
+        if(stream->output_fd == -1)
+            return -1;
+    }
+    if(stream->direct && !(fcntl(stream->output_fd, F_GETFL) & O_DIRECT))
+        stream->direct = 0;                             //file system doesn't support O_DIRECT
+    if(alloc_output(stream) == -1)
+        return -1;
+    if(stream->index_fd != -1)
+        rtp_task_submit(&(stream->segment_task));
 
     rtp_print_log(RTP_DEBUG, "Stream output successfully initialized\n");
+    return 0;
+}
+
+int rtp_write_packet(rtp_session_type_t stream_type, RD_buffer_t *packet, int len, struct rtp_stream *stream,
+                     unsigned int shard)
+{
+    struct rtp_ring *ring = shard == 0 ? &(stream->ring) : &(stream->shard_rings[shard - 1]);
+    if(rtp_ring_push(ring, stream_type == RTP_VIDEO ? 'V' : 'A', packet, len) == -1)
+        return 0;
+    return 1;
+}
+
+//Returns 1 when record a of sharded stream should be written before record b, 0 otherwise.
+//Records are ordered by arrival time, RTP packets that arrived in the same milisecond by
+//sequence number.
+static inline int record_before(const char *a, const char *b)
+{
+    RD_packet_t ha, hb;
+    memcpy(&ha, a + 1, sizeof(ha));
+    memcpy(&hb, b + 1, sizeof(hb));
+    int32_t diff = (int32_t) (ntohl(ha.offset) - ntohl(hb.offset));
+    if(diff != 0 || ha.plen == 0 || hb.plen == 0)
+        return diff < 0;
 
-    return open_file(stream);
+    uint16_t seq_a, seq_b;
+    memcpy(&seq_a, a + 1 + sizeof(ha) + 2, sizeof(seq_a));
+    memcpy(&seq_b, b + 1 + sizeof(hb) + 2, sizeof(seq_b));
+    return (int16_t) (ntohs(seq_a) - ntohs(seq_b)) < 0;
 }
 
-int rtp_write_packet(rtp_session_type_t stream_type, RD_buffer_t *packet, int len, struct rtp_stream *stream)
+//Moves cursor over skipped space of ring.
+static inline void skip_cursor(struct rtp_merge_cursor *cursor)
 {
-    stream_type == RTP_VIDEO ? fprintf(stream->output_file, "V") : fprintf(stream->output_file, "A");
+    while(cursor->pos < cursor->len && cursor->data[cursor->pos] == RING_SKIP)
+        cursor->pos += rtp_ring_rec_size(cursor->data + cursor->pos);
+}
+
+//Returns 1 when cursor of ring has record not written yet. Empty cursor claims next records.
+static inline int fill_cursor(struct rtp_ring *ring, struct rtp_merge_cursor *cursor)
+{
+    if(cursor->pos < cursor->len)
+        return 1;
+    cursor->pos = 0;
+    cursor->len = rtp_ring_claim(ring, &(cursor->data), &(cursor->records));
+    skip_cursor(cursor);
+    if(cursor->len > 0 && cursor->pos == cursor->len) {    //claimed records are skipped space only
+        rtp_ring_release(ring, cursor->records);
+        return fill_cursor(ring, cursor);
+    }
+    return cursor->len > 0;
+}
 
-    int items = fwrite((void *)packet, len, 1, stream->output_file) ; //???? WTF + 1 because 'A'/'V' was also written
-    if(items < 1) {
-        if(ferror(stream->output_file)) {
-            rtp_print_log(RTP_WARN, "Writing packet to file failed.\n");
-            clearerr(stream->output_file);
+//Returns 1 when writer holds back records of sharded stream, 0 otherwise.
+static inline int merge_held(struct rtp_stream *stream)
+{
+    unsigned int i;
+    for(i = 0; i < stream->video_session.shards; i++) {
+        if(stream->merge[i].pos < stream->merge[i].len)
+            return 1;
+    }
+    return 0;
+}
+
+//Moves records from rings of sharded stream to output buffer ordered by arrival time.
+//Records are moved while every ring has record or their arrival is older than merge delay.
+static ssize_t merge_stream_output(struct rtp_stream *stream, int all)
+{
+    struct rtp_ring *rings[RTP_MAX_SHARDS];
+    unsigned int n = stream->video_session.shards;
+    unsigned int i;
+    rings[0] = &(stream->ring);
+    for(i = 1; i < n; i++)
+        rings[i] = &(stream->shard_rings[i - 1]);
+
+    double first_rtp;
+    struct timeval now;
+    __atomic_load(&(stream->first_rtp), &first_rtp, __ATOMIC_ACQUIRE);
+    gettimeofday(&now, NULL);
+    uint32_t horizon = (uint32_t) ((now.tv_sec + now.tv_usec / 1e6 - first_rtp) * 1000) - RTP_MERGE_DELAY;
+
+    ssize_t written = 0;
+    while(1) {
+        struct rtp_merge_cursor *next = NULL;
+        int complete = 1;                               //every ring has record
+        for(i = 0; i < n; i++) {
+            struct rtp_merge_cursor *cursor = &(stream->merge[i]);
+            if(!fill_cursor(rings[i], cursor))
+                complete = 0;
+            else if(next == NULL || record_before(cursor->data + cursor->pos, next->data + next->pos))
+                next = cursor;
         }
+        if(next == NULL)
+            break;
+
+        char *rec = next->data + next->pos;
+        RD_packet_t hdr;
+        memcpy(&hdr, rec + 1, sizeof(hdr));
+        uint32_t offset = ntohl(hdr.offset);
+        if(!complete && !all && (int32_t) (offset - horizon) > 0)
+            break;                                      //earlier records may still arrive
+
+        uint32_t size = rtp_ring_rec_size(rec);
+        if(hdr.plen != 0)                               //RTP packet, in order of arrival
+            rtp_ssrc_update(&(stream->sources), rec + 1 + sizeof(hdr), size - 1 - sizeof(hdr),
+                            first_rtp + offset / 1e3, rec[0] == 'V');
+        append_records(stream, rec, size);
+        written += size;
+        next->pos += size;
+        skip_cursor(next);
+        if(next->pos == next->len) {                    //free space for worker as soon as possible
+            rtp_ring_release(rings[next - stream->merge], next->records);
+            next->len = 0;
+            next->pos = 0;
+        }
+    }
+
+    return written;
+}
+
+ssize_t rtp_drain_stream_output(struct rtp_stream *stream, int all)
+{
+    if(stream->video_session.shards > 1)
+        return merge_stream_output(stream, all);
+
+    ssize_t written = 0;
+    int i;
+    for(i = 0; i < 2; i++) {                    //second pass continues from start of ring
+        char *data = NULL;
+        uint32_t records = 0;
+        uint32_t len = rtp_ring_claim(&(stream->ring), &data, &records);
+        if(len == 0)
+            break;
+
+        append_records(stream, data, len);
+        rtp_ring_release(&(stream->ring), records);
+        written += len;
+    }
+
+    return written;
+}
+
+int rtp_held_stream_output(struct rtp_stream *stream)
+{
+    return stream->video_session.shards > 1 && merge_held(stream) ? RTP_MERGE_DELAY : -1;
+}
+
+int rtp_flush_stream_output(struct rtp_stream *stream, uint64_t now)
+{
+    int held = rtp_held_stream_output(stream);
+    if(stream->obuf_len == stream->obuf_flushed)
+        return held;
+
+    uint64_t age = now - stream->obuf_since;
+    if(age < flush_interval)
+        return held != -1 && held < (int) (flush_interval - age) ? held : (int) (flush_interval - age);
+
+    flush_output(stream);
+    return held;
+}
+
+int rtp_sync_stream_output(struct rtp_stream *stream, uint64_t now)
+{
+    if(!sync_enabled(stream) || stream->output_fd == -1)
+        return -1;
+    if(stream->pending_len > 0) {                       //completed segments are synced first
+        if(rtp_task_done(&(stream->sync_task)))
+            submit_pending(stream);
+        return SYNC_RETRY;
     }
+    //buffered data are counted too, they are written before sync
+    off64_t unsynced = stream->output_offset + (off64_t) (stream->obuf_len - stream->obuf_flushed)
+                       - stream->sync_offset;
+    if(unsynced <= 0)
+        return -1;
 
-    return items;
+    uint64_t age = now - stream->sync_last;
+    if((stream->sync_interval == 0 || age < stream->sync_interval)
+       && (stream->sync_bytes == 0 || unsynced < stream->sync_bytes))
+        return stream->sync_interval != 0 ? (int) (stream->sync_interval - age) : -1;
+    if(!rtp_task_done(&(stream->sync_task)))           //previous sync is not done yet
+        return SYNC_RETRY;
+
+    if(stream->obuf_len > stream->obuf_flushed)
+        flush_output(stream);
+    submit_sync(stream, now);
+    return stream->sync_interval != 0 ? (int) stream->sync_interval : -1;
+}
+
+size_t rtp_pending_stream_output(struct rtp_stream *stream, uint64_t *since)
+{
+    *since = stream->obuf_since;
+    return stream->obuf_len - stream->obuf_flushed;
+}
+
+int rtp_prepare_stream_write(struct rtp_stream *stream, struct iovec *iov, off64_t *offset)
+{
+    if(stream->output_fd == -1 || stream->obuf_len == stream->obuf_flushed)
+        return -1;
+    if(stream->direct) {
+        flush_direct(stream, 0);
+        return -1;
+    }
+
+    iov->iov_base = stream->obuf;
+    iov->iov_len = stream->obuf_len;
+    *offset = stream->output_offset;
+    return stream->output_fd;
+}
+
+void rtp_complete_stream_write(struct rtp_stream *stream, ssize_t written)
+{
+    write_output(stream, written > 0 ? (size_t) written : 0);
 }
 
 int rtp_init_stream_output(struct rtp_stream *stream, char *addr, uint16_t port)
 {
     RD_hdr_t hdr;
     struct timeval start;
-    off64_t wlen = 0;
+    char line[128];
 
     gettimeofday(&start,0);
-    wlen = fprintf(stream->output_file, "#!rtpplay%s %s/%d\n", RTPFILE_VERSION, addr, htons(port));
+    int wlen = snprintf(line, sizeof(line), "#!rtpplay%s %s/%d\n", RTPFILE_VERSION, addr, htons(port));
+    if(wlen < 0 || wlen >= (int) sizeof(line))
+        return -1;
+    if(stream->segment_hdr_len + wlen + sizeof(hdr) > sizeof(stream->segment_hdr))
+        return -1;
 
     hdr.start.tv_sec  = htonl(start.tv_sec);
     hdr.start.tv_usec = htonl(start.tv_usec);
     hdr.source = inet_addr(addr);
     hdr.port   = htons(port);
 
-    wlen = fwrite((char *)&hdr, sizeof(hdr), 1, stream->output_file);
-    if(wlen < (off64_t) 1)
-        return -1;
+    //headers are kept to be written at start of every segment file
+    char *seg_hdr = stream->segment_hdr + stream->segment_hdr_len;
+    memcpy(seg_hdr, line, wlen);
+    memcpy(seg_hdr + wlen, (char *) &hdr, sizeof(hdr));
+    stream->segment_hdr_len += wlen + sizeof(hdr);
+    stream->segment_size += wlen + sizeof(hdr);
+
+    append_output(stream, seg_hdr, wlen + sizeof(hdr));
 
     return 0;
 }
@@ -104,6 +903,7 @@ int rtp_close_stream_output(struct rtp_stream *stream)
     int retval = close_file(stream);
     if(stream->file_name != NULL)
         free(stream->file_name);
-    stream->output_file = NULL;
+    stream->file_name = NULL;
+    stream->output_fd = -1;
     return retval;
 }
@@ -12,7 +12,10 @@
 #include <bits/time.h>          //struct timeval
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/uio.h>            //struct iovec
 #include "rtp_stream_thread.h"
+#include "rtp_seek.h"
 
 /**
  * Module for saving rtp data in files.
@@ -58,6 +61,27 @@ typedef union
     char byte[8192];
 } RD_buffer_t;
 
+/**
+ * Time in miliseconds, that writer waits for packets of other sockets of sharded stream
+ * before packet is written.
+ */
+#define RTP_MERGE_DELAY 20
+
+/**
+ * Returns coarse monotonic time in miliseconds. Used to time flushing of output buffers.
+ */
+static inline uint64_t rtp_clock_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Sets options of file outputs (size of output buffer, flush interval).
+ * \param config Configuration of RtpStore.
+ */
+void rtp_foutput_init(const struct rtp_store_config *config);
 
 /**
  * Initializates created file output. (Must be called for video and for audio)
@@ -69,13 +93,18 @@ typedef union
 int rtp_init_stream_output(struct rtp_stream *stream, char *addr, uint16_t port);
 
 /**
- *Create file output.
+ *Create file output. When size or duration of segment is bounded, data are written to
+ *segment files <file_path>.<n>.irtp and file_path is index listing segment files in form:
+ *<n> <offset of the first packet> <offset of the last packet> <count of packets> <size> <segment file>
+ *where offsets are in miliseconds since start of recording. When seek interval or seek
+ *packets is set, seek index <file_path>.sidx (see RD_seek_hdr_t) is written too.
  *\param stream Stream, for which will be file output created.
  *\param file_path Path of the file that will be output.
- *\param max_fsize_quota Maximum permited file size, where RTP stream is stored (when reached new file is created)
+ *\param config Options of stream. When segment reaches max_fsize_quota or max_segment_time,
+ *new segment file is created.
  *\return 0 on success, -1 otherwise.
  */
-int rtp_create_stream_output(struct rtp_stream *stream, char *file_path);
+int rtp_create_stream_output(struct rtp_stream *stream, char *file_path, const struct rtp_stream_config *config);
 
 /**
  * Closes file output of stream.
@@ -85,12 +114,81 @@ int rtp_create_stream_output(struct rtp_stream *stream, char *file_path);
 int rtp_close_stream_output(struct rtp_stream *stream);
 
 /**
- * Writes rtp packet to file.
+ * Puts rtp packet into queue of stream. Packet is written to file by writer of stream.
  *\param stream_type Type of stream which packet belongs to.
  *\param packet Packet that is being stored.
  *\param len Length of the packet.
  *\param stream Stream that packet belongs to.
+ *\param shard Number of socket of SO_REUSEPORT group, that received packet (0 for other sockets).
+ *\return 1 on success, 0 when packet was dropped, because queue was full.
+ */
+int rtp_write_packet(rtp_session_type_t stream_type, RD_buffer_t *packet, int len, struct rtp_stream *stream,
+                     unsigned int shard);
+
+/**
+ * Moves packets from queue of stream to output buffer of stream. Full output buffer
+ * is written to file. Called by writer of stream. Queues of sharded stream are merged
+ * by arrival time, packet is held back until all queues contain later packets or until
+ * RTP_MERGE_DELAY elapsed since its arrival.
+ *\param stream Stream which packets are written.
+ *\param all 1 to move also packets held back by merging (stream is closing), 0 otherwise.
+ *\return Size of moved data in bytes.
+ */
+ssize_t rtp_drain_stream_output(struct rtp_stream *stream, int all);
+
+/**
+ * Writes output buffer of stream to file, when its data are older than flush interval.
+ * Called by writer of stream.
+ *\param stream Stream which output buffer is written.
+ *\param now Current time returned by rtp_clock_ms().
+ *\return Time in miliseconds until output buffer should be written, -1 if output
+ * buffer is empty.
+ */
+int rtp_flush_stream_output(struct rtp_stream *stream, uint64_t now);
+
+/**
+ * Applies durability policy of stream. When sync interval elapsed or sync bytes were stored
+ * since the previous sync, output buffer is written and sync of output file is handed to
+ * background task. Called by writer of stream.
+ *\param stream Stream which output file is synced.
+ *\param now Current time returned by rtp_clock_ms().
+ *\return Time in miliseconds until output file should be synced, -1 if stream has no
+ * durability policy or no data to sync.
+ */
+int rtp_sync_stream_output(struct rtp_stream *stream, uint64_t now);
+
+/**
+ * Returns size of data in output buffer of stream not written to file yet. Used by
+ * writer with group commit instead of rtp_flush_stream_output().
+ *\param stream Stream.
+ *\param since (out) Time (rtp_clock_ms()) since data are buffered.
+ *\return Size of data in bytes.
+ */
+size_t rtp_pending_stream_output(struct rtp_stream *stream, uint64_t *since);
+
+/**
+ * Returns time in miliseconds until records of sharded stream held back by merging should
+ * be moved, -1 if no record is held back.
+ */
+int rtp_held_stream_output(struct rtp_stream *stream);
+
+/**
+ * Prepares write of output buffer of stream by group commit. Output buffer must not be
+ * changed until rtp_complete_stream_write() is called. Output buffer of stream written
+ * with O_DIRECT is handed to background task instead.
+ *\param stream Stream which output buffer is written.
+ *\param iov (out) Data that should be written.
+ *\param offset (out) Position in file, where data should be written.
+ *\return File descriptor, where data should be written, -1 if there is nothing to write.
+ */
+int rtp_prepare_stream_write(struct rtp_stream *stream, struct iovec *iov, off64_t *offset);
+
+/**
+ * Completes write of output buffer of stream prepared by rtp_prepare_stream_write().
+ * Data not written yet are written synchronously.
+ *\param stream Stream which output buffer was written.
+ *\param written Size of written data, negative value when write failed.
  */
-int rtp_write_packet(rtp_session_type_t stream_type, RD_buffer_t *packet, int len, struct rtp_stream *stream);
+void rtp_complete_stream_write(struct rtp_stream *stream, ssize_t written);
 
 #endif /* RTP_FOUTPUT_H_ */
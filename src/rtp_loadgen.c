@@ -0,0 +1,568 @@
+/*
+ * rtp_loadgen.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+#define _GNU_SOURCE         //sendmmsg()
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rtp_store.h"
+
+/**
+ * rtploadgen - end-to-end load generator. Creates K streams by rtp_store_create_stream_config()
+ * on 127.0.0.1, sends RTP and RTCP traffic to them from sender threads and reports
+ * sustained throughput, kernel drops (SO_RXQ_OVFL), drops of queues, CPU time of
+ * RtpStore per packet, bytes written to disk, count of write calls and bytes synced to disk
+ * by durability policy. K is swept over list or doubling range.
+ * Usage: rtploadgen [-k 1,10,100 | -k 1:4096] [-t seconds] [-a audio pps] [-v video pps]
+ *                   [-s audio size] [-S video size] [-c rtcp interval ms] [-b burst]
+ *                   [-g senders] [-P base port] [-d directory] [-f csv|json]
+ *                   [-W workers] [-w writers] [-q queue size] [-p drop|oldest|block]
+ *                   [-B receive buffer size] [-x shards of video RTP socket] [-E epoll|uring]
+ *                   [-C capture interface] [-Z direct receive into queue 0|1] [-D (O_DIRECT output)]
+ *                   [-G group commit latency ms] [-M group commit bytes]
+ *                   [-y sync interval ms] [-Y sync bytes]
+ */
+
+#define MAX_STEPS 64                    //maximum count of values of K
+#define SEND_BATCH 64                   //count of datagrams sent by one sendmmsg()
+#define MAX_PACKET 1500                 //maximum size of packet
+#define RTCP_LEN 80                     //size of RTCP packet (SR + SDES)
+#define MAX_LAG 100000000ULL            //sender lagging behind more than this (ns) skips packets
+#define DRAIN_TIME 500000               //time in microseconds for draining queues after sending
+
+//Destinations of stream.
+enum {DST_VIDEO, DST_VIDEO_RTCP, DST_AUDIO, DST_AUDIO_RTCP, DST_COUNT};
+
+//Stream under load.
+struct lg_stream {
+    rtp_stream_id_t id;                 //ID of stream in RtpStore
+    struct sockaddr_in dst[DST_COUNT];  //addresses of sessions of stream
+    uint16_t vseq;                      //sequence number of next video packet
+    uint16_t aseq;                      //sequence number of next audio packet
+    uint64_t vnext;                     //time of next video burst in ns
+    uint64_t anext;                     //time of next audio burst in ns
+    uint64_t rnext;                     //time of next RTCP packets in ns
+};
+
+//Sender thread.
+struct lg_sender {
+    pthread_t thread;
+    struct lg_stream *streams;          //the first stream of sender
+    unsigned int count;                 //count of streams of sender
+    uint64_t packets;                   //count of sent packets
+    uint64_t bytes;                     //count of sent bytes
+    uint64_t skipped;                   //count of packets not sent, because sender lagged
+    uint64_t cpu_ns;                    //CPU time of sender
+    struct mmsghdr msgs[SEND_BATCH];
+    struct iovec iovs[SEND_BATCH];
+    char bufs[SEND_BATCH][MAX_PACKET];
+    int sockfd;
+    int queued;                         //count of queued datagrams
+};
+
+//Result of one step of sweep.
+struct lg_result {
+    unsigned int streams;
+    double seconds;
+    uint64_t sent;
+    uint64_t sent_bytes;
+    uint64_t skipped;
+    uint64_t received;
+    uint64_t lost;
+    uint64_t stored_bytes;
+    uint64_t durable_bytes;
+    uint64_t queue_dropped;
+    uint64_t kernel_drops;
+    double store_cpu_ns;
+    double sender_cpu_ns;
+    uint64_t file_bytes;
+    uint64_t disk_bytes;
+    uint64_t write_calls;
+};
+
+//options of load generator
+static unsigned int steps[MAX_STEPS] = {1, 10, 100, 1000};
+static int nsteps = 4;
+static double duration = 5;
+static unsigned int audio_pps = 50;
+static unsigned int video_pps = 300;
+static unsigned int audio_size = 172;
+static unsigned int video_size = 1200;
+static unsigned int rtcp_interval = 5000;
+static unsigned int burst = 1;
+static unsigned int nsenders = 1;
+static uint16_t base_port = 20000;
+static const char *dir = "/tmp";
+static int json = 0;
+static unsigned int shards = 1;
+static unsigned int sync_interval = 0;
+static unsigned int sync_bytes = 0;
+static struct rtp_store_config config;
+
+static volatile int sending = 0;
+static int results_count = 0;
+
+static inline uint64_t now_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//Returns CPU time of process in ns.
+static uint64_t process_cpu_ns(void)
+{
+    return now_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+//Returns counter of process in /proc/self/io (format e.g. "write_bytes: %llu"), 0 if unknown.
+static uint64_t proc_io(const char *format)
+{
+    FILE *f = fopen("/proc/self/io", "r");
+    if(f == NULL)
+        return 0;
+    char line[128];
+    unsigned long long value = 0;
+    while(fgets(line, sizeof(line), f) != NULL)
+        if(sscanf(line, format, &value) == 1)
+            break;
+    fclose(f);
+    return value;
+}
+
+//Queues RTP packet of stream s for destination dst.
+static void queue_packet(struct lg_sender *snd, struct lg_stream *s, int dst, unsigned int len)
+{
+    struct mmsghdr *msg = &(snd->msgs[snd->queued]);
+    unsigned char *buf = (unsigned char *) snd->bufs[snd->queued];
+    uint32_t ssrc = htonl((uint32_t) (s - snd->streams) * 4 + dst + 1);
+    if(dst == DST_VIDEO_RTCP || dst == DST_AUDIO_RTCP) {
+        buf[0] = 0x80;                                  //SR without reception reports
+        buf[1] = 200;
+        buf[2] = 0;
+        buf[3] = 6;
+        memcpy(buf + 4, &ssrc, 4);
+    } else {
+        int video = dst == DST_VIDEO;
+        uint16_t seq = htons(video ? s->vseq++ : s->aseq++);
+        uint32_t ts = htonl(ntohs(seq) * (video ? 3000 : 160));
+        buf[0] = 0x80;
+        buf[1] = video ? 96 : 0;
+        memcpy(buf + 2, &seq, 2);
+        memcpy(buf + 4, &ts, 4);
+        memcpy(buf + 8, &ssrc, 4);
+    }
+    snd->iovs[snd->queued].iov_len = len;
+    msg->msg_hdr.msg_name = &(s->dst[dst]);
+    msg->msg_hdr.msg_namelen = sizeof(s->dst[dst]);
+    snd->packets++;
+    snd->bytes += len;
+    snd->queued++;
+}
+
+//Sends queued packets.
+static void flush_packets(struct lg_sender *snd)
+{
+    int sent = 0;
+    while(sent < snd->queued) {
+        int res = sendmmsg(snd->sockfd, snd->msgs + sent, snd->queued - sent, 0);
+        if(res == -1) {
+            if(errno == EINTR)
+                continue;
+            break;                                      //e.g. ECONNREFUSED of closed port
+        }
+        sent += res;
+    }
+    snd->queued = 0;
+}
+
+//Queues burst of packets, when time of burst *next came. Returns time of next burst.
+static uint64_t send_due(struct lg_sender *snd, struct lg_stream *s, int dst, uint64_t *next,
+                         uint64_t now, uint64_t period, unsigned int count, unsigned int len)
+{
+    if(period == 0)
+        return UINT64_MAX;
+    if(now > *next + MAX_LAG) {                         //sender can't keep up
+        uint64_t behind = (now - *next) / period;
+        snd->skipped += behind * count;
+        *next += behind * period;
+    }
+    while(*next <= now) {
+        unsigned int i;
+        for(i = 0; i < count; i++) {
+            queue_packet(snd, s, dst, len);
+            if(snd->queued == SEND_BATCH)
+                flush_packets(snd);
+        }
+        *next += period;
+    }
+    return *next;
+}
+
+//Execution handler of sender thread.
+static void *sender_thread(void *param)
+{
+    struct lg_sender *snd = (struct lg_sender *) param;
+    uint64_t aperiod = audio_pps ? 1000000000ULL * burst / audio_pps : 0;
+    uint64_t vperiod = video_pps ? 1000000000ULL * burst / video_pps : 0;
+    uint64_t rperiod = rtcp_interval ? 1000000ULL * rtcp_interval : 0;
+    unsigned int i;
+
+    uint64_t start = now_ns(CLOCK_MONOTONIC);
+    for(i = 0; i < snd->count; i++) {                   //streams are spread over period
+        struct lg_stream *s = &(snd->streams[i]);
+        s->anext = start + (aperiod ? aperiod * i / snd->count : 0);
+        s->vnext = start + (vperiod ? vperiod * i / snd->count : 0);
+        s->rnext = start + (rperiod ? rperiod * i / snd->count : 0);
+    }
+
+    while(sending) {
+        uint64_t now = now_ns(CLOCK_MONOTONIC);
+        uint64_t wake = now + 1000000;
+        for(i = 0; i < snd->count; i++) {
+            struct lg_stream *s = &(snd->streams[i]);
+            uint64_t next = send_due(snd, s, DST_AUDIO, &(s->anext), now, aperiod, burst, audio_size);
+            if(next < wake) wake = next;
+            next = send_due(snd, s, DST_VIDEO, &(s->vnext), now, vperiod, burst, video_size);
+            if(next < wake) wake = next;
+            if(rperiod != 0 && s->rnext <= now) {
+                queue_packet(snd, s, DST_AUDIO_RTCP, RTCP_LEN);
+                if(snd->queued == SEND_BATCH)
+                    flush_packets(snd);
+                queue_packet(snd, s, DST_VIDEO_RTCP, RTCP_LEN);
+                if(snd->queued == SEND_BATCH)
+                    flush_packets(snd);
+                s->rnext += rperiod;
+            }
+            if(rperiod != 0 && s->rnext < wake) wake = s->rnext;
+        }
+        flush_packets(snd);
+
+        now = now_ns(CLOCK_MONOTONIC);
+        if(wake > now) {
+            struct timespec ts = {(wake - now) / 1000000000, (wake - now) % 1000000000};
+            nanosleep(&ts, NULL);
+        }
+    }
+    snd->cpu_ns = now_ns(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+//Initializes sender snd sending to count streams.
+static int sender_init(struct lg_sender *snd, struct lg_stream *streams, unsigned int count)
+{
+    memset(snd, 0, sizeof(*snd));
+    snd->streams = streams;
+    snd->count = count;
+    snd->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(snd->sockfd == -1)
+        return -1;
+    int i;
+    for(i = 0; i < SEND_BATCH; i++) {
+        memset(snd->bufs[i], 0, MAX_PACKET);
+        snd->iovs[i].iov_base = snd->bufs[i];
+        snd->msgs[i].msg_hdr.msg_iov = &(snd->iovs[i]);
+        snd->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return 0;
+}
+
+static void print_result(const struct lg_result *r)
+{
+    double rx_pps = r->received / r->seconds;
+    double cpu_pkt = r->received ? r->store_cpu_ns / r->received : 0;
+    if(json)
+        printf("%s  {\"streams\": %u, \"seconds\": %.2f, \"sent_pps\": %.0f, \"sent_mbps\": %.2f, "
+               "\"skipped\": %llu, \"received_pps\": %.0f, \"lost\": %llu, \"stored_mbps\": %.2f, "
+               "\"queue_dropped\": %llu, \"kernel_drops\": %llu, \"cpu_ns_per_packet\": %.0f, "
+               "\"store_cpu_pct\": %.1f, \"sender_cpu_pct\": %.1f, \"file_bytes\": %llu, \"disk_bytes\": %llu, "
+               "\"write_calls\": %llu, \"durable_bytes\": %llu}",
+               results_count > 0 ? ",\n" : "", r->streams, r->seconds, r->sent / r->seconds,
+               r->sent_bytes * 8 / r->seconds / 1e6, (unsigned long long) r->skipped, rx_pps,
+               (unsigned long long) r->lost, r->stored_bytes * 8 / r->seconds / 1e6,
+               (unsigned long long) r->queue_dropped, (unsigned long long) r->kernel_drops, cpu_pkt,
+               r->store_cpu_ns / r->seconds / 1e7, r->sender_cpu_ns / r->seconds / 1e7,
+               (unsigned long long) r->file_bytes, (unsigned long long) r->disk_bytes,
+               (unsigned long long) r->write_calls, (unsigned long long) r->durable_bytes);
+    else {
+        if(results_count == 0)
+            printf("streams,seconds,sent_pps,sent_mbps,skipped,received_pps,lost,stored_mbps,"
+                   "queue_dropped,kernel_drops,cpu_ns_per_packet,store_cpu_pct,sender_cpu_pct,"
+                   "file_bytes,disk_bytes,write_calls,durable_bytes\n");
+        printf("%u,%.2f,%.0f,%.2f,%llu,%.0f,%llu,%.2f,%llu,%llu,%.0f,%.1f,%.1f,%llu,%llu,%llu,%llu\n",
+               r->streams, r->seconds, r->sent / r->seconds, r->sent_bytes * 8 / r->seconds / 1e6,
+               (unsigned long long) r->skipped, rx_pps, (unsigned long long) r->lost,
+               r->stored_bytes * 8 / r->seconds / 1e6, (unsigned long long) r->queue_dropped,
+               (unsigned long long) r->kernel_drops, cpu_pkt, r->store_cpu_ns / r->seconds / 1e7,
+               r->sender_cpu_ns / r->seconds / 1e7, (unsigned long long) r->file_bytes,
+               (unsigned long long) r->disk_bytes, (unsigned long long) r->write_calls,
+               (unsigned long long) r->durable_bytes);
+    }
+    results_count++;
+    fflush(stdout);
+}
+
+//Returns name of output file of stream i.
+static void file_name(char *name, size_t size, unsigned int i)
+{
+    snprintf(name, size, "%s/rtploadgen_%u.rtp", dir, i);
+}
+
+//Runs one step of sweep with k streams. Returns 0 on success, -1 otherwise.
+static int run_step(unsigned int k)
+{
+    struct lg_result res;
+    memset(&res, 0, sizeof(res));
+    res.streams = k;
+    unsigned int i, created = 0;
+    char name[4096];
+
+    struct lg_stream *streams = (struct lg_stream *) calloc(k, sizeof(struct lg_stream));
+    struct lg_sender *senders = (struct lg_sender *) calloc(nsenders, sizeof(struct lg_sender));
+    if(streams == NULL || senders == NULL) {
+        fprintf(stderr, "rtploadgen: malloc failed\n");
+        goto ON_ERROR;
+    }
+
+    for(created = 0; created < k; created++) {
+        struct lg_stream *s = &(streams[created]);
+        uint16_t vport = base_port + 4 * created;
+        file_name(name, sizeof(name), created);
+        struct rtp_stream_config scfg;
+        rtp_stream_config_init(&scfg);
+        scfg.shards = shards;
+        scfg.capture = config.capture_interface != NULL;
+        scfg.sync_interval = sync_interval;
+        scfg.sync_bytes = sync_bytes;
+        s->id = rtp_store_create_stream_config("127.0.0.1", vport, vport + 2, name, &scfg);
+        if(s->id == -1) {
+            fprintf(stderr, "rtploadgen: creating stream %u failed (every stream needs 6 descriptors, "
+                            "see log)\n", created);
+            goto ON_ERROR;
+        }
+        int d;
+        for(d = 0; d < DST_COUNT; d++) {
+            s->dst[d].sin_family = AF_INET;
+            s->dst[d].sin_port = htons(vport + d);
+            s->dst[d].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+    }
+
+    unsigned int per = (k + nsenders - 1) / nsenders;
+    unsigned int nsnd = 0;
+    for(i = 0; i < nsenders && i * per < k; i++, nsnd++) {
+        unsigned int count = k - i * per < per ? k - i * per : per;
+        if(sender_init(&senders[i], streams + i * per, count) == -1) {
+            fprintf(stderr, "rtploadgen: creating socket of sender failed\n");
+            goto ON_ERROR;
+        }
+    }
+
+    uint64_t disk_start = proc_io("write_bytes: %llu");
+    uint64_t calls_start = proc_io("syscw: %llu");
+    uint64_t cpu_start = process_cpu_ns();
+    uint64_t start = now_ns(CLOCK_MONOTONIC);
+    sending = 1;
+    for(i = 0; i < nsnd; i++)
+        pthread_create(&(senders[i].thread), NULL, sender_thread, &senders[i]);
+    usleep((useconds_t) (duration * 1000000));
+    sending = 0;
+    for(i = 0; i < nsnd; i++) {
+        pthread_join(senders[i].thread, NULL);
+        res.sent += senders[i].packets;
+        res.sent_bytes += senders[i].bytes;
+        res.skipped += senders[i].skipped;
+        res.sender_cpu_ns += senders[i].cpu_ns;
+        close(senders[i].sockfd);
+    }
+    usleep(DRAIN_TIME);                                 //workers and writers drain queues
+    res.seconds = (now_ns(CLOCK_MONOTONIC) - start) / 1e9;
+    res.store_cpu_ns = (double) (process_cpu_ns() - cpu_start) - res.sender_cpu_ns;
+
+    for(i = 0; i < k; i++) {
+        struct rtp_source_stats src[4];
+        int n = rtp_get_stream_sources(streams[i].id, src, 4);
+        int j;
+        for(j = 0; j < n; j++) {
+            res.received += src[j].received;
+            if(src[j].lost > 0)
+                res.lost += src[j].lost;
+        }
+    }
+    struct rtp_stream_stats *stats = (struct rtp_stream_stats *) malloc(k * sizeof(struct rtp_stream_stats));
+    if(stats != NULL) {
+        int n = rtp_get_streams_stats(stats, k);
+        for(i = 0; i < (unsigned int) n; i++) {
+            res.stored_bytes += stats[i].downloaded_data_size;
+            res.durable_bytes += stats[i].durable_offset;
+            res.queue_dropped += stats[i].queue.dropped;
+            res.kernel_drops += stats[i].sockets.video_rtp_dropped + stats[i].sockets.video_rtcp_dropped
+                                + stats[i].sockets.audio_rtp_dropped + stats[i].sockets.audio_rtcp_dropped;
+        }
+        free(stats);
+    }
+
+    for(i = 0; i < k; i++)
+        rtp_store_close_stream(streams[i].id);
+    res.disk_bytes = proc_io("write_bytes: %llu") - disk_start;
+    res.write_calls = proc_io("syscw: %llu") - calls_start;
+    for(i = 0; i < k; i++) {
+        struct stat st;
+        file_name(name, sizeof(name), i);
+        if(stat(name, &st) == 0)
+            res.file_bytes += st.st_size;
+        unlink(name);
+        strncat(name, ".sidx", sizeof(name) - strlen(name) - 1);
+        unlink(name);
+    }
+
+    print_result(&res);
+    free(streams);
+    free(senders);
+    return 0;
+
+    ON_ERROR:
+    if(streams != NULL) {
+        for(i = 0; i < created; i++) {
+            rtp_store_close_stream(streams[i].id);
+            file_name(name, sizeof(name), i);
+            unlink(name);
+            strncat(name, ".sidx", sizeof(name) - strlen(name) - 1);
+            unlink(name);
+        }
+    }
+    for(i = 0; i < nsenders && senders != NULL; i++)
+        if(senders[i].sockfd > 0)
+            close(senders[i].sockfd);
+    free(streams);
+    free(senders);
+    return -1;
+}
+
+//Parses list of K (1,10,100) or doubling range (1:4096).
+static int parse_steps(const char *arg)
+{
+    unsigned int first, last;
+    if(strchr(arg, ':') != NULL) {
+        if(sscanf(arg, "%u:%u", &first, &last) != 2 || first == 0 || first > last)
+            return -1;
+        for(nsteps = 0; first <= last && nsteps < MAX_STEPS; first *= 2)
+            steps[nsteps++] = first;
+        return 0;
+    }
+    char *copy = strdup(arg);
+    char *tok, *save = NULL;
+    nsteps = 0;
+    for(tok = strtok_r(copy, ",", &save); tok != NULL && nsteps < MAX_STEPS; tok = strtok_r(NULL, ",", &save))
+        if((steps[nsteps++] = atoi(tok)) == 0)
+            nsteps--;
+    free(copy);
+    return nsteps > 0 ? 0 : -1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-k 1,10,100 | -k 1:4096] [-t seconds] [-a audio pps] [-v video pps]\n"
+                    "       [-s audio size] [-S video size] [-c rtcp interval ms] [-b burst] [-g senders]\n"
+                    "       [-P base port] [-d directory] [-f csv|json] [-W workers] [-w writers]\n"
+                    "       [-q queue size] [-p drop|oldest|block] [-B receive buffer size] [-x shards]\n"
+                    "       [-E epoll|uring] [-C capture interface] [-Z direct receive into queue 0|1]\n"
+                    "       [-D (O_DIRECT output)] [-G group commit latency ms] [-M group commit bytes]\n"
+                    "       [-y sync interval ms] [-Y sync bytes]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    rtp_store_config_init(&config);
+    int opt;
+    while((opt = getopt(argc, argv, "k:t:a:v:s:S:c:b:g:P:d:f:W:w:q:p:B:x:E:C:Z:DG:M:y:Y:")) != -1) {
+        switch(opt) {
+        case 'k': if(parse_steps(optarg) == -1) usage(argv[0]); break;
+        case 't': duration = atof(optarg); break;
+        case 'a': audio_pps = atoi(optarg); break;
+        case 'v': video_pps = atoi(optarg); break;
+        case 's': audio_size = atoi(optarg); break;
+        case 'S': video_size = atoi(optarg); break;
+        case 'c': rtcp_interval = atoi(optarg); break;
+        case 'b': burst = atoi(optarg); break;
+        case 'g': nsenders = atoi(optarg); break;
+        case 'P': base_port = (uint16_t) atoi(optarg); break;
+        case 'd': dir = optarg; break;
+        case 'f': json = strcmp(optarg, "json") == 0; break;
+        case 'W': config.workers = atoi(optarg); break;
+        case 'w': config.writers = atoi(optarg); break;
+        case 'q': config.queue_size = atoi(optarg); break;
+        case 'B': config.rcvbuf = atoi(optarg); break;
+        case 'x': shards = atoi(optarg); break;
+        case 'C': config.capture_interface = optarg; break;
+        case 'Z': config.direct_recv = atoi(optarg) != 0; break;
+        case 'D': config.direct_io = 1; break;
+        case 'G': config.group_commit = atoi(optarg); break;
+        case 'M': config.group_commit_bytes = atoi(optarg); break;
+        case 'y': sync_interval = atoi(optarg); break;
+        case 'Y': sync_bytes = atoi(optarg); break;
+        case 'E': config.engine = strcmp(optarg, "uring") == 0 ? RTP_ENGINE_URING : RTP_ENGINE_EPOLL; break;
+        case 'p':
+            if(strcmp(optarg, "oldest") == 0)
+                config.queue_policy = RTP_QUEUE_DROP_OLDEST;
+            else if(strcmp(optarg, "block") == 0)
+                config.queue_policy = RTP_QUEUE_BLOCK;
+            else
+                config.queue_policy = RTP_QUEUE_DROP_NEWEST;
+            break;
+        default: usage(argv[0]);
+        }
+    }
+    if(duration <= 0 || burst == 0 || nsenders == 0 || audio_size < 12 || video_size < 12
+       || audio_size > MAX_PACKET || video_size > MAX_PACKET)
+        usage(argv[0]);
+
+    struct rlimit rl;                                   //4 sockets per stream
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    char log_path[4096];
+    snprintf(log_path, sizeof(log_path), "%s/rtploadgen.log", dir);
+    rtp_store_loginit(log_path, RTP_WARN | RTP_ERROR, MAX_FSIZE_QUOTA_UNBOUNDED, 1);
+    if(rtp_store_init_config(&config) == -1) {
+        fprintf(stderr, "rtploadgen: initialization of RtpStore failed\n");
+        return 1;
+    }
+
+    if(json)
+        printf("[\n");
+    int i, ret = 0;
+    for(i = 0; i < nsteps; i++) {
+        if(base_port + 4 * steps[i] > 65535) {
+            fprintf(stderr, "rtploadgen: not enough ports for %u streams\n", steps[i]);
+            ret = 1;
+            break;
+        }
+        if(run_step(steps[i]) == -1) {
+            ret = 1;
+            break;
+        }
+    }
+    if(json)
+        printf("\n]\n");
+
+    rtp_store_close();
+    return ret;
+}
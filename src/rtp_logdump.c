@@ -0,0 +1,170 @@
+/*
+ * rtp_logdump.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "log_format.h"
+
+/**
+ * rtplogdump - prints binary log file written with format RTP_LOG_BINARY as text
+ * log file.
+ * Usage: rtplogdump [<binary log file>]  (standard input when file is not given)
+ */
+
+#define MAX_RECORD_LEN (UINT16_MAX + 1)     //maximum length of data of record
+
+static char **strings = NULL;               //strings defined in file, indexed by ID
+static uint32_t strings_size = 0;           //size of array strings
+
+//Frees all strings defined in file.
+static void reset_strings(void)
+{
+    uint32_t i;
+    for(i = 0; i < strings_size; i++) {
+        free(strings[i]);
+        strings[i] = NULL;
+    }
+}
+
+//Defines string str with ID id. Returns 0 on success, -1 otherwise.
+static int define_string(uint32_t id, char *str)
+{
+    if(id >= strings_size) {
+        uint32_t size = strings_size == 0 ? 256 : strings_size;
+        while(size <= id)
+            size *= 2;
+        char **new_strings = (char **) realloc(strings, size * sizeof(char *));
+        if(new_strings == NULL)
+            return -1;
+        memset(new_strings + strings_size, 0, (size - strings_size) * sizeof(char *));
+        strings = new_strings;
+        strings_size = size;
+    }
+    free(strings[id]);
+    strings[id] = str;
+    return 0;
+}
+
+//Returns string with ID id or "?" when it wasn't defined.
+static inline const char *get_string(uint32_t id)
+{
+    if(id >= strings_size || strings[id] == NULL)
+        return "?";
+    return strings[id];
+}
+
+//Reads rest of header, which type was already read. Returns 0 on success, -1 otherwise.
+static int read_header(FILE *in, char type)
+{
+    rtp_logbin_hdr_t hdr;
+    hdr.magic[0] = type;
+    if(fread((char *) &hdr + 1, sizeof(hdr) - 1, 1, in) != 1)
+        return -1;
+    if(memcmp(hdr.magic, RTP_LOGBIN_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "rtplogdump: not a binary log file\n");
+        return -1;
+    }
+    if(hdr.bom != RTP_LOGBIN_BOM) {
+        fprintf(stderr, "rtplogdump: log file was written by host with different byte order\n");
+        return -1;
+    }
+    reset_strings();
+    return 0;
+}
+
+//Reads rest of record, which type was already read, and prints log message.
+//Returns 0 on success, -1 otherwise.
+static int read_record(FILE *in, char type, char *data)
+{
+    if(type == RTP_LOGBIN_STRING) {
+        rtp_logbin_string_t def;
+        def.type = type;
+        if(fread((char *) &def + 1, sizeof(def) - 1, 1, in) != 1)
+            return -1;
+        char *str = (char *) malloc(def.len + 1);
+        if(str == NULL)
+            return -1;
+        if(def.len > 0 && fread(str, def.len, 1, in) != 1) {
+            free(str);
+            return -1;
+        }
+        str[def.len] = '\0';
+        if(define_string(def.id, str) == -1) {
+            free(str);
+            return -1;
+        }
+        return 0;
+    }
+
+    rtp_logbin_msg_t msg;
+    msg.type = type;
+    if(fread((char *) &msg + 1, sizeof(msg) - 1, 1, in) != 1)
+        return -1;
+    if(msg.len > 0 && fread(data, msg.len, 1, in) != 1)
+        return -1;
+
+    char message[RTP_LOG_MSG_LEN];
+    if(type == RTP_LOGBIN_MESSAGE)
+        rtp_log_decode(message, sizeof(message), get_string(msg.fmt), data, msg.len);
+    else {
+        size_t len = msg.len < sizeof(message) ? msg.len : sizeof(message) - 1;
+        memcpy(message, data, len);
+        message[len] = '\0';
+    }
+
+    struct timeval tv = {.tv_sec = msg.sec, .tv_usec = msg.usec};
+    char line[RTP_LOG_MSG_LEN + 128];
+    rtp_log_line(line, sizeof(line), (rtp_log_level_t) msg.level, &tv, get_string(msg.func), message);
+    fputs(line, stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    if(argc > 2) {
+        fprintf(stderr, "Usage: %s [<binary log file>]\n", argv[0]);
+        return 2;
+    }
+    if(argc == 2 && (in = fopen(argv[1], "r")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    static char data[MAX_RECORD_LEN];
+    int type;
+    int first = 1;
+    int ret = 0;
+    while((type = fgetc(in)) != EOF) {
+        int res;
+        if(type == RTP_LOGBIN_MAGIC[0])
+            res = read_header(in, (char) type);
+        else if(first) {
+            fprintf(stderr, "rtplogdump: not a binary log file\n");
+            res = -1;
+        } else if(type == RTP_LOGBIN_STRING || type == RTP_LOGBIN_MESSAGE || type == RTP_LOGBIN_TEXT)
+            res = read_record(in, (char) type, data);
+        else {
+            fprintf(stderr, "rtplogdump: unknown record type 0x%02x\n", type);
+            res = -1;
+        }
+        if(res == -1) {
+            if(ferror(in) || feof(in))
+                fprintf(stderr, "rtplogdump: truncated log file\n");
+            ret = 1;
+            break;
+        }
+        first = 0;
+    }
+
+    reset_strings();
+    free(strings);
+    if(in != stdin)
+        fclose(in);
+    return ret;
+}
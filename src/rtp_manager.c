@@ -8,31 +8,29 @@
 
 #include "rtp_store.h"
 #include "rtp_stream_thread.h"
+#include "rtp_worker.h"
+#include "rtp_writer.h"
+#include "rtp_network.h"
+#include "rtp_foutput.h"
+#include "rtp_task.h"
+#include "rtp_registry.h"
 #include "log.h"
 
-#define MAX_STREAMS 100
+static int initialized = 0;                 //1 while RtpStore is initialized
 
-static struct rtp_stream *streams[MAX_STREAMS];
-
-static inline int get_avail_streamid(void) {
-    int i;
-    for(i = 0; i < MAX_STREAMS; i++) {
-        if(streams[i] == NULL) {
-            rtp_print_log(RTP_DEBUG, "Stream ID=%d allocated\n", i);
-            return i;
-        }
-    }
-    rtp_print_log(RTP_ERROR, "No avaliable ID\n");
-    return -1;
+int rtp_store_remote_loginit(const char *ip, uint16_t port, rtp_log_level_t levels)
+{
+    return rtp_init_remote_log(ip, port, levels);
 }
 
-static inline void free_streamid(int id) {
-    streams[id] = NULL;
+void rtp_store_logformat(rtp_log_format_t format)
+{
+    rtp_set_log_format(format);
 }
 
-int rtp_store_remote_loginit(const char *ip, uint16_t port, rtp_log_level_t levels)
+int rtp_store_logconfig(unsigned int flush_size, unsigned int flush_time, unsigned int sync_interval)
 {
-    return rtp_init_remote_log(ip, port, levels);
+    return rtp_set_log_options(flush_size, flush_time, sync_interval);
 }
 
 int rtp_store_loginit(const char *flog, rtp_log_level_t log_levels, unsigned int max_fsize_quota, unsigned int rb_count)
@@ -40,6 +38,11 @@ int rtp_store_loginit(const char *flog, rtp_log_level_t log_levels, unsigned int
     return rtp_init_log(flog, log_levels, max_fsize_quota, rb_count);
 }
 
+int rtp_store_remote_logconfig(unsigned int mtu, unsigned int flush_time, unsigned int rate)
+{
+    return rtp_set_remote_log_options(mtu, flush_time, rate);
+}
+
 void rtp_store_remote_logclose(void)
 {
     rtp_close_remote_log();
@@ -50,82 +53,246 @@ void rtp_store_logclose(void)
     rtp_close_log();
 }
 
-void rtp_store_init(void)
+void rtp_store_config_init(struct rtp_store_config *config)
+{
+    config->workers = RTP_WORKERS_DEFAULT;
+    config->recv_batch = RTP_RECV_BATCH_DEFAULT;
+    config->direct_recv = 1;
+    config->tstamp = RTP_TSTAMP_KERNEL;
+    config->writers = RTP_WRITERS_DEFAULT;
+    config->queue_size = RTP_QUEUE_SIZE_DEFAULT;
+    config->queue_policy = RTP_QUEUE_DROP_NEWEST;
+    config->output_buffer = RTP_OUTPUT_BUFFER_DEFAULT;
+    config->flush_interval = RTP_FLUSH_INTERVAL_DEFAULT;
+    config->direct_io = 0;
+    config->group_commit = 0;
+    config->group_commit_bytes = RTP_GROUP_COMMIT_BYTES_DEFAULT;
+    config->rcvbuf = RTP_RCVBUF_DEFAULT;
+    config->engine = RTP_ENGINE_EPOLL;
+    config->capture_interface = NULL;
+}
+
+int rtp_store_init(void)
 {
-    int i;
-    for(i = 0; i < MAX_STREAMS; i++)
-        streams[i] = NULL;
+    struct rtp_store_config config;
+    rtp_store_config_init(&config);
+    return rtp_store_init_config(&config);
+}
+
+int rtp_store_init_config(const struct rtp_store_config *config)
+{
+    rtp_registry_init();
+    rtp_net_init(config);
+    rtp_foutput_init(config);
+    if(rtp_task_init() == -1) {
+        rtp_print_log(RTP_ERROR, "RtpStore initialization failed.\n");
+        return -1;
+    }
+    if(rtp_writer_pool_init(config) == -1) {
+        rtp_task_close();
+        rtp_print_log(RTP_ERROR, "RtpStore initialization failed.\n");
+        return -1;
+    }
+    if(rtp_worker_pool_init(config) == -1) {
+        rtp_writer_pool_close();
+        rtp_task_close();
+        rtp_print_log(RTP_ERROR, "RtpStore initialization failed.\n");
+        return -1;
+    }
+    initialized = 1;
     rtp_print_log(RTP_INFO, "RtpStore initialized.\n");
+    return 0;
 }
 
-int rtp_store_create_stream(char *ip, uint16_t video_port, uint16_t audio_port,
-               char *file_path)
+void rtp_stream_config_init(struct rtp_stream_config *config)
 {
-    int id = get_avail_streamid();
-    if(id == -1 || streams[id] != NULL) return -1;
+    config->max_fsize_quota = MAX_FSIZE_QUOTA_UNBOUNDED;
+    config->max_segment_time = 0;
+    config->seek_interval = RTP_SEEK_INTERVAL_DEFAULT;
+    config->seek_packets = 0;
+    config->video_clock_rate = RTP_VIDEO_CLOCK_RATE_DEFAULT;
+    config->audio_clock_rate = RTP_AUDIO_CLOCK_RATE_DEFAULT;
+    config->shards = 1;
+    config->capture = 0;
+    config->sync_interval = 0;
+    config->sync_bytes = 0;
+}
 
-    streams[id] = rtp_stream_init(ip, video_port, audio_port, file_path);
-    if(streams[id] == NULL) return -1;
+rtp_stream_id_t rtp_store_create_stream(char *ip, uint16_t video_port, uint16_t audio_port,
+                                        char *file_path)
+{
+    struct rtp_stream_config config;
+    rtp_stream_config_init(&config);
+    return rtp_store_create_stream_config(ip, video_port, audio_port, file_path, &config);
+}
 
-    if(rtp_stream_run(streams[id]) == -1) {
-        free_streamid(id);                      //uvolnenie prostriedkov.
+rtp_stream_id_t rtp_store_create_stream_config(char *ip, uint16_t video_port, uint16_t audio_port,
+                                               char *file_path, const struct rtp_stream_config *config)
+{
+    if(!initialized) {
+        rtp_print_log(RTP_ERROR, "RtpStore is not initialized\n");
+        return -1;
+    }
+
+    struct rtp_stream *stream = rtp_stream_init(ip, video_port, audio_port, file_path, config);
+    if(stream == NULL) return -1;
+
+    if(rtp_stream_run(stream) == -1)            //stream is closed by rtp_stream_run()
+        return -1;
+
+    //stream is published only when it runs, nobody else can reach it before
+    rtp_stream_id_t id = rtp_registry_add(stream);
+    if(id == -1) {
+        rtp_stream_close(stream);
         return -1;
     }
 
-    rtp_print_log(RTP_INFO, "Rtp stream with ID=%d created on IP=%s vport=%d aport=%d outputfile=%s\n",
-                  id, ip, video_port, audio_port, file_path);
+    rtp_print_log(RTP_INFO, "Rtp stream with ID=%lld created on IP=%s vport=%d aport=%d outputfile=%s\n",
+                  (long long) id, ip, video_port, audio_port, file_path);
     return id;
 }
 
-int rtp_store_close_stream(int id)
+int rtp_store_close_stream(rtp_stream_id_t id)
 {
-    if(id == -1 || streams[id] == NULL) {
-        rtp_print_log(RTP_ERROR, "Wrong parameter (ID == -1 or NULL)\n");
+    struct rtp_stream *stream = rtp_registry_remove(id);     //ID is not valid anymore
+    if(stream == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (ID=%lld is not valid)\n", (long long) id);
         return -1;
     }
-    rtp_stream_close(streams[id]);  //uzavrie streams[id], ale hodnota smernika streams[id] ostava nezmenena!!
-    free_streamid(id);              //nastavenie na NULL, aby sa znova mohol pouzit.
-    rtp_print_log(RTP_INFO, "Closing rtp stream with ID=%d\n", id);
+    rtp_stream_close(stream);
+    rtp_print_log(RTP_INFO, "Closing rtp stream with ID=%lld\n", (long long) id);
     return 0;
 }
 
-rtp_stream_state_t rtp_get_stream_state(int id)
+rtp_stream_state_t rtp_get_stream_state(rtp_stream_id_t id)
 {
-    if(id == -1 || streams[id] == NULL) {
-        rtp_print_log(RTP_ERROR, "Wrong parameter (ID == -1 or NULL)\n");
+    struct rtp_stream *stream = rtp_registry_get(id);
+    if(stream == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (ID=%lld is not valid)\n", (long long) id);
         return RTP_FAILED;
     }
 
-    return rtp_get_stream_info(streams[id]).rtp_stream_state;
+    rtp_stream_state_t state = rtp_get_stream_info(stream).rtp_stream_state;
+    rtp_registry_put(id);
+    return state;
 }
 
-double rtp_get_stream_download_speed(int id)
+double rtp_get_stream_download_speed(rtp_stream_id_t id)
 {
-    if(id == -1 || streams[id] == NULL) {
-        rtp_print_log(RTP_ERROR, "Wrong parameter (ID == -1 or NULL)\n");
+    struct rtp_stream *stream = rtp_registry_get(id);
+    if(stream == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (ID=%lld is not valid)\n", (long long) id);
         return -1;
     }
 
-    return rtp_get_stream_info(streams[id]).download_speed;
+    double speed = rtp_get_stream_info(stream).download_speed;
+    rtp_registry_put(id);
+    return speed;
 }
 
-off64_t rtp_get_stream_dsize(int id)
+int rtp_get_stream_sources(rtp_stream_id_t id, struct rtp_source_stats *sources, unsigned int max)
 {
-    if(id == -1 || streams[id] == NULL) {
-        rtp_print_log(RTP_ERROR, "Wrong parameter (ID == -1 or NULL)\n");
+    if(sources == NULL && max > 0) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (sources == NULL)\n");
+        return -1;
+    }
+    struct rtp_stream *stream = rtp_registry_get(id);
+    if(stream == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (ID=%lld is not valid)\n", (long long) id);
         return -1;
     }
 
-    return rtp_get_stream_info(streams[id]).downloaded_data_size;
+    int count = (int) rtp_ssrc_stats(&(stream->sources), sources, max);
+    rtp_registry_put(id);
+    return count;
 }
 
-void rtp_store_close(void)
+int rtp_get_stream_queue_stats(rtp_stream_id_t id, struct rtp_queue_stats *stats)
+{
+    if(stats == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (stats == NULL)\n");
+        return -1;
+    }
+    struct rtp_stream *stream = rtp_registry_get(id);
+    if(stream == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (ID=%lld is not valid)\n", (long long) id);
+        return -1;
+    }
+
+    *stats = rtp_get_stream_info(stream).queue;
+    rtp_registry_put(id);
+    return 0;
+}
+
+int rtp_get_stream_socket_stats(rtp_stream_id_t id, struct rtp_socket_stats *stats)
+{
+    if(stats == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (stats == NULL)\n");
+        return -1;
+    }
+    struct rtp_stream *stream = rtp_registry_get(id);
+    if(stream == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (ID=%lld is not valid)\n", (long long) id);
+        return -1;
+    }
+
+    *stats = rtp_get_stream_info(stream).sockets;
+    rtp_registry_put(id);
+    return 0;
+}
+
+int rtp_get_streams_stats(struct rtp_stream_stats *stats, unsigned int max)
 {
-    int i;
-    for(i = 0; i < MAX_STREAMS; i++) {
-        if(streams[i] != NULL)
-            rtp_store_close_stream(i);
+    if(stats == NULL && max > 0) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (stats == NULL)\n");
+        return -1;
     }
+
+    unsigned int count = 0;
+    rtp_stream_id_t id;
+    for(id = rtp_registry_next(-1); id != -1 && count < max; id = rtp_registry_next(id)) {
+        struct rtp_stream *stream = rtp_registry_get(id);
+        if(stream == NULL)                      //stream was closed meanwhile
+            continue;
+        struct rtp_stream_info info = rtp_get_stream_info(stream);
+        rtp_registry_put(id);
+
+        stats[count].id = id;
+        stats[count].state = info.rtp_stream_state;
+        stats[count].download_speed = info.download_speed;
+        stats[count].downloaded_data_size = info.downloaded_data_size;
+        stats[count].queue = info.queue;
+        stats[count].sockets = info.sockets;
+        stats[count].durable_offset = info.durable_offset;
+        stats[count].durable_segment = info.durable_segment;
+        count++;
+    }
+    return (int) count;
+}
+
+off64_t rtp_get_stream_dsize(rtp_stream_id_t id)
+{
+    struct rtp_stream *stream = rtp_registry_get(id);
+    if(stream == NULL) {
+        rtp_print_log(RTP_ERROR, "Wrong parameter (ID=%lld is not valid)\n", (long long) id);
+        return -1;
+    }
+
+    off64_t dsize = rtp_get_stream_info(stream).downloaded_data_size;
+    rtp_registry_put(id);
+    return dsize;
+}
+
+void rtp_store_close(void)
+{
+    rtp_stream_id_t id;
+    while((id = rtp_registry_next(-1)) != -1)
+        rtp_store_close_stream(id);
+    rtp_registry_close();
+    rtp_worker_pool_close();
+    rtp_writer_pool_close();
+    rtp_task_close();
+    initialized = 0;
     rtp_print_log(RTP_INFO, "RtpStore is closed.\n");
     rtp_close_log();
 }
@@ -5,27 +5,56 @@
  *      Author: Matus Valo
  *      E-mail: matusvalo@gmail.com
  */
+#define _GNU_SOURCE         //recvmmsg()
 
 #include <sys/types.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/time.h>
 #include <errno.h>
 #include <string.h>                                     //strerror()
+#include <linux/filter.h>                               //struct sock_fprog
 #include "rtp_foutput.h"
 #include "rtp_stream_thread.h"
 #include "rtp_store.h"
 #include "rtp_network.h"
+#include "rtp_writer.h"
+#include "rtp_ssrc.h"
+#include "rtp_ring.h"
+#include "rtp_uring.h"
 #include "rtp.h"
 #include "vat.h"
 #include "log.h"
 
 #define TRUNC 1000000
 
+//Maximum count of recvmmsg() calls on one socket per readiness event. Bounds time spent
+//on one socket, so other sockets of worker are not starved.
+#define MAX_RECV_ROUNDS 4
+
+//Initial size of data of slot in ring, which datagram is received into directly. Datagram
+//of ethernet MTU fits into it.
+#define RECV_SLOT_DEFAULT 1472
+
+//Minimal size of data of slot in ring.
+#define RECV_SLOT_MIN 64
+
 /*
  * Module of network implementation.
  */
 
+static rtp_tstamp_source_t tstamp_source = RTP_TSTAMP_KERNEL;   //source of arrival time of packets
+static int rcvbuf_size = RTP_RCVBUF_DEFAULT;                    //requested size of receive buffers
+static int direct_recv = 1;                                     //datagrams are received directly into rings
+
+void rtp_net_init(const struct rtp_store_config *config)
+{
+    tstamp_source = config->tstamp;
+    rcvbuf_size = config->rcvbuf > INT_MAX / 2 ? INT_MAX / 2 : (int) config->rcvbuf;
+    direct_recv = config->direct_recv;
+}
+
 
 //Sets sockets of session to no blocking mode.
 static int set_socks_nonblock(struct rtp_session *session)
@@ -58,6 +87,153 @@ static int set_socks_nonblock(struct rtp_session *session)
     return 0;
 }
 
+//Enables kernel timestamps of received packets on sockets of session. When it fails, arrival
+//time of packets is taken by gettimeofday() after they are received.
+static int set_socks_timestamps(struct rtp_session *session)
+{
+    int one = 1;
+    if(setsockopt(session->rtp_sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+        rtp_print_log(RTP_WARN, "Setting SO_TIMESTAMPNS on RTP socket(FD=%d) failed(%s)\n",
+                      session->rtp_sockfd, strerror(errno));
+        return -1;
+    }
+    if(setsockopt(session->rtcp_sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+        rtp_print_log(RTP_WARN, "Setting SO_TIMESTAMPNS on RTCP socket(FD=%d) failed(%s)\n",
+                      session->rtcp_sockfd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//Sets size of receive buffer of socket sockfd. SO_RCVBUFFORCE (privileged) isn't limited by
+//net.core.rmem_max, SO_RCVBUF is used when it fails. Returns size reported by kernel.
+static int set_sock_rcvbuf(int sockfd)
+{
+    int size = rcvbuf_size;
+    if(size != RTP_RCVBUF_DEFAULT
+       && setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0
+       && setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+        rtp_print_log(RTP_WARN, "Setting SO_RCVBUF on socket(FD=%d) failed(%s)\n",
+                      sockfd, strerror(errno));
+
+    int actual = 0;
+    socklen_t len = sizeof(actual);
+    getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &actual, &len);
+    if(size != RTP_RCVBUF_DEFAULT && actual / 2 < size)     //kernel doubles requested size
+        rtp_print_log(RTP_WARN, "Receive buffer of socket(FD=%d) has %d B instead of %d B (see net.core.rmem_max)\n",
+                      sockfd, actual / 2, size);
+    return actual;
+}
+
+//Enables counting of datagrams dropped by kernel (SO_RXQ_OVFL) on sockets of session.
+static int set_socks_ovfl(struct rtp_session *session)
+{
+    int one = 1;
+    if(setsockopt(session->rtp_sockfd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+        rtp_print_log(RTP_WARN, "Setting SO_RXQ_OVFL on RTP socket(FD=%d) failed(%s)\n",
+                      session->rtp_sockfd, strerror(errno));
+        return -1;
+    }
+    if(setsockopt(session->rtcp_sockfd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+        rtp_print_log(RTP_WARN, "Setting SO_RXQ_OVFL on RTCP socket(FD=%d) failed(%s)\n",
+                      session->rtcp_sockfd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//Joins socket sockfd to SO_REUSEPORT group of shards sockets as socket number shard. Socket
+//accepts only RTP packets with sequence number modulo shards equal to shard. For unicast
+//it is the socket selected by program of group, multicast is delivered to every socket.
+static int set_sock_shard(int sockfd, unsigned int shard, unsigned int shards)
+{
+    int one = 1;
+    if(setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        rtp_print_log(RTP_ERROR, "Setting SO_REUSEPORT on socket(FD=%d) failed(%s)\n",
+                      sockfd, strerror(errno));
+        return -1;
+    }
+
+    struct sock_filter code[] = {                       //data start with UDP header
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 8 + 2),      //RTP sequence number
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, shards),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, shard, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+        BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code
+    };
+    if(setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        rtp_print_log(RTP_ERROR, "Attaching filter to socket(FD=%d) failed(%s)\n",
+                      sockfd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//Attaches program selecting socket of SO_REUSEPORT group of socket sockfd by RTP sequence
+//number, so packets of one flow are spread over all shards sockets of group.
+static int set_group_steering(int sockfd, unsigned int shards)
+{
+    struct sock_filter code[] = {                       //data start with UDP payload
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 2),          //RTP sequence number
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, shards),
+        BPF_STMT(BPF_RET | BPF_A, 0)
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code
+    };
+    if(setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        rtp_print_log(RTP_ERROR, "Attaching SO_REUSEPORT program to socket(FD=%d) failed(%s)\n",
+                      sockfd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//Opens additional RTP socket number shard of SO_REUSEPORT group of session bound to addr.
+//Returns file descriptor on success, -1 otherwise.
+static int open_shard(struct rtp_session *session, unsigned int shard, struct sockaddr_in *addr,
+                      struct ip_mreq *mreq)
+{
+    int one = 1;
+    int sockfd = socket(PF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if(sockfd == -1) {
+        rtp_print_log(RTP_ERROR, "Rtp socket(shard=%u) failed with errno=%s\n", shard, strerror(errno));
+        return -1;
+    }
+
+    if(tstamp_source == RTP_TSTAMP_KERNEL
+       && setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0)
+        rtp_print_log(RTP_WARN, "Setting SO_TIMESTAMPNS on RTP socket(FD=%d) failed(%s)\n",
+                      sockfd, strerror(errno));
+    if(setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0)
+        rtp_print_log(RTP_WARN, "Setting SO_RXQ_OVFL on RTP socket(FD=%d) failed(%s)\n",
+                      sockfd, strerror(errno));
+    set_sock_rcvbuf(sockfd);
+    if(IN_CLASSD(ntohl(mreq->imr_multiaddr.s_addr)))
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (char *) &one, sizeof(one));
+    if(set_sock_shard(sockfd, shard, session->shards) == -1)
+        goto ON_ERROR;
+
+    if(bind(sockfd, (struct sockaddr *) addr, sizeof(*addr)) < 0) {
+        rtp_print_log(RTP_ERROR, "RTP socket (shard=%u, port=%d) bind failed with errno=%s\n",
+                      shard, ntohs(addr->sin_port), strerror(errno));
+        goto ON_ERROR;
+    }
+    if(IN_CLASSD(ntohl(mreq->imr_multiaddr.s_addr))
+       && setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char *) mreq, sizeof(*mreq)) < 0)
+        goto ON_ERROR;
+    return sockfd;
+
+    ON_ERROR:
+    close(sockfd);
+    return -1;
+}
+
 //TODO:implementacia DNS
 int rtp_net_connect(char *ip, uint16_t rtp_port, struct rtp_session *session)
 {
@@ -114,6 +290,11 @@ int rtp_net_connect(char *ip, uint16_t rtp_port, struct rtp_session *session)
 
     //setting nonblocking mod of sockets (see man 2 select - part bugs)
     set_socks_nonblock(session);
+    if(tstamp_source == RTP_TSTAMP_KERNEL)
+        set_socks_timestamps(session);
+    set_socks_ovfl(session);
+    session->rcvbuf = set_sock_rcvbuf(session->rtp_sockfd);
+    set_sock_rcvbuf(session->rtcp_sockfd);
 
     //------------------------------------------------------
     //skopirovane z RtpStore
@@ -125,6 +306,11 @@ int rtp_net_connect(char *ip, uint16_t rtp_port, struct rtp_session *session)
         setsockopt(session->rtcp_sockfd, SOL_SOCKET, SO_REUSEADDR, (char *) &one, sizeof(one));
     //-----------------------------------------------------
 
+    session->addr = rtp_addr.sin_addr.s_addr;
+    session->port = rtp_port;
+    if(session->shards > 1 && set_sock_shard(session->rtp_sockfd, 0, session->shards) == -1)
+        goto ON_ERROR;
+
     //TODO:kontrola podla errno + kontrola parnosti, neparnosti portov
 
     if(bind(session->rtp_sockfd, (struct sockaddr *) &rtp_addr, sizeof(rtp_addr)) < 0) {
@@ -151,6 +337,16 @@ int rtp_net_connect(char *ip, uint16_t rtp_port, struct rtp_session *session)
     }
     //------------------------------------------------------
 
+    //order of binding is order of sockets in group, that is selected by program of group
+    unsigned int i;
+    for(i = 1; i < session->shards; i++) {
+        session->shard_sockfd[i - 1] = open_shard(session, i, &rtp_addr, &rtp_mreq);
+        if(session->shard_sockfd[i - 1] == -1)
+            goto ON_ERROR;
+    }
+    if(session->shards > 1 && set_group_steering(session->rtp_sockfd, session->shards) == -1)
+        goto ON_ERROR;
+
     rtp_print_log(RTP_DEBUG, "Rtp session (ip=%s, rtp port=%d) net connect successed\n",
                   ip, rtp_port);
     return 0;
@@ -161,6 +357,23 @@ int rtp_net_connect(char *ip, uint16_t rtp_port, struct rtp_session *session)
     return -1;
 }
 
+int rtp_net_mute(struct rtp_session *session)
+{
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code
+    };
+    if(setsockopt(session->rtp_sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0
+       || setsockopt(session->rtcp_sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        rtp_print_log(RTP_ERROR, "Attaching filter to sockets of session failed(%s)\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
 void rtp_net_close(struct rtp_session *session)
 {
     if(session->rtp_sockfd > 0) {
@@ -173,6 +386,13 @@ void rtp_net_close(struct rtp_session *session)
         session->rtcp_sockfd = -1;
         rtp_print_log(RTP_DEBUG, "RTCP session closed.\n");
     }
+    unsigned int i;
+    for(i = 1; i < session->shards; i++) {
+        if(session->shard_sockfd[i - 1] > 0) {
+            close(session->shard_sockfd[i - 1]);
+            session->shard_sockfd[i - 1] = -1;
+        }
+    }
 }
 
 // Konverzia timeval na double.
@@ -181,7 +401,7 @@ static inline double tdbl(struct timeval *a)
    return(a->tv_sec + a->tv_usec/1e6);
 }
 
-static int parse_header(char *buf)
+static inline int parse_header(char *buf)
 {
   rtp_hdr_t *r = (rtp_hdr_t *)buf;
   int hlen = 0;
@@ -212,53 +432,324 @@ static inline int rtp_packet_filter(char *buf, int len)
     return 0;
 }
 
-static int packet_handler(struct timeval now, int is_rtcp, RD_buffer_t *packet, int len,
-                        rtp_session_type_t stream_type, struct rtp_stream *stream)
+//Fills rtpdump header hdr of packet data of size len received at time dnow. Returns size of
+//data stored in record (payload may be truncated), -1 when packet is not stored.
+static int prepare_record(double dnow, int is_rtcp, char *data, int len, RD_packet_t *hdr,
+                          rtp_session_type_t stream_type, struct rtp_stream *stream)
 {
-    double dnow = tdbl(&now);
     int hlen;                                   /* header length */
     int offset;
-
-    if((stream->first_rtp == -1) && (!is_rtcp)) {
-        stream->first_rtp = dnow - 3;
-        if(stream->first_rtp < 0) stream->first_rtp = 0;
+    double first_rtp;
+
+    __atomic_load(&(stream->first_rtp), &first_rtp, __ATOMIC_ACQUIRE);
+    if((first_rtp == -1) && (!is_rtcp)) {
+        double start = dnow - 3;
+        if(start < 0) start = 0;
+        //workers of sharded stream may race, time of the first one is kept
+        if(__atomic_compare_exchange(&(stream->first_rtp), &first_rtp, &start, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            first_rtp = start;
     }
 
-    hlen = is_rtcp ? len : parse_header(packet->p.data);
-    offset = (int)((dnow - stream->first_rtp) * 1000);
-    packet->p.hdr.offset = htonl(offset);
-    packet->p.hdr.plen = is_rtcp ? 0 : htons(len);
+    hlen = is_rtcp ? len : parse_header(data);
+    offset = (int)((dnow - first_rtp) * 1000);
+    hdr->offset = htonl(offset);
+    hdr->plen = is_rtcp ? 0 : htons(len);
 
     // truncation of payload
     if(!is_rtcp && (len - hlen > TRUNC))
         len = hlen + TRUNC;
-    packet->p.hdr.length = htons(len + sizeof(packet->p.hdr));
+    hdr->length = htons(len + sizeof(*hdr));
 
-    if(stream->first_rtp >= 0) {
+    if(first_rtp >= 0) {
         if(is_rtcp) {
-            if(rtcp_packet_filter(packet->p.data, len) != 0)
-                return rtp_write_packet(stream_type, packet, len + sizeof(packet->p.hdr), stream);
+            if(rtcp_packet_filter(data, len) != 0)
+                return len;
         }
         else {
-            if (rtp_packet_filter(packet->p.data, len) != 0)
-                return rtp_write_packet(stream_type, packet, len + sizeof(packet->p.hdr), stream);
+            if (rtp_packet_filter(data, len) != 0) {
+                if(stream->video_session.shards == 1)           //sharded stream is updated by writer
+                    rtp_ssrc_update(&(stream->sources), data, len, dnow, stream_type == RTP_VIDEO);
+                return len;
+            }
         }
     }
-    return 0;
+    return -1;
 }
 
-ssize_t read_from_sock(int sockfd, rtp_session_type_t session_type, int is_rtcp, struct rtp_stream *stream)
+//Handles one received packet. Fills rtpdump header of packet and stores it into queue
+//of socket number shard of SO_REUSEPORT group.
+static int handle_packet(double dnow, int is_rtcp, RD_buffer_t *packet, int len,
+                         rtp_session_type_t stream_type, struct rtp_stream *stream, unsigned int shard)
 {
-    struct timeval now;
-    ssize_t len = -1;
-    RD_buffer_t packet;
-    gettimeofday(&now, 0);
-    len = recv(sockfd, packet.p.data, sizeof(packet.p.data), 0);    //v originale recvfrom
-    if(len == -1) {
-        rtp_print_log(RTP_WARN, "recv() failed with errno %s\n", strerror(errno));
+    len = prepare_record(dnow, is_rtcp, packet->p.data, len, &(packet->p.hdr), stream_type, stream);
+    if(len == -1)
         return 0;
+    return rtp_write_packet(stream_type, packet, len + sizeof(packet->p.hdr), stream, shard);
+}
+
+//Returns arrival time of datagram msg taken by kernel, or time now (taken by gettimeofday()
+//only once per batch) when datagram doesn't carry kernel timestamp. Stores count of datagrams
+//dropped by kernel on socket to ovfl, when datagram carries it.
+static inline double packet_time(struct msghdr *msg, struct timeval *now, uint32_t *ovfl)
+{
+    double time = -1;
+    struct cmsghdr *cmsg;
+    for(cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if(cmsg->cmsg_level != SOL_SOCKET)
+            continue;
+        if(cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            time = ts.tv_sec + ts.tv_nsec / 1e9;
+        } else if(cmsg->cmsg_type == SO_RXQ_OVFL)     //present only after the first drop
+            memcpy(ovfl, CMSG_DATA(cmsg), sizeof(*ovfl));
+    }
+    if(time >= 0)
+        return time;
+
+    if(now->tv_sec == 0)
+        gettimeofday(now, 0);
+    return tdbl(now);
+}
+
+//Handles batch of count received packets by socket number shard of SO_REUSEPORT group.
+//Stores the last count of datagrams dropped by kernel on socket carried by packets to ovfl.
+static void packet_handler(int is_rtcp, struct rtp_recv_batch *batch, int count,
+                           rtp_session_type_t stream_type, struct rtp_stream *stream,
+                           unsigned int shard, uint32_t *ovfl)
+{
+    struct timeval now = {0, 0};
+    int i;
+    for(i = 0; i < count; i++) {
+        double dnow = packet_time(&(batch->msgs[i].msg_hdr), &now, ovfl);
+        handle_packet(dnow, is_rtcp, &(batch->packets[i]), batch->msgs[i].msg_len, stream_type, stream, shard);
+    }
+}
+
+int rtp_parse_header(char *buf)
+{
+    return parse_header(buf);
+}
+
+void rtp_packet_handler(int is_rtcp, struct rtp_recv_batch *batch, int count,
+                        rtp_session_type_t stream_type, struct rtp_stream *stream)
+{
+    uint32_t ovfl = 0;
+    packet_handler(is_rtcp, batch, count, stream_type, stream, 0, &ovfl);
+}
+
+int rtp_recv_batch_init(struct rtp_recv_batch *batch, unsigned int size)
+{
+    if(size == 0)
+        size = RTP_RECV_BATCH_DEFAULT;
+
+    batch->size = size;
+    batch->packets = (RD_buffer_t *) malloc(size * sizeof(RD_buffer_t));
+    batch->msgs = (struct mmsghdr *) calloc(size, sizeof(struct mmsghdr));
+    batch->iovs = (struct iovec *) malloc(2 * size * sizeof(struct iovec));
+    batch->ctrls = (char (*)[RTP_CTRL_LEN]) malloc(size * RTP_CTRL_LEN);
+    if(batch->packets == NULL || batch->msgs == NULL || batch->iovs == NULL || batch->ctrls == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of receive batch failed\n");
+        rtp_recv_batch_free(batch);
+        return -1;
+    }
+
+    unsigned int i;
+    for(i = 0; i < size; i++) {
+        batch->msgs[i].msg_hdr.msg_iov = &(batch->iovs[2 * i]);
+        batch->msgs[i].msg_hdr.msg_control = batch->ctrls[i];
+    }
+    return 0;
+}
+
+void rtp_recv_batch_free(struct rtp_recv_batch *batch)
+{
+    free(batch->packets);
+    free(batch->msgs);
+    free(batch->iovs);
+    free(batch->ctrls);
+    batch->ctrls = NULL;
+    batch->packets = NULL;
+    batch->msgs = NULL;
+    batch->iovs = NULL;
+    batch->size = 0;
+}
+
+//Adds datagrams dropped by kernel since the last counter ovfl of socket of endpoint to its drops.
+static inline void account_ovfl(struct rtp_endpoint *ep, uint32_t ovfl)
+{
+    if(ovfl != ep->ovfl) {                                      //kernel dropped datagrams
+        __atomic_store_n(&(ep->dropped), ep->dropped + (uint32_t) (ovfl - ep->ovfl), __ATOMIC_RELAXED);
+        ep->ovfl = ovfl;
     }
+}
+
+ssize_t read_from_uring(struct rtp_endpoint *ep, char *buf, unsigned int len, struct timeval *now)
+{
+    if(len < RTP_URING_DATA_OFFSET)
+        return 0;
 
-    packet_handler(now, is_rtcp, &packet, len, session_type, stream);
+    struct io_uring_recvmsg_out out;
+    memcpy(&out, buf, sizeof(out));
+    struct msghdr msg = {
+        .msg_control = buf + sizeof(out),
+        .msg_controllen = out.controllen
+    };
+    uint32_t ovfl = ep->ovfl;
+    double dnow = packet_time(&msg, now, &ovfl);
+    account_ovfl(ep, ovfl);
+
+    //rtpdump header is written over the end of space for control messages, already parsed
+    unsigned int size = len - RTP_URING_DATA_OFFSET;
+    RD_buffer_t *packet = (RD_buffer_t *) (buf + RTP_URING_DATA_OFFSET - sizeof(RD_packet_t));
+    handle_packet(dnow, ep->is_rtcp, packet, size, ep->session_type, ep->stream, ep->shard);
+    return size;
+}
+
+ssize_t read_from_capture(struct rtp_endpoint *ep, char *data, unsigned int len, const struct timespec *tstamp)
+{
+    //rtpdump header is written over UDP header, already parsed
+    RD_buffer_t *packet = (RD_buffer_t *) (data - sizeof(RD_packet_t));
+    if(len > sizeof(packet->p.data))
+        len = sizeof(packet->p.data);
+    double dnow = tstamp->tv_sec + tstamp->tv_nsec / 1e9;
+    handle_packet(dnow, ep->is_rtcp, packet, len, ep->session_type, ep->stream, 0);
     return len;
 }
+
+//Points data vectors of count messages of batch to its receive buffers.
+static inline void aim_buffers(struct rtp_recv_batch *batch, unsigned int count)
+{
+    unsigned int i;
+    for(i = 0; i < count; i++) {
+        struct iovec *iov = batch->msgs[i].msg_hdr.msg_iov;
+        iov[0].iov_base = batch->packets[i].p.data;
+        iov[0].iov_len = sizeof(batch->packets[i].p.data);
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+//Points data vectors of count messages of batch to slots of size slot starting at space.
+//Data of datagram are received behind space for tag and rtpdump header of record, rest of
+//datagram larger than slot continues into receive buffer.
+static inline void aim_slots(struct rtp_recv_batch *batch, char *space, uint32_t slot, unsigned int count)
+{
+    uint32_t data_len = slot - 1 - sizeof(RD_packet_t) - RING_SKIP_LEN;
+    unsigned int i;
+    for(i = 0; i < count; i++) {
+        struct iovec *iov = batch->msgs[i].msg_hdr.msg_iov;
+        iov[0].iov_base = space + i * slot + 1 + sizeof(RD_packet_t);
+        iov[0].iov_len = data_len;
+        iov[1].iov_base = batch->packets[i].p.data;
+        iov[1].iov_len = sizeof(batch->packets[i].p.data) - data_len;
+        batch->msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+}
+
+//Completes count datagrams received by endpoint into slots of size slot starting at space.
+//Every slot becomes record followed by skipped space, or skipped space only, when packet is
+//not stored. Datagrams from the first one larger than slot are moved into receive buffers
+//and stored by copying, after space of previous slots is committed to ring.
+static void complete_slots(struct rtp_endpoint *ep, struct rtp_ring *ring, struct rtp_recv_batch *batch,
+                           char *space, uint32_t slot, int count, uint32_t *ovfl)
+{
+    uint32_t data_len = slot - 1 - sizeof(RD_packet_t) - RING_SKIP_LEN;
+    char tag = ep->session_type == RTP_VIDEO ? 'V' : 'A';
+    struct timeval now = {0, 0};
+    uint32_t records = 0;
+    uint32_t max_len = RECV_SLOT_MIN;
+    int spilled = -1;                                           //the first datagram larger than slot
+    int i;
+    for(i = 0; i < count; i++) {
+        uint32_t len = batch->msgs[i].msg_len;
+        if(len > max_len)
+            max_len = len;
+        if(len > data_len && spilled == -1)
+            spilled = i;
+        if(spilled != -1) {                                     //slot is not committed, data are moved
+            char *data = batch->packets[i].p.data;
+            if(len > data_len) {
+                memmove(data + data_len, data, len - data_len);
+                memcpy(data, space + i * slot + 1 + sizeof(RD_packet_t), data_len);
+            } else
+                memcpy(data, space + i * slot + 1 + sizeof(RD_packet_t), len);
+            continue;
+        }
+
+        char *rec = space + i * slot;
+        RD_packet_t hdr;
+        double dnow = packet_time(&(batch->msgs[i].msg_hdr), &now, ovfl);
+        int rlen = prepare_record(dnow, ep->is_rtcp, rec + 1 + sizeof(hdr), len, &hdr, ep->session_type, ep->stream);
+        uint32_t used = 0;
+        if(rlen != -1) {
+            rec[0] = tag;
+            memcpy(rec + 1, &hdr, sizeof(hdr));
+            used = 1 + sizeof(hdr) + rlen;
+            records++;
+        }
+        rtp_ring_skip(rec + used, slot - used);
+    }
+
+    rtp_ring_commit(ring, (spilled == -1 ? count : spilled) * slot, records);
+    for(i = spilled; i != -1 && i < count; i++) {
+        double dnow = packet_time(&(batch->msgs[i].msg_hdr), &now, ovfl);
+        handle_packet(dnow, ep->is_rtcp, &(batch->packets[i]), batch->msgs[i].msg_len,
+                      ep->session_type, ep->stream, ep->shard);
+    }
+
+    //slot follows the largest datagram, it shrinks only when datagrams get much smaller
+    if(max_len > sizeof(batch->packets[0].p.data))
+        max_len = sizeof(batch->packets[0].p.data);
+    if(count > 0 && (max_len > ep->slot_len || max_len < ep->slot_len / 2))
+        ep->slot_len = max_len;
+}
+
+ssize_t read_from_sock(struct rtp_endpoint *ep, struct rtp_recv_batch *batch)
+{
+    struct rtp_stream *stream = ep->stream;
+    struct rtp_ring *ring = ep->shard == 0 ? &(stream->ring) : &(stream->shard_rings[ep->shard - 1]);
+    if(ep->slot_len == 0)
+        ep->slot_len = RECV_SLOT_DEFAULT;
+
+    ssize_t size = 0;
+    int rounds;
+    for(rounds = 0; rounds < MAX_RECV_ROUNDS; rounds++) {
+        //datagrams are received directly into free slots of ring, into receive buffers when
+        //ring is full (policy of ring is applied then)
+        uint32_t slot = 1 + sizeof(RD_packet_t) + ep->slot_len + RING_SKIP_LEN;
+        uint32_t slots = batch->size;
+        char *space = direct_recv ? rtp_ring_reserve(ring, slot, &slots) : NULL;
+        if(space != NULL)
+            aim_slots(batch, space, slot, slots);
+        else {
+            slots = batch->size;
+            aim_buffers(batch, slots);
+        }
+
+        unsigned int i;
+        for(i = 0; i < slots; i++)                              //updated by kernel on every call
+            batch->msgs[i].msg_hdr.msg_controllen = RTP_CTRL_LEN;
+
+        int count = recvmmsg(ep->sockfd, batch->msgs, slots, MSG_DONTWAIT, NULL);
+        if(count == -1) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                rtp_print_log(RTP_WARN, "recvmmsg() failed with errno %s\n", strerror(errno));
+            break;
+        }
+
+        for(i = 0; i < (unsigned int) count; i++)
+            size += batch->msgs[i].msg_len;
+        uint32_t ovfl = ep->ovfl;
+        if(space != NULL)
+            complete_slots(ep, ring, batch, space, slot, count, &ovfl);
+        else
+            packet_handler(ep->is_rtcp, batch, count, ep->session_type, stream, ep->shard, &ovfl);
+        account_ovfl(ep, ovfl);
+        rtp_writer_notify(stream->writer);
+
+        if((unsigned int) count < slots)                        //socket is drained
+            break;
+    }
+    return size;
+}
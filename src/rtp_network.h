@@ -12,7 +12,45 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 #include "rtp_stream_thread.h"
+#include "rtp_foutput.h"
+
+/**
+ * Size of buffer for control messages (arrival time) of one datagram.
+ */
+#define RTP_CTRL_LEN 64
+
+/**
+ * Structure that represents batch of preallocated receive buffers. Every worker owns one batch.
+ */
+struct rtp_recv_batch {
+	unsigned int size;						/**< count of buffers in batch*/
+	RD_buffer_t *packets;					/**< receive buffers*/
+	struct mmsghdr *msgs;					/**< message headers for recvmmsg()*/
+	struct iovec *iovs;						/**< two data vectors of every datagram (slot of ring, receive buffer)*/
+	char (*ctrls)[RTP_CTRL_LEN];			/**< buffers for control messages of datagrams*/
+};
+
+/**
+ * Sets options of sockets created by rtp_net_connect() (source of arrival time).
+ * \param config Configuration of RtpStore.
+ */
+void rtp_net_init(const struct rtp_store_config *config);
+
+/**
+ * Allocates receive buffers of batch.
+ * \param batch Batch that will be initialized.
+ * \param size Count of buffers in batch (maximum count of datagrams received at once).
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_recv_batch_init(struct rtp_recv_batch *batch, unsigned int size);
+
+/**
+ * Frees receive buffers of batch.
+ * \param batch Batch that will be freed.
+ */
+void rtp_recv_batch_free(struct rtp_recv_batch *batch);
 
 /**
  * Function creates network connection. Creates sockets on desired port and IP address.
@@ -23,6 +61,14 @@
  */
 int rtp_net_connect(char *ip, uint16_t rtp_port, struct rtp_session *session);
 
+/**
+ * Attaches filter dropping all datagrams to sockets of session, which data are received
+ * by packet capture. Sockets stay bound, so groups stay joined.
+ * \param session RTP session.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_net_mute(struct rtp_session *session);
+
 /**
  * Closes network connection for RTP session session.
  * \param session RTP session, which network connection should be closed.
@@ -30,13 +76,57 @@ int rtp_net_connect(char *ip, uint16_t rtp_port, struct rtp_session *session);
 void rtp_net_close(struct rtp_session *session);
 
 /**
- * Reads from network connection and stores data in file specified in struct rtp_stream *stream.
- * \param sockfd File descriptor of socket.
- * \param stream_type Type of stream, which will be data read from.
- * \param is_rtcp Should be 1 if session of stream is RTCP, 0 otherwise.
- * \param stream Stream which should be data read from.
+ * Reads all pending datagrams from socket of endpoint using recvmmsg() and stores data
+ * in file specified in stream of endpoint. Unless disabled by configuration, datagrams
+ * are received directly into free space of queue of stream, so their data are not copied
+ * before they are written to output buffer.
+ * \param ep Endpoint (socket of stream), which will be data read from.
+ * \param batch Receive buffers, where datagrams are received to when queue is full.
  * \return Size of read data in bytes.
  */
-ssize_t read_from_sock(int sockfd, rtp_session_type_t stream_type, int is_rtcp, struct rtp_stream *stream);
+ssize_t read_from_sock(struct rtp_endpoint *ep, struct rtp_recv_batch *batch);
+
+/**
+ * Handles one datagram received from socket of endpoint into buffer of io_uring and stores
+ * data in file specified in stream of endpoint.
+ * \param ep Endpoint (socket of stream), which datagram was received from.
+ * \param buf Buffer filled by multishot recvmsg (see rtp_uring.h).
+ * \param len Size of used part of buffer.
+ * \param now Time taken once per completions, tv_sec is 0 until it is needed.
+ * \return Size of data of datagram in bytes.
+ */
+ssize_t read_from_uring(struct rtp_endpoint *ep, char *buf, unsigned int len, struct timeval *now);
+
+/**
+ * Handles one datagram returned by packet capture and stores data in file specified in
+ * stream of endpoint. Bytes preceeding data (UDP header) are overwritten.
+ * \param ep Endpoint (socket of stream), which datagram was sent to.
+ * \param data Data of datagram in ring of capture.
+ * \param len Size of data.
+ * \param tstamp Arrival time of datagram taken by kernel.
+ * \return Size of data of datagram in bytes.
+ */
+ssize_t read_from_capture(struct rtp_endpoint *ep, char *data, unsigned int len, const struct timespec *tstamp);
+
+/**
+ * Returns length of header of RTP or VAT packet. Used by benchmarks of packet path,
+ * receiving uses inlined version.
+ * \param buf Data of packet.
+ * \return Length of header in bytes, 0 for unknown version.
+ */
+int rtp_parse_header(char *buf);
+
+/**
+ * Handles batch of received packets: fills rtpdump headers of packets, updates statistics
+ * of sources and puts packets into queue of stream. Used by benchmarks of packet path,
+ * receiving uses inlined version.
+ * \param is_rtcp 1 for RTCP packets, 0 for RTP (or VAT) packets.
+ * \param batch Batch with received packets (msg_len of messages is length of packets).
+ * \param count Count of packets in batch.
+ * \param stream_type Type of stream which packets belong to.
+ * \param stream Stream that packets belong to.
+ */
+void rtp_packet_handler(int is_rtcp, struct rtp_recv_batch *batch, int count,
+                        rtp_session_type_t stream_type, struct rtp_stream *stream);
 
 #endif /* RTP_NETWORK_H_ */
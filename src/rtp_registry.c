@@ -0,0 +1,179 @@
+/*
+ * rtp_registry.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+#define _THREAD_SAFE        //additional objects for thread environment
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>                      //sched_yield()
+#include "rtp_store.h"
+#include "rtp_registry.h"
+#include "log.h"
+
+//Count of slots in one chunk and maximum count of chunks.
+#define CHUNK_SLOTS 1024
+#define MAX_CHUNKS 4096
+
+//Index of slot, that terminates free list.
+#define NO_SLOT UINT32_MAX
+
+//packs index and generation of slot into ID of stream
+#define REGISTRY_ID(index, gen) ((rtp_stream_id_t) (((uint64_t) (gen) << 32) | (uint32_t) (index)))
+#define REGISTRY_INDEX(id) ((uint32_t) (id))
+#define REGISTRY_GEN(id) ((uint32_t) ((uint64_t) (id) >> 32))
+
+//Slot of registry.
+struct registry_slot {
+    uint32_t gen;                       //generation of slot, incremented when stream is removed
+    uint32_t refs;                      //count of readers accessing stream
+    struct rtp_stream *stream;          //stream in slot, NULL if slot is free
+    uint32_t next_free;                 //next slot in free list
+} __attribute__((aligned(64)));
+
+static struct registry_slot *chunks[MAX_CHUNKS];    //chunks of slots
+static uint32_t nslots = 0;                         //count of allocated slots
+static uint32_t free_head = NO_SLOT;                //first slot of free list
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;  //locking mutex to add and remove streams
+
+static inline struct registry_slot *get_slot(uint32_t index)
+{
+    return &(__atomic_load_n(&chunks[index / CHUNK_SLOTS], __ATOMIC_ACQUIRE)[index % CHUNK_SLOTS]);
+}
+
+//Allocates new chunk of slots and puts them into free list. Called with registry_mutex
+//locked. Returns 0 on success, -1 otherwise.
+static int grow(void)
+{
+    uint32_t chunk = nslots / CHUNK_SLOTS;
+    if(chunk == MAX_CHUNKS) {
+        rtp_print_log(RTP_ERROR, "No avaliable ID\n");
+        return -1;
+    }
+
+    struct registry_slot *slots = NULL;
+    if(posix_memalign((void **) &slots, 64, CHUNK_SLOTS * sizeof(struct registry_slot)) != 0) {
+        rtp_print_log(RTP_ERROR, "Malloc of registry chunk failed\n");
+        return -1;
+    }
+
+    uint32_t i;
+    for(i = 0; i < CHUNK_SLOTS; i++) {
+        slots[i].gen = 1;
+        slots[i].refs = 0;
+        slots[i].stream = NULL;
+        slots[i].next_free = i + 1 < CHUNK_SLOTS ? nslots + i + 1 : free_head;
+    }
+    free_head = nslots;
+
+    //chunk must be visible before readers can see its slots
+    __atomic_store_n(&chunks[chunk], slots, __ATOMIC_RELEASE);
+    __atomic_store_n(&nslots, nslots + CHUNK_SLOTS, __ATOMIC_RELEASE);
+    rtp_print_log(RTP_DEBUG, "Registry of streams grown to %u slots\n", nslots);
+    return 0;
+}
+
+void rtp_registry_init(void)
+{
+    pthread_mutex_lock(&registry_mutex);
+    nslots = 0;
+    free_head = NO_SLOT;
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+void rtp_registry_close(void)
+{
+    pthread_mutex_lock(&registry_mutex);
+    uint32_t i;
+    for(i = 0; i < nslots / CHUNK_SLOTS; i++) {
+        free(chunks[i]);
+        chunks[i] = NULL;
+    }
+    nslots = 0;
+    free_head = NO_SLOT;
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+rtp_stream_id_t rtp_registry_add(struct rtp_stream *stream)
+{
+    pthread_mutex_lock(&registry_mutex);
+    if(free_head == NO_SLOT && grow() == -1) {
+        pthread_mutex_unlock(&registry_mutex);
+        return -1;
+    }
+
+    uint32_t index = free_head;
+    struct registry_slot *slot = get_slot(index);
+    free_head = slot->next_free;
+    __atomic_store_n(&(slot->stream), stream, __ATOMIC_RELEASE);
+    rtp_stream_id_t id = REGISTRY_ID(index, slot->gen);
+    pthread_mutex_unlock(&registry_mutex);
+
+    rtp_print_log(RTP_DEBUG, "Stream ID=%lld allocated\n", (long long) id);
+    return id;
+}
+
+struct rtp_stream *rtp_registry_remove(rtp_stream_id_t id)
+{
+    uint32_t index = REGISTRY_INDEX(id);
+    if(id < 0 || index >= __atomic_load_n(&nslots, __ATOMIC_ACQUIRE))
+        return NULL;
+    struct registry_slot *slot = get_slot(index);
+
+    //new generation makes ID invalid for new readers and for concurrent removing
+    pthread_mutex_lock(&registry_mutex);
+    if(slot->gen != REGISTRY_GEN(id) || slot->stream == NULL) {
+        pthread_mutex_unlock(&registry_mutex);
+        return NULL;
+    }
+    struct rtp_stream *stream = slot->stream;
+    uint32_t gen = slot->gen + 1;
+    __atomic_store_n(&(slot->stream), NULL, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(slot->gen), gen > INT32_MAX ? 1 : gen, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&registry_mutex);
+
+    while(__atomic_load_n(&(slot->refs), __ATOMIC_SEQ_CST) != 0)
+        sched_yield();
+
+    pthread_mutex_lock(&registry_mutex);
+    slot->next_free = free_head;
+    free_head = index;
+    pthread_mutex_unlock(&registry_mutex);
+    return stream;
+}
+
+struct rtp_stream *rtp_registry_get(rtp_stream_id_t id)
+{
+    uint32_t index = REGISTRY_INDEX(id);
+    if(id < 0 || index >= __atomic_load_n(&nslots, __ATOMIC_ACQUIRE))
+        return NULL;
+    struct registry_slot *slot = get_slot(index);
+
+    //pairs with incrementing of generation in rtp_registry_remove()
+    __atomic_add_fetch(&(slot->refs), 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&(slot->gen), __ATOMIC_SEQ_CST) == REGISTRY_GEN(id)) {
+        struct rtp_stream *stream = __atomic_load_n(&(slot->stream), __ATOMIC_ACQUIRE);
+        if(stream != NULL)
+            return stream;
+    }
+    __atomic_sub_fetch(&(slot->refs), 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void rtp_registry_put(rtp_stream_id_t id)
+{
+    __atomic_sub_fetch(&(get_slot(REGISTRY_INDEX(id))->refs), 1, __ATOMIC_RELEASE);
+}
+
+rtp_stream_id_t rtp_registry_next(rtp_stream_id_t prev)
+{
+    uint32_t count = __atomic_load_n(&nslots, __ATOMIC_ACQUIRE);
+    uint32_t index = prev < 0 ? 0 : REGISTRY_INDEX(prev) + 1;
+    for(; index < count; index++) {
+        struct registry_slot *slot = get_slot(index);
+        if(__atomic_load_n(&(slot->stream), __ATOMIC_ACQUIRE) != NULL)
+            return REGISTRY_ID(index, __atomic_load_n(&(slot->gen), __ATOMIC_ACQUIRE));
+    }
+    return -1;
+}
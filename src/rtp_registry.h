@@ -0,0 +1,71 @@
+/*
+ * rtp_registry.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_REGISTRY_H_
+#define RTP_REGISTRY_H_
+
+#include <stdint.h>
+#include "rtp_store.h"
+#include "rtp_stream_thread.h"
+
+/**
+ * Module of registry of streams. It maps IDs of streams to streams.
+ *
+ * ID consists of index of slot (low 32 bits) and generation of slot (high 32 bits).
+ * Generation is incremented when stream is removed, so ID of removed stream never
+ * refers to stream, that reused its slot. Slots are allocated in chunks, which are
+ * never moved or freed until registry is closed. Free slots are kept in free list.
+ *
+ * Lookups don't take locks. Reader holds reference of slot while it accesses stream
+ * and removing of stream waits until all references are released.
+ */
+
+/**
+ * Initializes empty registry.
+ */
+void rtp_registry_init(void);
+
+/**
+ * Frees resources of registry. All streams must be removed before.
+ */
+void rtp_registry_close(void);
+
+/**
+ * Adds stream into registry.
+ * \param stream Stream that will be added.
+ * \return ID of stream on success, -1 otherwise.
+ */
+rtp_stream_id_t rtp_registry_add(struct rtp_stream *stream);
+
+/**
+ * Removes stream from registry. Waits until readers release references of stream.
+ * \param id ID of stream.
+ * \return Removed stream, NULL if ID is not valid.
+ */
+struct rtp_stream *rtp_registry_remove(rtp_stream_id_t id);
+
+/**
+ * Returns stream with ID and takes reference of it. Stream isn't closed until
+ * reference is released by rtp_registry_put().
+ * \param id ID of stream.
+ * \return Stream on success, NULL if ID is not valid.
+ */
+struct rtp_stream *rtp_registry_get(rtp_stream_id_t id);
+
+/**
+ * Releases reference of stream taken by rtp_registry_get().
+ * \param id ID of stream.
+ */
+void rtp_registry_put(rtp_stream_id_t id);
+
+/**
+ * Returns ID of the first stream, which slot follows slot of ID prev.
+ * \param prev ID of previous stream, -1 to start from the first slot.
+ * \return ID of stream, -1 if there are no more streams.
+ */
+rtp_stream_id_t rtp_registry_next(rtp_stream_id_t prev);
+
+#endif /* RTP_REGISTRY_H_ */
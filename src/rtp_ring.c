@@ -0,0 +1,103 @@
+/*
+ * rtp_ring.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "rtp_store.h"
+#include "rtp_foutput.h"
+#include "rtp_ring.h"
+#include "log.h"
+
+//Minimal size of ring. At least two largest records must fit into it.
+#define MIN_RING_SIZE (4 * sizeof(RD_buffer_t))
+
+//Time in microseconds, that producer waits for free space in ring with policy RTP_QUEUE_BLOCK.
+#define BLOCK_WAIT_TIME 100
+
+int rtp_ring_init(struct rtp_ring *ring, uint32_t size, rtp_queue_policy_t policy)
+{
+    uint32_t rsize = MIN_RING_SIZE;
+    while(rsize < size && rsize < (1U << 31))
+        rsize <<= 1;
+
+    ring->buf = (char *) malloc(rsize);
+    if(ring->buf == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of ring with size %u failed\n", rsize);
+        return -1;
+    }
+
+    ring->size = rsize;
+    ring->policy = policy;
+    ring->on_full = NULL;
+    ring->on_full_arg = NULL;
+    ring->head = 0;
+    ring->tail = RING_TAIL(0, 0);
+    ring->queued = 0;
+    ring->dropped = 0;
+    ring->blocked = 0;
+    ring->written = 0;
+    return 0;
+}
+
+void rtp_ring_free(struct rtp_ring *ring)
+{
+    free(ring->buf);
+    ring->buf = NULL;
+    ring->size = 0;
+}
+
+//Moves tail over the oldest records until there is need bytes of free space. Possible
+//only when consumer doesn't access ring. Returns 0 on success, -1 otherwise.
+static int drop_oldest(struct rtp_ring *ring, uint32_t need)
+{
+    uint64_t tail = __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE);
+    uint32_t claim = RING_CLAIM(tail);
+    if(claim != RING_RELEASE(tail))                         //consumer writes the oldest records
+        return -1;
+
+    uint32_t head = ring->head;
+    uint32_t pos = claim;
+    uint64_t count = 0;
+    while(ring->size - (head - pos) < need && pos != head) {
+        uint32_t off = pos & (ring->size - 1);
+        if(ring->buf[off] == RING_PAD)
+            pos += ring->size - off;
+        else {
+            if(ring->buf[off] != RING_SKIP)
+                count++;
+            pos += rtp_ring_rec_size(ring->buf + off);
+        }
+    }
+    if(ring->size - (head - pos) < need)
+        return -1;
+
+    //fails when consumer claimed records meanwhile
+    if(!__atomic_compare_exchange_n(&(ring->tail), &tail, RING_TAIL(pos, pos), 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return -1;
+
+    __atomic_store_n(&(ring->dropped), ring->dropped + count, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int rtp_ring_make_room(struct rtp_ring *ring, uint32_t need)
+{
+    switch(ring->policy) {
+    case RTP_QUEUE_DROP_OLDEST:
+        return drop_oldest(ring, need);
+    case RTP_QUEUE_BLOCK:
+        __atomic_store_n(&(ring->blocked), ring->blocked + 1, __ATOMIC_RELAXED);
+        while(ring->size - (ring->head - RING_RELEASE(__atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE))) < need) {
+            if(ring->on_full != NULL)
+                ring->on_full(ring->on_full_arg);
+            usleep(BLOCK_WAIT_TIME);
+        }
+        return 0;
+    case RTP_QUEUE_DROP_NEWEST:
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,270 @@
+/*
+ * rtp_ring.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_RING_H_
+#define RTP_RING_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "rtp_store.h"
+
+/**
+ * Module of bounded lock-free single-producer/single-consumer queue of records between
+ * worker (producer) and writer (consumer) of stream.
+ *
+ * Records are stored exactly in rtpdump format, as they will be written to file:
+ * one byte tag ('A'/'V') followed by RD_packet_t and data of packet. Record never
+ * wraps around end of buffer. When it doesn't fit into the rest of buffer, the rest
+ * is skipped and marked by tag RING_PAD.
+ *
+ * Worker may also receive datagrams directly into ring (see rtp_ring_reserve()). Space
+ * reserved for datagram but not filled by it is marked as record with tag RING_SKIP,
+ * which is not written to file.
+ *
+ * Tail of ring consists of two positions packed in one word. Claim position is moved
+ * by writer when it starts to write records, release position when writing is done.
+ * Positions are equal when writer doesn't access ring and only then producer can drop
+ * the oldest records by moving both positions.
+ */
+
+/**
+ * Tag of skipped rest of buffer.
+ */
+#define RING_PAD 0
+
+/**
+ * Tag of skipped space between records. Like record, it is followed by its length
+ * (see rtp_ring_rec_size()), so it has at least RING_SKIP_LEN bytes.
+ */
+#define RING_SKIP 1
+#define RING_SKIP_LEN 3
+
+//packs claim and release position into tail word
+#define RING_TAIL(claim, release) (((uint64_t) (release) << 32) | (uint32_t) (claim))
+#define RING_CLAIM(tail) ((uint32_t) (tail))
+#define RING_RELEASE(tail) ((uint32_t) ((tail) >> 32))
+
+/**
+ * Structure that represents ring buffer.
+ */
+struct rtp_ring {
+	char *buf;									/**< buffer of records*/
+	uint32_t size;								/**< size of buffer, power of 2*/
+	rtp_queue_policy_t policy;					/**< what to do when ring is full*/
+	void (*on_full)(void *);					/**< called before producer waits for free space*/
+	void *on_full_arg;							/**< parameter of on_full*/
+
+	uint32_t head __attribute__((aligned(64)));	/**< position of next record, moved by producer only*/
+	uint64_t queued;							/**< count of records put into ring*/
+	uint64_t dropped;							/**< count of records dropped because ring was full*/
+	uint64_t blocked;							/**< count of records that waited for free space*/
+
+	uint64_t tail __attribute__((aligned(64)));	/**< claim and release position (see RING_TAIL)*/
+	uint64_t written;							/**< count of records taken by consumer*/
+};
+
+/**
+ * Allocates buffer of ring.
+ * \param ring Ring that will be initialized.
+ * \param size Size of buffer in bytes. Rounded up to power of 2.
+ * \param policy Policy applied, when ring is full.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_ring_init(struct rtp_ring *ring, uint32_t size, rtp_queue_policy_t policy);
+
+/**
+ * Frees buffer of ring.
+ * \param ring Ring that will be freed.
+ */
+void rtp_ring_free(struct rtp_ring *ring);
+
+/**
+ * Makes room for record of size need. Called by producer when ring is full, applies
+ * policy of ring.
+ * \param ring Ring where record should be stored.
+ * \param need Size of needed space in bytes.
+ * \return 0 when space is available, -1 when record must be dropped.
+ */
+int rtp_ring_make_room(struct rtp_ring *ring, uint32_t need);
+
+/**
+ * Returns size of record (tag and RD_packet_t included) starting at rec.
+ */
+static inline uint32_t rtp_ring_rec_size(const char *rec)
+{
+    uint16_t length;
+    memcpy(&length, rec + 1, sizeof(length));               //RD_packet_t.length
+    return 1 + ntohs(length);
+}
+
+/**
+ * Puts record into ring. Called by producer only.
+ * \param ring Ring where record is stored.
+ * \param tag Tag of record ('A' or 'V').
+ * \param packet Packet with header (RD_packet_t) of record.
+ * \param len Length of packet (header included).
+ * \return 0 on success, -1 when record was dropped.
+ */
+static inline int rtp_ring_push(struct rtp_ring *ring, char tag, const void *packet, uint32_t len)
+{
+    uint32_t head = ring->head;
+    uint32_t pos = head & (ring->size - 1);
+    uint32_t contig = ring->size - pos;
+    uint32_t need = 1 + len;
+    if(contig < need)                                       //record is stored from start of buffer
+        need += contig;
+
+    uint32_t release = RING_RELEASE(__atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE));
+    if(ring->size - (head - release) < need && rtp_ring_make_room(ring, need) == -1) {
+        __atomic_store_n(&(ring->dropped), ring->dropped + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    if(contig < 1 + len) {
+        ring->buf[pos] = RING_PAD;
+        pos = 0;
+    }
+    ring->buf[pos] = tag;
+    memcpy(ring->buf + pos + 1, packet, len);
+
+    __atomic_store_n(&(ring->queued), ring->queued + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&(ring->head), head + need, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Marks space of size len (at least RING_SKIP_LEN) as skipped.
+ */
+static inline void rtp_ring_skip(char *space, uint32_t len)
+{
+    uint16_t length = htons(len - 1);
+    space[0] = RING_SKIP;
+    memcpy(space + 1, &length, sizeof(length));
+}
+
+/**
+ * Reserves contiguous space for at most *count slots of size slot at head of ring, where
+ * producer stores records directly. Policy of ring is not applied, only free space is
+ * reserved. Reserved space is made visible to consumer by rtp_ring_commit(). Called by
+ * producer only.
+ * \param ring Ring where records are stored.
+ * \param slot Size of slot in bytes.
+ * \param count (in/out) Requested count of slots, count of reserved slots.
+ * \return Pointer to reserved space, NULL when no slot is free.
+ */
+static inline char *rtp_ring_reserve(struct rtp_ring *ring, uint32_t slot, uint32_t *count)
+{
+    uint32_t head = ring->head;
+    uint32_t pos = head & (ring->size - 1);
+    uint32_t contig = ring->size - pos;
+    uint32_t release = RING_RELEASE(__atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE));
+    uint32_t space = ring->size - (head - release);
+
+    uint32_t n = 0;
+    if(contig >= slot)
+        n = (contig < space ? contig : space) / slot;
+    else if(space > contig)                                 //slots are reserved from start of buffer
+        n = (space - contig) / slot;
+    if(n > *count)
+        n = *count;
+    *count = n;
+    if(n == 0)
+        return NULL;
+
+    if(contig < slot) {
+        ring->buf[pos] = RING_PAD;
+        __atomic_store_n(&(ring->head), head + contig, __ATOMIC_RELEASE);
+        pos = 0;
+    }
+    return ring->buf + pos;
+}
+
+/**
+ * Makes space reserved by rtp_ring_reserve() and filled by records (and skipped space)
+ * visible to consumer. Called by producer only.
+ * \param ring Ring where records are stored.
+ * \param len Size of filled space in bytes.
+ * \param records Count of records (without skipped space) stored.
+ */
+static inline void rtp_ring_commit(struct rtp_ring *ring, uint32_t len, uint32_t records)
+{
+    __atomic_store_n(&(ring->queued), ring->queued + records, __ATOMIC_RELAXED);
+    __atomic_store_n(&(ring->head), ring->head + len, __ATOMIC_RELEASE);
+}
+
+/**
+ * Claims records stored in ring. Claimed records are contiguous and they are not
+ * overwritten by producer until rtp_ring_release() is called. They may contain skipped
+ * space (RING_SKIP), which is not counted in records. Called by consumer only.
+ * \param ring Ring where records are stored.
+ * \param data (out) Pointer to first claimed record.
+ * \param records (out) Count of claimed records.
+ * \return Size of claimed records in bytes, 0 when ring is empty.
+ */
+static inline uint32_t rtp_ring_claim(struct rtp_ring *ring, char **data, uint32_t *records)
+{
+    while(1) {
+        uint64_t tail = __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE);
+        uint32_t claim = RING_CLAIM(tail);
+        uint32_t head = __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+        if(claim == head)
+            return 0;
+
+        uint32_t pos = claim & (ring->size - 1);
+        uint32_t end = ring->size - pos;
+        if(head - claim < end)
+            end = head - claim;
+
+        uint32_t len = 0;
+        uint32_t count = 0;
+        if(ring->buf[pos] == RING_PAD) {
+            len = ring->size - pos;                         //nothing to write, skips to start of buffer
+        } else {
+            while(len < end && ring->buf[pos + len] != RING_PAD) {
+                if(ring->buf[pos + len] != RING_SKIP)
+                    count++;
+                len += rtp_ring_rec_size(ring->buf + pos + len);
+            }
+        }
+
+        //fails when producer dropped the oldest records meanwhile
+        uint64_t claimed = RING_TAIL(claim + len, claim);
+        if(count == 0)
+            claimed = RING_TAIL(claim + len, claim + len);
+        if(!__atomic_compare_exchange_n(&(ring->tail), &tail, claimed, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+        if(count == 0)
+            continue;
+
+        *data = ring->buf + pos;
+        *records = count;
+        return len;
+    }
+}
+
+/**
+ * Releases records claimed by rtp_ring_claim(). Called by consumer only.
+ * \param ring Ring where records are stored.
+ * \param records Count of released records.
+ */
+static inline void rtp_ring_release(struct rtp_ring *ring, uint32_t records)
+{
+    uint32_t claim = RING_CLAIM(__atomic_load_n(&(ring->tail), __ATOMIC_RELAXED));
+    __atomic_store_n(&(ring->written), ring->written + records, __ATOMIC_RELAXED);
+    __atomic_store_n(&(ring->tail), RING_TAIL(claim, claim), __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns 1 when ring contains records, 0 otherwise.
+ */
+static inline int rtp_ring_pending(struct rtp_ring *ring)
+{
+    return RING_CLAIM(__atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE))
+            != __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+}
+
+#endif /* RTP_RING_H_ */
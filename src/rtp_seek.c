@@ -0,0 +1,116 @@
+/*
+ * rtp_seek.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <stdio.h>                              //sprintf()
+#include <stdlib.h>
+#include <string.h>                             //strerror()
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "rtp_store.h"
+#include "rtp_seek.h"
+#include "log.h"
+
+/*
+ * Module for reading seek index written alongside recording by rtp_foutput.c.
+ */
+
+struct rtp_seek_index {
+    void *map;                          //mapped index file
+    size_t map_len;                     //length of mapping
+    const RD_seek_entry_t *entries;     //entries of index
+    size_t count;                       //count of entries
+    uint32_t flags;                     //flags from header of index
+};
+
+struct rtp_seek_index *rtp_seek_open(const char *file_path)
+{
+    if(file_path == NULL)
+        return NULL;
+
+    char fname[strlen(file_path) + SEEK_SUFFIX_LEN];
+    sprintf(fname, "%s.sidx", file_path);
+    int fd = open(fname, O_RDONLY | O_CLOEXEC);
+    if(fd == -1) {
+        rtp_print_log(RTP_ERROR, "Opening seek index:%s, failed:%s\n", fname, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(RD_seek_hdr_t)) {
+        rtp_print_log(RTP_ERROR, "Seek index:%s is not valid\n", fname);
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        rtp_print_log(RTP_ERROR, "Mapping seek index:%s, failed:%s\n", fname, strerror(errno));
+        return NULL;
+    }
+
+    const RD_seek_hdr_t *hdr = (const RD_seek_hdr_t *) map;
+    if(memcmp(hdr->magic, RTPSEEK_MAGIC, sizeof(hdr->magic)) != 0
+       || ntohl(hdr->entry_size) != sizeof(RD_seek_entry_t)) {
+        rtp_print_log(RTP_ERROR, "Seek index:%s is not valid\n", fname);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    struct rtp_seek_index *index = (struct rtp_seek_index *) malloc(sizeof(struct rtp_seek_index));
+    if(index == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc failed\n");
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    index->map = map;
+    index->map_len = st.st_size;
+    index->entries = (const RD_seek_entry_t *) ((const char *) map + sizeof(RD_seek_hdr_t));
+    index->count = (st.st_size - sizeof(RD_seek_hdr_t)) / sizeof(RD_seek_entry_t);
+    index->flags = ntohl(hdr->flags);
+    return index;
+}
+
+int rtp_seek_find(const struct rtp_seek_index *index, uint32_t offset, struct rtp_seek_entry *entry)
+{
+    if(index == NULL || index->count == 0)
+        return -1;
+
+    //the last entry with offset <= offset
+    size_t low = 0;
+    size_t high = index->count;
+    while(high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if(ntohl(index->entries[mid].offset) <= offset)
+            low = mid;
+        else
+            high = mid;
+    }
+
+    entry->offset = ntohl(index->entries[low].offset);
+    entry->segment = ntohl(index->entries[low].segment);
+    entry->position = be64toh(index->entries[low].position);
+    return 0;
+}
+
+int rtp_seek_segmented(const struct rtp_seek_index *index)
+{
+    return (index->flags & RTPSEEK_SEGMENTED) != 0;
+}
+
+void rtp_seek_close(struct rtp_seek_index *index)
+{
+    if(index == NULL)
+        return;
+    munmap(index->map, index->map_len);
+    free(index);
+}
@@ -0,0 +1,38 @@
+/*
+ * rtp_seek.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_SEEK_H_
+#define RTP_SEEK_H_
+
+#include <stdint.h>
+
+/*
+* seek index file format
+*
+* Seek index <file_path>.sidx is written alongside recording. It starts with one
+* RD_seek_hdr_t followed by RD_seek_entry_t entries sorted by offset. Entry is written
+* for the first packet of every segment file and then every seek interval (in
+* miliseconds) or every seek packets. All fields are in network byte order.
+*/
+
+#define RTPSEEK_MAGIC "RTPSIDX1"
+#define RTPSEEK_SEGMENTED 1     /* flag: data are stored in segment files */
+
+typedef struct {
+    char magic[8];          /* RTPSEEK_MAGIC */
+    uint32_t flags;         /* RTPSEEK_SEGMENTED or 0 */
+    uint32_t entry_size;    /* size of RD_seek_entry_t */
+} RD_seek_hdr_t;
+
+typedef struct {
+    uint32_t offset;        /* milliseconds since the start of recording */
+    uint32_t segment;       /* number of segment file, 0 if not segmented */
+    uint64_t position;      /* byte offset of packet (its tag) in segment file */
+} RD_seek_entry_t;
+
+#define SEEK_SUFFIX_LEN 6       /* length of ".sidx" including terminating zero */
+
+#endif /* RTP_SEEK_H_ */
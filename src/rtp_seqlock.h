@@ -0,0 +1,57 @@
+/*
+ * rtp_seqlock.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_SEQLOCK_H_
+#define RTP_SEQLOCK_H_
+
+#include <stdint.h>
+
+/**
+ * Sequence counter protecting data with single writer. Writer never waits, readers
+ * copy data and retry when writer modified them meanwhile. Counter is odd while data
+ * are being modified.
+ */
+
+/**
+ * Starts modification of data protected by sequence counter seq. Called by writer only.
+ */
+static inline void rtp_seq_write_begin(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Ends modification of data protected by sequence counter seq. Called by writer only.
+ */
+static inline void rtp_seq_write_end(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Starts reading of data protected by sequence counter seq.
+ * \return Value of counter, that must be passed to rtp_seq_read_retry().
+ */
+static inline uint32_t rtp_seq_read_begin(const uint32_t *seq)
+{
+    uint32_t start;
+    while((start = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+        ;
+    return start;
+}
+
+/**
+ * Returns 1 when data read after rtp_seq_read_begin() were modified meanwhile and
+ * reading must be repeated, 0 otherwise.
+ */
+static inline int rtp_seq_read_retry(const uint32_t *seq, uint32_t start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+#endif /* RTP_SEQLOCK_H_ */
@@ -0,0 +1,217 @@
+/*
+ * rtp_ssrc.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include "rtp_store.h"
+#include "rtp_ssrc.h"
+#include "rtp_seqlock.h"
+#include "rtp.h"
+#include "log.h"
+
+//Constants of validation of sources (RFC 3550, A.1).
+#define MAX_DROPOUT 3000
+#define MAX_MISORDER 100
+#define MIN_SEQUENTIAL 2
+
+//Count of the latest sequence numbers, which duplicates are detected.
+#define WINDOW_SIZE 64
+
+//Clock rates of static payload types (RFC 3551), 0 for dynamic and unassigned types.
+static const uint32_t static_clock_rates[] = {
+    8000, 0, 0, 8000, 8000, 8000, 16000, 8000,              //0-7
+    8000, 8000, 44100, 44100, 8000, 8000, 90000, 8000,      //8-15
+    11025, 22050, 8000, 0, 0, 0, 0, 0,                      //16-23
+    0, 90000, 90000, 0, 90000, 0, 0, 90000,                 //24-31
+    90000, 90000, 90000                                     //32-34
+};
+
+void rtp_ssrc_init(struct rtp_ssrc_table *table, const struct rtp_stream_config *config)
+{
+    memset(table->slots, 0, sizeof(table->slots));
+    table->count = 0;
+    table->last = 0;
+    table->seq = 0;
+    table->overflow = 0;
+    table->video_clock_rate = config->video_clock_rate;
+    table->audio_clock_rate = config->audio_clock_rate;
+}
+
+//Starts counting of sequence numbers of source from seq.
+static inline void init_seq(struct rtp_source *source, uint16_t seq)
+{
+    source->base_seq = seq;
+    source->max_seq = seq;
+    source->bad_seq = RTP_SEQ_MOD + 1;          //so seq == bad_seq is false
+    source->cycles = 0;
+    source->received = 0;
+    source->window = 1;
+}
+
+//Updates sequence number of source (RFC 3550, A.1). Returns 1 when packet is valid,
+//0 when packet is duplicated or source is not valid yet.
+static inline int update_seq(struct rtp_source *source, uint16_t seq)
+{
+    uint16_t udelta = seq - source->max_seq;
+
+    if(source->probation) {                     //packets must be in sequence
+        if(seq == (uint16_t) (source->max_seq + 1)) {
+            source->probation--;
+            source->max_seq = seq;
+            if(source->probation == 0) {
+                init_seq(source, seq);
+                source->received++;
+                return 1;
+            }
+        } else {
+            source->probation = MIN_SEQUENTIAL - 1;
+            source->max_seq = seq;
+        }
+        return 0;
+    }
+
+    if(udelta == 0) {
+        source->duplicates++;
+        return 0;
+    } else if(udelta < MAX_DROPOUT) {           //in order, with permissible gap
+        if(seq < source->max_seq)
+            source->cycles += RTP_SEQ_MOD;
+        source->max_seq = seq;
+        source->window = udelta < WINDOW_SIZE ? (source->window << udelta) | 1 : 1;
+    } else if(udelta <= RTP_SEQ_MOD - MAX_MISORDER) {
+        if(seq != source->bad_seq) {            //the very large jump
+            source->bad_seq = (seq + 1) & (RTP_SEQ_MOD - 1);
+            return 0;
+        }
+        //two sequential packets, source was restarted
+        init_seq(source, seq);
+    } else {                                    //duplicated or reordered packet
+        uint16_t back = source->max_seq - seq;
+        if(back < WINDOW_SIZE) {
+            if(source->window & ((uint64_t) 1 << back)) {
+                source->duplicates++;
+                return 0;
+            }
+            source->window |= (uint64_t) 1 << back;
+        }
+        source->reordered++;
+    }
+
+    source->received++;
+    return 1;
+}
+
+//Returns clock rate of RTP timestamps of payload type.
+static inline uint32_t clock_rate(struct rtp_ssrc_table *table, unsigned int payload_type, int video)
+{
+    if(payload_type < sizeof(static_clock_rates) / sizeof(static_clock_rates[0])
+       && static_clock_rates[payload_type] != 0)
+        return static_clock_rates[payload_type];
+    return video ? table->video_clock_rate : table->audio_clock_rate;
+}
+
+//Returns source with identifier ssrc. When table doesn't contain it, new source is added
+//and validation of its sequence numbers starts from seq. Returns NULL when table is full.
+static inline struct rtp_source *find_source(struct rtp_ssrc_table *table, uint32_t ssrc, uint16_t seq)
+{
+    struct rtp_source *source = &(table->slots[table->last]);
+    if(source->used && source->ssrc == ssrc)
+        return source;
+
+    unsigned int slot = (ssrc * 2654435761U) >> (32 - RTP_SSRC_BITS);
+    unsigned int i;
+    for(i = 0; i < RTP_SSRC_SLOTS; i++, slot = (slot + 1) & (RTP_SSRC_SLOTS - 1)) {
+        source = &(table->slots[slot]);
+        if(!source->used)
+            break;
+        if(source->ssrc == ssrc) {
+            table->last = slot;
+            return source;
+        }
+    }
+    if(i == RTP_SSRC_SLOTS)
+        return NULL;
+
+    memset(source, 0, sizeof(*source));
+    source->ssrc = ssrc;
+    source->used = 1;
+    source->max_seq = seq - 1;
+    source->probation = MIN_SEQUENTIAL;
+    table->count++;
+    table->last = slot;
+    return source;
+}
+
+void rtp_ssrc_update(struct rtp_ssrc_table *table, const char *data, int len, double arrival, int video)
+{
+    const rtp_hdr_t *r = (const rtp_hdr_t *) data;
+    if(len < 12 || r->version != RTP_VERSION)
+        return;
+
+    rtp_seq_write_begin(&(table->seq));
+    uint16_t seqno = ntohs(r->seq);
+    struct rtp_source *source = find_source(table, ntohl(r->ssrc), seqno);
+    if(source == NULL) {
+        if(table->overflow++ == 0)
+            rtp_print_log(RTP_WARN, "Table of sources of stream is full, SSRC=%u is not tracked\n",
+                          ntohl(r->ssrc));
+    } else {
+        if(source->received == 0) {             //clock rate is given by the first payload type
+            source->video = video;
+            source->clock_rate = clock_rate(table, r->pt, video);
+        }
+        source->payload_type = r->pt;
+
+        if(update_seq(source, seqno)) {
+            //interarrival jitter (RFC 3550, A.8), arrival time in timestamp units
+            uint32_t transit = (uint32_t) (uint64_t) (arrival * source->clock_rate) - ntohl(r->ts);
+            if(source->received > 1) {
+                int32_t d = (int32_t) (transit - source->transit);
+                if(d < 0)
+                    d = -d;
+                source->jitter += d - ((source->jitter + 8) >> 4);
+            }
+            source->transit = transit;
+        }
+    }
+
+    rtp_seq_write_end(&(table->seq));
+}
+
+unsigned int rtp_ssrc_stats(const struct rtp_ssrc_table *table, struct rtp_source_stats *stats, unsigned int max)
+{
+    struct rtp_source slots[RTP_SSRC_SLOTS];
+    uint32_t seq;
+    do {
+        seq = rtp_seq_read_begin(&(table->seq));
+        memcpy(slots, table->slots, sizeof(slots));
+    } while(rtp_seq_read_retry(&(table->seq), seq));
+
+    unsigned int count = 0;
+    unsigned int i;
+    for(i = 0; i < RTP_SSRC_SLOTS; i++) {
+        struct rtp_source *source = &slots[i];
+        if(!source->used)
+            continue;
+        if(count < max) {
+            struct rtp_source_stats *s = &stats[count];
+            uint32_t expected = source->probation ? 0 : source->cycles + source->max_seq - source->base_seq + 1;
+            s->ssrc = source->ssrc;
+            s->video = source->video;
+            s->payload_type = source->payload_type;
+            s->valid = source->probation == 0;
+            s->ext_max_seq = source->cycles + source->max_seq;
+            s->received = source->received;
+            s->expected = expected;
+            s->lost = (int32_t) (expected - source->received);
+            s->duplicates = source->duplicates;
+            s->reordered = source->reordered;
+            s->jitter = source->clock_rate ? source->jitter / 16.0 * 1000.0 / source->clock_rate : 0;
+        }
+        count++;
+    }
+    return count;
+}
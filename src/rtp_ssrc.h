@@ -0,0 +1,90 @@
+/*
+ * rtp_ssrc.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_SSRC_H_
+#define RTP_SSRC_H_
+
+#include <stdint.h>
+#include "rtp_store.h"
+
+/**
+ * Module of statistics of RTP sources (SSRC) of stream. Sequence numbers, loss and
+ * interarrival jitter of every source are tracked as described in RFC 3550 (A.1, A.8).
+ *
+ * Sources are stored in open-addressing table of fixed size embedded in stream, so
+ * updating statistics of packet doesn't allocate memory. Table is updated by worker of
+ * stream only (by writer of stream with sharded video, which merges packets into order).
+ * Readers copy it protected by sequence counter, so worker never waits.
+ */
+
+/**
+ * Count of slots of table of sources (power of 2).
+ */
+#define RTP_SSRC_BITS 4
+#define RTP_SSRC_SLOTS (1 << RTP_SSRC_BITS)
+
+/**
+ * Structure that represents state of one RTP source.
+ */
+struct rtp_source {
+	uint32_t ssrc;							/**< synchronization source identifier*/
+	uint8_t used;							/**< 1 if slot is used, 0 otherwise*/
+	uint8_t video;							/**< 1 if source belongs to video session, 0 otherwise*/
+	uint8_t payload_type;					/**< payload type of the last packet*/
+	uint16_t max_seq;						/**< highest sequence number seen*/
+	uint32_t cycles;						/**< shifted count of sequence number cycles*/
+	uint32_t base_seq;						/**< base sequence number*/
+	uint32_t bad_seq;						/**< last 'bad' sequence number + 1*/
+	uint32_t probation;						/**< count of sequential packets till source is valid*/
+	uint32_t received;						/**< count of packets received (duplicates excluded)*/
+	uint32_t duplicates;					/**< count of duplicated packets*/
+	uint32_t reordered;						/**< count of packets received out of order*/
+	uint32_t clock_rate;					/**< clock rate of RTP timestamps in Hz*/
+	uint32_t transit;						/**< relative transit time of the previous packet*/
+	uint32_t jitter;						/**< interarrival jitter in timestamp units multiplied by 16*/
+	uint64_t window;						/**< bit i set when packet with max_seq - i was received*/
+} __attribute__((aligned(64)));
+
+/**
+ * Structure that represents table of sources of stream.
+ */
+struct rtp_ssrc_table {
+	struct rtp_source slots[RTP_SSRC_SLOTS];	/**< open-addressing table of sources*/
+	unsigned int count;						/**< count of used slots*/
+	unsigned int last;						/**< slot of source of the last packet*/
+	uint32_t seq;							/**< sequence counter, odd while table is updated*/
+	uint32_t overflow;						/**< count of packets of sources, that didn't fit into table*/
+	uint32_t video_clock_rate;				/**< clock rate of video with dynamic payload type*/
+	uint32_t audio_clock_rate;				/**< clock rate of audio with dynamic payload type*/
+};
+
+/**
+ * Initializes empty table of sources.
+ * \param table Table that will be initialized.
+ * \param config Options of stream (clock rates of dynamic payload types).
+ */
+void rtp_ssrc_init(struct rtp_ssrc_table *table, const struct rtp_stream_config *config);
+
+/**
+ * Updates statistics of source of received RTP packet. Called by worker of stream only.
+ * \param table Table of sources of stream.
+ * \param data RTP packet (RTP header included).
+ * \param len Length of packet.
+ * \param arrival Arrival time of packet in seconds.
+ * \param video 1 if packet was received by video session, 0 otherwise.
+ */
+void rtp_ssrc_update(struct rtp_ssrc_table *table, const char *data, int len, double arrival, int video);
+
+/**
+ * Copies statistics of sources in table.
+ * \param table Table of sources of stream.
+ * \param stats (out) Array where statistics are copied.
+ * \param max Size of array stats.
+ * \return Count of sources in table (may be greater than max).
+ */
+unsigned int rtp_ssrc_stats(const struct rtp_ssrc_table *table, struct rtp_source_stats *stats, unsigned int max);
+
+#endif /* RTP_SSRC_H_ */
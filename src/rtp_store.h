@@ -24,6 +24,11 @@ typedef enum {
     RTP_ENDED = 4                   /**< stream has ended*/
 } rtp_stream_state_t;
 
+/**
+ * ID of RTP stream. ID of closed stream is never reused for another stream.
+ */
+typedef int64_t rtp_stream_id_t;
+
 /**
  * Sets maximum file size quota to unbounded.
  */
@@ -42,6 +47,24 @@ typedef enum {
     RTP_ALL = INT_MAX       /**<All logs*/                          //pole 1-tiek
 } rtp_log_level_t;
 
+/**
+ * Enumeration that represents format of log messages.
+ */
+typedef enum {
+    RTP_LOG_TEXT = 0,       /**<Message is formatted by caller of logging*/
+    RTP_LOG_DEFERRED = 1,   /**<Message is formatted by logging thread*/
+    RTP_LOG_BINARY = 2      /**<Log file is binary, formatted offline by rtplogdump*/
+} rtp_log_format_t;
+
+/**
+ * Sets format of log messages. Must be called before rtp_store_loginit().
+ * With RTP_LOG_DEFERRED and RTP_LOG_BINARY only format string and values of arguments
+ * are stored by caller, so strings passed to logging must be string literals.
+ * Remote log messages are always text.
+ * \param format Format of log messages (RTP_LOG_TEXT by default).
+ */
+void rtp_store_logformat(rtp_log_format_t format);
+
 /**
  * Initializes logging to file.
  * \param flog - file path of logging output file. "stdout" for standard output and
@@ -54,6 +77,22 @@ typedef enum {
  */
 int rtp_store_loginit(const char *flog, rtp_log_level_t log_levels, unsigned int max_fsize_quota, unsigned int rb_count);
 
+#define RTP_LOG_FLUSH_SIZE_DEFAULT 65536     /**< default flush size of log file in bytes*/
+#define RTP_LOG_FLUSH_TIME_DEFAULT 200       /**< default flush time of log file in miliseconds*/
+#define RTP_LOG_SYNC_OFF 0                   /**< log file is not synced to disk*/
+
+/**
+ * Sets options of logging to file. Must be called before rtp_store_loginit(). Log file
+ * is buffered and flushed, when size of buffered data reaches flush_size or the oldest
+ * buffered data wait for flush_time. Log file is rotated and synced in background.
+ * \param flush_size Flush threshold in bytes.
+ * \param flush_time Flush threshold in miliseconds.
+ * \param sync_interval Interval in miliseconds of fdatasync() of log file,
+ * RTP_LOG_SYNC_OFF (default) for no syncing.
+ * \returns 0 on success, -1 otherwise.
+ */
+int rtp_store_logconfig(unsigned int flush_size, unsigned int flush_time, unsigned int sync_interval);
+
 /**
  * Inits logging to remote location. The log messages are sent by UDP protocol.
  * \param ip IP address of remote destination, where logs should be sent.
@@ -63,6 +102,24 @@ int rtp_store_loginit(const char *flog, rtp_log_level_t log_levels, unsigned int
  */
 int rtp_store_remote_loginit(const char *ip, uint16_t port, rtp_log_level_t levels);
 
+#define RTP_REMOTE_LOG_MTU_DEFAULT 1400      /**< default maximum size of datagram of remote log*/
+#define RTP_REMOTE_LOG_FLUSH_DEFAULT 100    /**< default flush time of remote log in miliseconds*/
+#define RTP_REMOTE_LOG_RATE_DEFAULT 1000    /**< default rate limit of remote log*/
+#define RTP_REMOTE_LOG_RATE_UNBOUNDED 0     /**< remote log without rate limit*/
+
+/**
+ * Sets options of logging to remote location. Must be called before
+ * rtp_store_remote_loginit(). Log lines are gathered into datagrams, every datagram
+ * contains one or more lines terminated by '\n' and is terminated by '\0'.
+ * \param mtu Maximum size of datagram in bytes (256 - 9000). Longer lines are truncated.
+ * \param flush_time Maximum time in miliseconds, that line waits before it is sent.
+ * \param rate Maximum count of lines per second sent for each level of logging,
+ * RTP_REMOTE_LOG_RATE_UNBOUNDED for unbounded. Count of suppressed lines is reported
+ * by next line of the same level.
+ * \returns 0 on success, -1 otherwise.
+ */
+int rtp_store_remote_logconfig(unsigned int mtu, unsigned int flush_time, unsigned int rate);
+
 /**
  * Closes logging to remote destination.
  */
@@ -79,48 +136,362 @@ void rtp_store_logclose(void);
 
  * \returns state of stream on success, (rtp_stream_state_t) -1 otherwise.
  */
-rtp_stream_state_t rtp_get_stream_state(int id);
+rtp_stream_state_t rtp_get_stream_state(rtp_stream_id_t id);
 
 /**
  * Returns speed of downloading.
  * \param id ID of stream.
  * \returns current speed on success, -1 otherwise.
  */
-double rtp_get_stream_download_speed(int id);
+double rtp_get_stream_download_speed(rtp_stream_id_t id);
+
+/**
+ * Structure that represents statistics of one RTP source (SSRC) of stream (RFC 3550).
+ */
+struct rtp_source_stats {
+    uint32_t ssrc;                  /**< synchronization source identifier*/
+    int video;                      /**< 1 if source belongs to video session, 0 otherwise*/
+    unsigned int payload_type;      /**< payload type of the last packet*/
+    int valid;                      /**< 0 while sequence numbers of source are being validated*/
+    uint32_t ext_max_seq;           /**< extended highest sequence number received*/
+    uint32_t received;              /**< count of packets received (duplicates excluded)*/
+    uint32_t expected;              /**< count of packets expected*/
+    int32_t lost;                   /**< cumulative count of packets lost*/
+    uint32_t duplicates;            /**< count of duplicated packets*/
+    uint32_t reordered;             /**< count of packets received out of order*/
+    double jitter;                  /**< interarrival jitter in miliseconds*/
+};
+
+/**
+ * Returns statistics of RTP sources of stream.
+ * \param id ID of stream.
+ * \param sources (out) Array where statistics are stored.
+ * \param max Size of array sources.
+ * \return count of sources of stream (may be greater than max) on success, -1 otherwise.
+ */
+int rtp_get_stream_sources(rtp_stream_id_t id, struct rtp_source_stats *sources, unsigned int max);
 
 /**
  * Returns size of downloaded data.
  * \param id ID of stream.
  * \return size of downloaded data on success, -1 otherwise.
  */
-off64_t rtp_get_stream_dsize(int id);
+off64_t rtp_get_stream_dsize(rtp_stream_id_t id);
+
+/**
+ * Count of worker threads is chosen automatically - one worker per online CPU.
+ */
+#define RTP_WORKERS_DEFAULT 0
+
+/**
+ * Default count of datagrams received from socket by one system call.
+ */
+#define RTP_RECV_BATCH_DEFAULT 32
+
+/**
+ * Default count of writer threads.
+ */
+#define RTP_WRITERS_DEFAULT 1
+
+/**
+ * Default size of queue of received packets of stream in bytes.
+ */
+#define RTP_QUEUE_SIZE_DEFAULT (256 * 1024)
+
+/**
+ * Default size of output buffer of stream in megabytes. With O_DIRECT (see direct_io of
+ * rtp_store_config), output buffer is split into two halves: one is filled while the other
+ * is written by background thread. The last incomplete block of file is written padded by
+ * zeros and rewritten by the next write, padding is cut off when file is closed.
+ */
+#define RTP_OUTPUT_BUFFER_DEFAULT 1
+
+/**
+ * Default maximum time in miliseconds, that data stay in output buffer of stream.
+ */
+#define RTP_FLUSH_INTERVAL_DEFAULT 1000
+
+/**
+ * Default size in bytes of data buffered by streams of writer, which starts group commit
+ * (see group_commit of rtp_store_config). With group commit, writer writes output buffers
+ * of all its streams at once by one submission of io_uring, when the oldest buffered data
+ * are older than latency bound or their size reaches byte bound. Flush interval is not used
+ * then.
+ */
+#define RTP_GROUP_COMMIT_BYTES_DEFAULT (4 * 1024 * 1024)
+
+/**
+ * Enumeration that represents policies applied, when queue of received packets
+ * of stream is full (writer doesn't keep up with receiving).
+ */
+typedef enum {
+    RTP_QUEUE_DROP_NEWEST = 0,      /**< received packet is dropped*/
+    RTP_QUEUE_DROP_OLDEST = 1,      /**< the oldest packets in queue are dropped*/
+    RTP_QUEUE_BLOCK = 2             /**< receiving waits until writer makes space*/
+} rtp_queue_policy_t;
+
+/**
+ * Structure that represents counters of queue of received packets of stream.
+ */
+struct rtp_queue_stats {
+    uint64_t queued;                /**< count of packets put into queue*/
+    uint64_t written;               /**< count of packets taken by writer*/
+    uint64_t dropped;               /**< count of packets dropped because queue was full*/
+    uint64_t blocked;               /**< count of packets, that waited for free space in queue*/
+};
+
+/**
+ * Structure that represents counters of sockets of stream. Datagrams dropped by kernel
+ * (receive buffer of socket was full) are counted by SO_RXQ_OVFL, count is updated when
+ * next datagram is received from socket.
+ */
+struct rtp_socket_stats {
+    uint64_t video_rtp_dropped;     /**< count of datagrams dropped by kernel on video RTP socket*/
+    uint64_t video_rtcp_dropped;    /**< count of datagrams dropped by kernel on video RTCP socket*/
+    uint64_t audio_rtp_dropped;     /**< count of datagrams dropped by kernel on audio RTP socket*/
+    uint64_t audio_rtcp_dropped;    /**< count of datagrams dropped by kernel on audio RTCP socket*/
+    int video_rcvbuf;               /**< size of receive buffer of video sockets in bytes (as reported by kernel)*/
+    int audio_rcvbuf;               /**< size of receive buffer of audio sockets in bytes (as reported by kernel)*/
+};
+
+/**
+ * Returns counters of sockets of stream.
+ * \param id ID of stream.
+ * \param stats (out) Counters of sockets.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_get_stream_socket_stats(rtp_stream_id_t id, struct rtp_socket_stats *stats);
+
+/**
+ * Receive buffers of sockets have size given by system (net.core.rmem_default).
+ */
+#define RTP_RCVBUF_DEFAULT 0
+
+/**
+ * Enumeration that represents sources of arrival time of packets.
+ */
+typedef enum {
+    RTP_TSTAMP_USER = 0,            /**< time is taken by gettimeofday() after packets are received*/
+    RTP_TSTAMP_KERNEL = 1           /**< time is taken by kernel on arrival of packet (SO_TIMESTAMPNS)*/
+} rtp_tstamp_source_t;
+
+/**
+ * Enumeration that represents engines, which workers receive data of streams by.
+ */
+typedef enum {
+    RTP_ENGINE_EPOLL = 0,           /**< sockets are polled by epoll and read by recvmmsg()*/
+    RTP_ENGINE_URING = 1            /**< sockets are read by multishot recvmsg of io_uring into provided buffers*/
+} rtp_engine_t;
+
+/**
+ * Structure that represents configuration of RtpStore.
+ */
+struct rtp_store_config {
+    unsigned int workers;           /**< count of worker threads receiving data of streams*/
+    unsigned int recv_batch;        /**< maximum count of datagrams received from socket by one system call*/
+    int direct_recv;                /**< 1 to receive datagrams (epoll engine) directly into queue of stream, 0 to copy them from buffers of worker*/
+    rtp_tstamp_source_t tstamp;     /**< source of arrival time of packets*/
+    unsigned int writers;           /**< count of writer threads writing data of streams to files*/
+    unsigned int queue_size;        /**< size of queue of received packets of stream in bytes*/
+    rtp_queue_policy_t queue_policy;/**< policy applied, when queue of stream is full*/
+    unsigned int output_buffer;     /**< size of output buffer of stream in megabytes*/
+    unsigned int flush_interval;    /**< maximum time in miliseconds, that data stay in output buffer*/
+    int direct_io;                  /**< 1 to write output files with O_DIRECT (page cache is bypassed), 0 otherwise*/
+    unsigned int group_commit;      /**< latency bound of group commit of writers in miliseconds, 0 to write streams separately*/
+    unsigned int group_commit_bytes;/**< byte bound of group commit of writers*/
+    unsigned int rcvbuf;            /**< size of receive buffer of sockets in bytes, RTP_RCVBUF_DEFAULT for system default*/
+    rtp_engine_t engine;            /**< engine of workers, RTP_ENGINE_EPOLL is used when io_uring is not available*/
+    const char *capture_interface;  /**< interface of packet capture for streams with capture set, NULL for none*/
+};
+
+/**
+ * Fills configuration with default values.
+ * \param config Configuration that will be filled.
+ */
+void rtp_store_config_init(struct rtp_store_config *config);
+
+/**
+ * Returns counters of queue of received packets of stream.
+ * \param id ID of stream.
+ * \param stats (out) Counters of queue.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_get_stream_queue_stats(rtp_stream_id_t id, struct rtp_queue_stats *stats);
+
+/**
+ * Structure that represents statistics of one stream returned by rtp_get_streams_stats().
+ */
+struct rtp_stream_stats {
+    rtp_stream_id_t id;             /**< ID of stream*/
+    rtp_stream_state_t state;       /**< state of stream*/
+    double download_speed;          /**< speed of downloading in kb/s*/
+    off64_t downloaded_data_size;   /**< size of downloaded data in bytes*/
+    struct rtp_queue_stats queue;   /**< counters of queue of received packets*/
+    struct rtp_socket_stats sockets;/**< counters of sockets*/
+    off64_t durable_offset;         /**< position in output file, up to which data were synced to disk*/
+    unsigned int durable_segment;   /**< number of segment file, which durable_offset belongs to*/
+};
+
+/**
+ * Returns statistics of all running streams in one pass. Receiving of streams is not
+ * blocked by this call.
+ * \param stats (out) Array where statistics are stored.
+ * \param max Size of array stats.
+ * \return Count of streams stored in stats on success, -1 otherwise.
+ */
+int rtp_get_streams_stats(struct rtp_stream_stats *stats, unsigned int max);
+
+/**
+ * Initializates RTPStore with default configuration. Callers ignoring returned value keep
+ * working as before, streams are not created when initialization failed.
+ * \returns 0 on success, -1 otherwise.
+ */
+int rtp_store_init(void);
 
 /**
  * Initializates RTPStore.
+ * \param config Configuration of RtpStore. Should be filled by rtp_store_config_init() first.
+ * \returns 0 on success, -1 otherwise.
+ */
+int rtp_store_init_config(const struct rtp_store_config *config);
+
+/**
+ * Structure that represents options of RTP stream.
+ */
+struct rtp_stream_config {
+    off64_t max_fsize_quota;        /**< maximum size of segment file in bytes, MAX_FSIZE_QUOTA_UNBOUNDED for unbounded*/
+    unsigned int max_segment_time;  /**< maximum duration of segment file in seconds, 0 for unbounded*/
+    unsigned int seek_interval;     /**< time in miliseconds between entries of seek index, 0 for none*/
+    unsigned int seek_packets;      /**< count of packets between entries of seek index, 0 for none*/
+    unsigned int video_clock_rate;  /**< clock rate in Hz of video with dynamic payload type (for jitter)*/
+    unsigned int audio_clock_rate;  /**< clock rate in Hz of audio with dynamic payload type (for jitter)*/
+    unsigned int shards;            /**< count of sockets receiving video RTP, each served by different worker*/
+    int capture;                    /**< 1 to receive stream by packet capture (see RTP_MAX_SHARDS), 0 by its sockets*/
+    unsigned int sync_interval;     /**< time in miliseconds between syncs of output file to disk, 0 for none*/
+    unsigned int sync_bytes;        /**< size of data in bytes between syncs of output file to disk, 0 for none*/
+};
+
+/**
+ * Default time in miliseconds between two entries of seek index of recording.
+ */
+#define RTP_SEEK_INTERVAL_DEFAULT 1000
+
+/**
+ * Default clock rates of RTP timestamps of dynamic payload types in Hz.
+ */
+#define RTP_VIDEO_CLOCK_RATE_DEFAULT 90000
+#define RTP_AUDIO_CLOCK_RATE_DEFAULT 8000
+
+/**
+ * Maximum count of sockets receiving video RTP of one stream. When shards of stream is
+ * greater than 1, video RTP port is opened by group of SO_REUSEPORT sockets and packets
+ * are distributed among them by RTP sequence number, so one high-rate session is received
+ * by several workers. Writer merges packets of all sockets by arrival time into one
+ * recording. Statistics of sources of such stream are updated by writer, arrival times
+ * used for jitter have resolution of miliseconds.
+ */
+#define RTP_MAX_SHARDS 8
+
+/*
+ * Stream with capture set is received by one capture thread from AF_PACKET socket with
+ * TPACKET_V3 ring on interface capture_interface of RtpStore. Its sockets are still bound,
+ * so groups are joined, but they drop all datagrams. Such stream has one video RTP socket
+ * and arrival times are taken by kernel. RtpStore must have CAP_NET_RAW capability.
+ */
+
+/*
+ * Durability policy of stream. Data survive power loss only after output file is synced
+ * by fdatasync(). When sync_interval or sync_bytes of stream is set, writer writes output
+ * buffer of stream and hands sync of output file to background thread every sync_interval
+ * miliseconds or whenever sync_bytes of data were stored since the previous sync, so
+ * receiving and writing never wait for disk. Data synced so far are reported by
+ * durable_offset of rtp_stream_stats. Such stream syncs also segment file when it is
+ * completed and its files when it is closed. By default stream is not synced.
+ */
+
+/**
+ * Fills options of stream with default values (one unbounded output file).
+ * \param config Options that will be filled.
  */
-void rtp_store_init(void);
+void rtp_stream_config_init(struct rtp_stream_config *config);
 
 /**
- * Creates new RTP stream.
+ * Creates new RTP stream with default options. Data are stored in one file file_path.
+ * Stream is assigned to one of worker threads.
  * \param ip IP of recipient.
  * \param video_port Port of video session.
  * \param audio_port Port of audio session.
- * \param file_path File name, of index file. Data will be stored in files <file_path>.<integer suffix>.irtp
- * If file doesnt exist, will be created, if
+ * \param file_path File name of output file. If file doesnt exist, will be created, if
  * exists, will be truncated to zero length.
- * *\param max_fsize_quota Maximum permited file size (in bytes), where RTP
- * stream is stored (when reached new file is created). When passed macro
- * MAX_FSIZE_QUOTA_UNBOUNDED, then is file size quota unbounded.
  * \return ID of created RTP stream on success, -1 otherwise.
  */
-int rtp_store_create_stream(char *ip, uint16_t video_port, uint16_t audio_port,
-                            char *file_path);
+rtp_stream_id_t rtp_store_create_stream(char *ip, uint16_t video_port, uint16_t audio_port,
+                                        char *file_path);
+
+/**
+ * Creates new RTP stream. Stream is assigned to one of worker threads.
+ * \param ip IP of recipient.
+ * \param video_port Port of video session.
+ * \param audio_port Port of audio session.
+ * \param file_path File name, of index file. When segment size or duration is bounded,
+ * data will be stored in segment files <file_path>.<integer suffix>.irtp and index file
+ * lists segments with their time ranges. Otherwise data are stored in file file_path.
+ * If file doesnt exist, will be created, if exists, will be truncated to zero length.
+ * \param config Options of stream. When reached max_fsize_quota or max_segment_time,
+ * new segment file is created.
+ * \return ID of created RTP stream on success, -1 otherwise.
+ */
+rtp_stream_id_t rtp_store_create_stream_config(char *ip, uint16_t video_port, uint16_t audio_port,
+                                               char *file_path, const struct rtp_stream_config *config);
+
+/**
+ * Structure that represents entry of seek index of recording.
+ */
+struct rtp_seek_entry {
+    uint32_t offset;                /**< offset of packet in miliseconds since start of recording*/
+    uint32_t segment;               /**< number of segment file <file_path>.<segment>.irtp, 0 if not segmented*/
+    uint64_t position;              /**< byte offset of packet in (segment) file*/
+};
+
+/**
+ * Structure that represents opened seek index.
+ */
+struct rtp_seek_index;
+
+/**
+ * Opens seek index <file_path>.sidx of recording. Index is mapped to memory, entries
+ * written later are not visible.
+ * \param file_path File path of recording given to rtp_store_create_stream().
+ * \return Opened index on success, NULL otherwise.
+ */
+struct rtp_seek_index *rtp_seek_open(const char *file_path);
+
+/**
+ * Finds position of recording, where playing from time offset should start.
+ * \param index Opened seek index.
+ * \param offset Time in miliseconds since start of recording.
+ * \param entry (out) The last entry with offset less or equal to offset (the first
+ * entry, when offset precedes all entries).
+ * \return 0 on success, -1 when index is empty.
+ */
+int rtp_seek_find(const struct rtp_seek_index *index, uint32_t offset, struct rtp_seek_entry *entry);
+
+/**
+ * Returns 1 when recording of index is stored in segment files, 0 otherwise.
+ */
+int rtp_seek_segmented(const struct rtp_seek_index *index);
+
+/**
+ * Closes seek index.
+ * \param index Opened seek index.
+ */
+void rtp_seek_close(struct rtp_seek_index *index);
 
 /**
  * Closes and frees all resources of RTP stream
  * \param id ID of stream, that will be closed.
  */
-int rtp_store_close_stream(int id);
+int rtp_store_close_stream(rtp_stream_id_t id);
 
 /**
  * Closes and frees all resources of RtpStore. All running streams will be closed.
@@ -10,7 +10,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
-#include <signal.h>
 #include <string.h>                     //strerror()
 #include <errno.h>
 #include <sys/time.h>                   //gettimeofday()
@@ -19,6 +18,9 @@
 #include "rtp_stream_thread.h"
 #include "rtp_network.h"
 #include "rtp_foutput.h"
+#include "rtp_worker.h"
+#include "rtp_writer.h"
+#include "rtp_seqlock.h"
 
 //Time of period in seconds. Period is time between two synchronizing events.
 #define MAX_PERIOD_TIME 5
@@ -41,10 +43,40 @@
 struct rtp_stream_info rtp_get_stream_info(struct rtp_stream *stream)
 {
     struct rtp_stream_info stream_inf;
+    uint32_t seq;
+
+    do {                                                        //worker is never blocked by readers
+        seq = rtp_seq_read_begin(&(stream->info_seq));
+        stream_inf = stream->stream_info;
+    } while(rtp_seq_read_retry(&(stream->info_seq), seq));
+
+    do {                                                        //updated by background task
+        seq = rtp_seq_read_begin(&(stream->durable_seq));
+        stream_inf.durable_segment = stream->durable_segment;
+        stream_inf.durable_offset = stream->durable_offset;
+    } while(rtp_seq_read_retry(&(stream->durable_seq), seq));
+
+    unsigned int i;
+    if(stream->writer != NULL) {                                //counters are updated without locking
+        for(i = 0; i < stream->video_session.shards; i++) {
+            struct rtp_ring *ring = i == 0 ? &(stream->ring) : &(stream->shard_rings[i - 1]);
+            stream_inf.queue.queued += __atomic_load_n(&(ring->queued), __ATOMIC_RELAXED);
+            stream_inf.queue.written += __atomic_load_n(&(ring->written), __ATOMIC_RELAXED);
+            stream_inf.queue.dropped += __atomic_load_n(&(ring->dropped), __ATOMIC_RELAXED);
+            stream_inf.queue.blocked += __atomic_load_n(&(ring->blocked), __ATOMIC_RELAXED);
+        }
+    }
 
-    pthread_mutex_lock(&(stream->stream_mutex));                //kriticka sekcia
-    stream_inf = stream->stream_info;
-    pthread_mutex_unlock(&(stream->stream_mutex));              //koniec krit. sekcie
+    struct rtp_endpoint *ep = stream->endpoints;                //updated by worker without locking
+    stream_inf.sockets.audio_rtp_dropped = __atomic_load_n(&(ep[0].dropped), __ATOMIC_RELAXED);
+    stream_inf.sockets.audio_rtcp_dropped = __atomic_load_n(&(ep[1].dropped), __ATOMIC_RELAXED);
+    stream_inf.sockets.video_rtp_dropped = __atomic_load_n(&(ep[2].dropped), __ATOMIC_RELAXED);
+    stream_inf.sockets.video_rtcp_dropped = __atomic_load_n(&(ep[3].dropped), __ATOMIC_RELAXED);
+    for(i = 1; i < stream->video_session.shards; i++)
+        stream_inf.sockets.video_rtp_dropped += __atomic_load_n(&(ep[RTP_STREAM_ENDPOINTS + i - 1].dropped),
+                                                                __ATOMIC_RELAXED);
+    stream_inf.sockets.audio_rcvbuf = stream->audio_session.rcvbuf;
+    stream_inf.sockets.video_rcvbuf = stream->video_session.rcvbuf;
 
     return stream_inf;
 }
@@ -58,20 +90,53 @@ static struct rtp_stream *create_stream(void)
         return NULL;
     }
 
-    stream->output_file = NULL;
+    stream->output_fd = -1;
+    stream->obuf = NULL;
+    stream->obuf_spare = NULL;
+    stream->obuf_len = 0;
+    stream->direct = 0;
+    stream->flush_task.state = RTP_TASK_IDLE;
+    stream->sync_task.state = RTP_TASK_IDLE;
+    stream->pending = NULL;
+    stream->pending_len = 0;
+    stream->pending_size = 0;
+    stream->sync_interval = 0;
+    stream->sync_bytes = 0;
+    stream->durable_seq = 0;
+    stream->durable_segment = 0;
+    stream->durable_offset = 0;
+    stream->index_fd = -1;
+    stream->next_fd = -1;
+    stream->seek_fd = -1;
     stream->file_name = NULL;
 
-    stream->rtp_executor = NULL;
+    stream->worker = NULL;
+    stream->next = NULL;
+    stream->prev = NULL;
+    stream->writer = NULL;
+    stream->wnext = NULL;
+    stream->wprev = NULL;
 
     stream->audio_session.rtp_sockfd = -1;
     stream->audio_session.rtcp_sockfd = -1;
     stream->video_session.rtp_sockfd = -1;
     stream->video_session.rtcp_sockfd = -1;
+    stream->audio_session.rcvbuf = 0;
+    stream->video_session.rcvbuf = 0;
+    stream->audio_session.shards = 1;
+    stream->video_session.shards = 1;
+    memset(stream->endpoints, 0, sizeof(stream->endpoints));
+    memset(stream->shard_workers, 0, sizeof(stream->shard_workers));
+    memset(stream->merge, 0, sizeof(stream->merge));
+    stream->shard_downloaded = 0;
+    stream->capture = 0;
 
     stream->stream_info.download_speed = 0;
     stream->stream_info.downloaded_data_size = 0;
     stream->stream_info.rtp_stream_state = RTP_INITIALIZING;
+    memset(&(stream->stream_info.queue), 0, sizeof(stream->stream_info.queue));
 
+    stream->info_seq = 0;
     stream->first_rtp = -1;
 
     rtp_print_log(RTP_DEBUG, "Rtp stream created\n");
@@ -79,27 +144,31 @@ static struct rtp_stream *create_stream(void)
 }
 
 struct rtp_stream *rtp_stream_init(char *ip, uint16_t rtp_video_port,
-                                    uint16_t rtp_audio_port, char *file_path)
+                                    uint16_t rtp_audio_port, char *file_path,
+                                    const struct rtp_stream_config *config)
 {
     struct rtp_stream *stream = create_stream();
     if(stream == NULL) goto ON_ERROR;
+    rtp_ssrc_init(&(stream->sources), config);
 
+    stream->capture = config->capture;
+    if(config->shards > 1 && !config->capture) {
+        stream->video_session.shards = config->shards < RTP_MAX_SHARDS ? config->shards : RTP_MAX_SHARDS;
+        memset(stream->video_session.shard_sockfd, -1, sizeof(stream->video_session.shard_sockfd));
+    }
     if(rtp_net_connect(ip, rtp_video_port, &(stream->video_session)) == -1)
         goto ON_ERROR;                  //upratanie za sebou
 
     if(rtp_net_connect(ip, rtp_audio_port, &(stream->audio_session)) == -1)
         goto ON_ERROR;      //co ak zbehne prvy rtp_connect a druhy uz nezbehne -> free prvy :)
 
-    if(rtp_create_stream_output(stream, file_path) == -1)
+    if(stream->capture && (rtp_net_mute(&(stream->video_session)) == -1 || rtp_net_mute(&(stream->audio_session)) == -1))
         goto ON_ERROR;
-    rtp_init_stream_output(stream, ip, rtp_video_port);
-    rtp_init_stream_output(stream, ip, rtp_audio_port);
 
-    //inicializacia mutexov.
-    if(pthread_mutex_init(&(stream->stream_mutex), NULL) != 0) {
-        rtp_print_log(RTP_ERROR, "Initializing thread mutex failed:%s\n", strerror(errno));
+    if(rtp_create_stream_output(stream, file_path, config) == -1)
         goto ON_ERROR;
-    }
+    rtp_init_stream_output(stream, ip, rtp_video_port);
+    rtp_init_stream_output(stream, ip, rtp_audio_port);
 
     return stream;
 
@@ -108,122 +177,72 @@ struct rtp_stream *rtp_stream_init(char *ip, uint16_t rtp_video_port,
     return NULL;
 }
 
-//Initializates file descriptors for select(). Returns max. number of fds.
-static inline int init_select(fd_set *readfds, struct rtp_stream *stream)
-{
-    FD_ZERO(readfds);
-    FD_SET(stream->audio_session.rtp_sockfd, readfds);
-    FD_SET(stream->video_session.rtp_sockfd, readfds);
-    FD_SET(stream->audio_session.rtcp_sockfd, readfds);
-    FD_SET(stream->video_session.rtcp_sockfd, readfds);
-
-    int maxfds = -1;
-    if(stream->audio_session.rtp_sockfd > maxfds) maxfds = stream->audio_session.rtp_sockfd;
-    if(stream->video_session.rtp_sockfd > maxfds) maxfds = stream->video_session.rtp_sockfd;
-    if(stream->audio_session.rtcp_sockfd > maxfds) maxfds = stream->audio_session.rtcp_sockfd;
-    if(stream->video_session.rtcp_sockfd > maxfds) maxfds = stream->video_session.rtcp_sockfd;
-
-    return maxfds;
-}
-
-//Reads from selected file descriptors. Returns number of received bytes.
-static inline ssize_t read_from_fds(fd_set *readfds, struct rtp_stream *stream)
-{
-    ssize_t downloaded_size = 0;
-    if(FD_ISSET(stream->audio_session.rtp_sockfd, readfds))
-        downloaded_size += read_from_sock(stream->audio_session.rtp_sockfd, RTP_AUDIO, 0, stream);
-    if(FD_ISSET(stream->audio_session.rtcp_sockfd, readfds))
-        downloaded_size += read_from_sock(stream->audio_session.rtcp_sockfd, RTP_AUDIO, 1, stream);
-    if(FD_ISSET(stream->video_session.rtp_sockfd, readfds))
-        downloaded_size += read_from_sock(stream->video_session.rtp_sockfd, RTP_VIDEO, 0, stream);
-    if(FD_ISSET(stream->video_session.rtcp_sockfd, readfds))
-        downloaded_size += read_from_sock(stream->video_session.rtcp_sockfd, RTP_VIDEO, 1, stream);
-    return downloaded_size;
-}
-
-//Clean-up Handler that will be called on canceling thread.
-static void on_cancel(void *data)
+void rtp_stream_update(struct rtp_stream *stream, ssize_t downloaded_size, struct timeval *now)
 {
-    return;
-}
-
-//Execution handler of stream.
-static void *rtp_stream_handler(void *param)
-{
-    struct rtp_stream *stream = (struct rtp_stream *) param;
-
-    //Start time of last synchronizing part.
-    struct timeval select_timeout = {
-        .tv_sec = MAX_PERIOD_TIME,
-        .tv_usec = 0
-     };
-
-    stream->stream_info.rtp_stream_state = RTP_WAITING;
-
-    ssize_t period_downloaded_size = 0;                     //amount of data downloaded in period in Bytes
-    struct timeval start_time;                              //start time of period
-    gettimeofday(&start_time, NULL);
-    rtp_print_log(RTP_DEBUG, "Starting main loop of stream\n");
-    double speed = 0;                                       //speed in kb/s
-
-    pthread_cleanup_push(on_cancel, NULL);
-
-    while(1) {
-        fd_set readfds;
-        int maxfds = init_select(&readfds, stream);
-        select(maxfds + 1, &readfds, NULL, NULL, &select_timeout);
-        select_timeout.tv_sec = MAX_PERIOD_TIME;                //because select() updates parameter timeout
-
-        ssize_t downloaded_size = read_from_fds(&readfds, stream);
-        period_downloaded_size += downloaded_size;
-
-        struct timeval end_time;                            //end time of period
-        gettimeofday(&end_time, NULL);
-
-        if(end_time.tv_sec - start_time.tv_sec >= MAX_PERIOD_TIME) {
-            speed = SPEED(period_downloaded_size, PERIOD_TIME(start_time, end_time));
-            rtp_print_log(RTP_DEBUG, "Speed=%.1f kb/s, downloaded_size=%zd B\n",
-                          speed, period_downloaded_size);
-            start_time = end_time;                  //inicializing for next period
-            period_downloaded_size = 0;
-        }
-
-        //Synchronization part - synchronizing state of stream
-        pthread_mutex_lock(&(stream->stream_mutex));                    //critical section
-        stream->stream_info.rtp_stream_state = (downloaded_size == 0 ? RTP_WAITING : RTP_RECORDING);
-        stream->stream_info.downloaded_data_size += (off64_t) downloaded_size;
-        stream->stream_info.download_speed = speed;
-        pthread_mutex_unlock(&(stream->stream_mutex));                  //out crit. section
+    if(stream->video_session.shards > 1)                    //data received by other workers
+        downloaded_size += __atomic_exchange_n(&(stream->shard_downloaded), 0, __ATOMIC_RELAXED);
+    if(downloaded_size > 0) {
+        stream->period_downloaded_size += downloaded_size;
+        stream->last_data = *now;
     }
 
-    pthread_cleanup_pop(1);
+    double speed = stream->stream_info.download_speed;      //speed in kb/s
+    if(now->tv_sec - stream->period_start.tv_sec >= MAX_PERIOD_TIME) {
+        speed = SPEED(stream->period_downloaded_size, PERIOD_TIME(stream->period_start, *now));
+        rtp_print_log(RTP_DEBUG, "Speed=%.1f kb/s, downloaded_size=%zd B\n",
+                      speed, stream->period_downloaded_size);
+        stream->period_start = *now;                        //inicializing for next period
+        stream->period_downloaded_size = 0;
+    }
 
-    return NULL;
+    //stream is waiting, when no data were received during whole period
+    int waiting = downloaded_size == 0 && now->tv_sec - stream->last_data.tv_sec >= MAX_PERIOD_TIME;
+
+    rtp_stream_state_t state = stream->stream_info.rtp_stream_state;
+    if(downloaded_size > 0)
+        state = RTP_RECORDING;
+    else if(waiting)
+        state = RTP_WAITING;
+    if(downloaded_size == 0 && state == stream->stream_info.rtp_stream_state
+       && speed == stream->stream_info.download_speed)
+        return;                                             //nothing to publish
+
+    //Synchronization part - publishing state of stream to readers
+    rtp_seq_write_begin(&(stream->info_seq));
+    stream->stream_info.rtp_stream_state = state;
+    stream->stream_info.downloaded_data_size += (off64_t) downloaded_size;
+    stream->stream_info.download_speed = speed;
+    rtp_seq_write_end(&(stream->info_seq));
 }
 
 //Runs stream given as parameter.
 int rtp_stream_run(struct rtp_stream *stream)
 {
     if(stream == NULL) goto ON_ERROR;
-    if(stream->rtp_executor != NULL) goto ON_ERROR;
+    if(stream->worker != NULL) goto ON_ERROR;
+
+    struct rtp_endpoint *ep = stream->endpoints;
+    ep[0] = (struct rtp_endpoint) {stream->audio_session.rtp_sockfd, 0, 0, RTP_AUDIO, stream};
+    ep[1] = (struct rtp_endpoint) {stream->audio_session.rtcp_sockfd, 1, 0, RTP_AUDIO, stream};
+    ep[2] = (struct rtp_endpoint) {stream->video_session.rtp_sockfd, 0, 0, RTP_VIDEO, stream};
+    ep[3] = (struct rtp_endpoint) {stream->video_session.rtcp_sockfd, 1, 0, RTP_VIDEO, stream};
+    unsigned int i;
+    for(i = 1; i < stream->video_session.shards; i++)
+        ep[RTP_STREAM_ENDPOINTS + i - 1] = (struct rtp_endpoint) {stream->video_session.shard_sockfd[i - 1], 0, i,
+                                                                  RTP_VIDEO, stream};
+
+    gettimeofday(&(stream->period_start), NULL);
+    stream->last_data = stream->period_start;
+    stream->period_downloaded_size = 0;
+    rtp_seq_write_begin(&(stream->info_seq));
+    stream->stream_info.rtp_stream_state = RTP_WAITING;
+    rtp_seq_write_end(&(stream->info_seq));
 
-    stream->rtp_executor = (pthread_t *) malloc(sizeof(pthread_t));
-    if(stream->rtp_executor == NULL) {
-        rtp_print_log(RTP_ERROR, "Rtp executor malloc failed\n");
+    if(rtp_writer_add_stream(stream) == -1)
+        goto ON_ERROR;
+    if(rtp_worker_add_stream(stream) == -1)
         goto ON_ERROR;
-    }
-
-    int res = -1;                                       //rozlisovat chybove cisla
-    pthread_attr_t thread_attr;
-    res = pthread_attr_init(&thread_attr);
-    if(res != 0) goto ON_ERROR;
-    res = pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
-    if(res != 0) goto ON_ERROR;
-
-    res = pthread_create(stream->rtp_executor, &thread_attr, rtp_stream_handler, (void *) stream);
-    if(res != 0) goto ON_ERROR;
 
-    pthread_attr_destroy(&thread_attr);
     return 0;
 
     ON_ERROR:
@@ -235,16 +254,15 @@ int rtp_stream_run(struct rtp_stream *stream)
 void rtp_stream_close(struct rtp_stream *stream)
 {
     if(stream == NULL) return;
-    if(stream->rtp_executor != NULL) {
-        pthread_cancel(*(stream->rtp_executor));
-        void *foo = NULL;
-        if(pthread_join(*(stream->rtp_executor), &foo) == -1 && errno == EDEADLK)
-            pthread_kill(*(stream->rtp_executor), SIGKILL);     //killing thread in deadlock
+    if(stream->worker != NULL) {
+        rtp_worker_remove_stream(stream);
+        rtp_seq_write_begin(&(stream->info_seq));
         stream->stream_info.rtp_stream_state = RTP_ENDED;
-        pthread_mutex_destroy(&(stream->stream_mutex));
-        free(stream->rtp_executor);
+        rtp_seq_write_end(&(stream->info_seq));
         rtp_print_log(RTP_DEBUG, "Stream canceled\n");
     }
+    if(stream->writer != NULL)
+        rtp_writer_remove_stream(stream);           //after worker, so no packets are put into ring
     rtp_net_close(&(stream->video_session));
     rtp_net_close(&stream->audio_session);
 
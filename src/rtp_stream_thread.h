@@ -12,7 +12,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include "rtp_store.h"
+#include "rtp_ring.h"
+#include "rtp_task.h"
+#include "rtp_ssrc.h"
 
 
 /**
@@ -29,6 +33,68 @@ typedef enum {
 struct rtp_session {
 	int rtp_sockfd;						/**< File descriptor of RTP socket*/
 	int rtcp_sockfd;					/**< File descriptor of RTCP socket*/
+	int rcvbuf;							/**< size of receive buffer of sockets reported by kernel*/
+	unsigned int shards;				/**< count of RTP sockets (SO_REUSEPORT group), 1 for one socket*/
+	int shard_sockfd[RTP_MAX_SHARDS - 1];	/**< File descriptors of additional RTP sockets of group*/
+	uint32_t addr;						/**< address, which sockets are bound to (network order)*/
+	uint16_t port;						/**< RTP port*/
+};
+
+/**
+ * Count of sockets of stream (RTP and RTCP socket of audio and video session).
+ */
+#define RTP_STREAM_ENDPOINTS 4
+
+/**
+ * Maximum length of rtpdump headers (of audio and video session) of output file.
+ */
+#define RTP_SEGMENT_HDR_LEN 512
+
+/**
+ * Count of entries of seek index buffered before they are written to file.
+ */
+#define RTP_SEEK_BUF_ENTRIES 64
+
+struct rtp_stream;
+struct rtp_worker;
+struct rtp_writer;
+
+/**
+ * Structure that represents one socket of stream registered in epoll set of worker.
+ */
+struct rtp_endpoint {
+	int sockfd;								/**< File descriptor of socket*/
+	int is_rtcp;							/**< 1 if socket receives RTCP, 0 otherwise*/
+	unsigned int shard;						/**< number of socket in SO_REUSEPORT group, 0 for the first one*/
+	rtp_session_type_t session_type;		/**< type of session that socket belongs to*/
+	struct rtp_stream *stream;				/**< stream that socket belongs to*/
+	uint32_t ovfl;							/**< the last value of SO_RXQ_OVFL counter of socket*/
+	uint64_t dropped;						/**< count of datagrams dropped by kernel, updated by worker*/
+	uint32_t slot_len;						/**< size of data of slot, which datagram is received into directly in ring, 0 for default*/
+	int armed;								/**< 1 while multishot receive of socket is submitted (io_uring)*/
+	int cancel;								/**< 1 when receiving from socket should be stopped (io_uring)*/
+	int queued;								/**< 1 while socket is in commands of worker (io_uring)*/
+	struct rtp_endpoint *cmd_next;			/**< next socket in commands of worker (io_uring)*/
+};
+
+/**
+ * Structure that represents records claimed by writer from one ring of sharded stream,
+ * which are merged with records of other rings.
+ */
+struct rtp_merge_cursor {
+	char *data;								/**< claimed records*/
+	uint32_t len;							/**< size of claimed records in bytes*/
+	uint32_t pos;							/**< position of the first record not written yet*/
+	uint32_t records;						/**< count of claimed records*/
+};
+
+/**
+ * Structure that represents completed segment file of stream waiting for sync.
+ */
+struct rtp_pending_sync {
+	int fd;									/**< duplicate of descriptor of segment file*/
+	unsigned int segment;					/**< number of segment file*/
+	off64_t target;							/**< size of segment file*/
 };
 
 /**
@@ -38,6 +104,10 @@ struct rtp_stream_info {
 	off64_t downloaded_data_size;				/**< size of downloaded data in bytes*/
 	double download_speed;						/**< speed of downloading in kb/s*/
 	rtp_stream_state_t rtp_stream_state;		/**< state of RTP stream*/
+	struct rtp_queue_stats queue;				/**< counters of queue of received packets*/
+	struct rtp_socket_stats sockets;			/**< counters of sockets*/
+	off64_t durable_offset;						/**< position in output file, up to which data were synced to disk*/
+	unsigned int durable_segment;				/**< number of segment file, which durable_offset belongs to*/
 };
 
 /**
@@ -48,12 +118,79 @@ struct rtp_stream {
 	struct rtp_session audio_session;		/**< audio session*/
 
 	char *file_name;						/**< output file name.*/
-	FILE *output_file;						/**< output file, where data will be stored*/
+	int output_fd;							/**< output file, where data will be stored*/
+	char *obuf;								/**< output buffer, aligned to pages*/
+	size_t obuf_len;						/**< size of data in output buffer*/
+	uint64_t obuf_since;					/**< time (rtp_clock_ms()) when output buffer stopped being empty*/
+	off64_t output_offset;					/**< size of data written to output file*/
+	int direct;								/**< 1 if output file is written with O_DIRECT, 0 otherwise*/
+	size_t obuf_flushed;					/**< size of data at start of output buffer already written to file (O_DIRECT)*/
+	char *obuf_spare;						/**< staging buffer written by flush_task (O_DIRECT)*/
+	size_t flush_len;						/**< size of data written by flush_task, padded to whole blocks*/
+	off64_t flush_offset;					/**< position in output file, where flush_task writes*/
+	struct rtp_task flush_task;				/**< background task writing staging buffer (O_DIRECT)*/
+
+	uint32_t sync_interval;					/**< time in miliseconds between syncs of output file, 0 for none*/
+	uint32_t sync_bytes;					/**< size of data between syncs of output file, 0 for none*/
+	uint64_t sync_last;						/**< time (rtp_clock_ms()) of the last sync*/
+	off64_t sync_offset;					/**< position in output file, up to which the last sync was submitted*/
+	int sync_fd;							/**< duplicate of descriptor of output file synced by sync_task*/
+	unsigned int sync_segment;				/**< number of segment file synced by sync_task*/
+	off64_t sync_target;					/**< position in output file, up to which sync_task syncs*/
+	struct rtp_task sync_task;				/**< background task syncing output file to disk*/
+	struct rtp_pending_sync *pending;		/**< completed segment files waiting for sync, the oldest first*/
+	unsigned int pending_len;				/**< count of segment files waiting for sync*/
+	unsigned int pending_size;				/**< capacity of pending*/
+	uint32_t durable_seq;					/**< sequence counter protecting durable position, updated by sync_task*/
+	unsigned int durable_segment;			/**< number of segment file synced to disk*/
+	off64_t durable_offset;					/**< position in durable_segment, up to which data were synced to disk*/
+
+	off64_t max_fsize_quota;				/**< maximum size of segment file, MAX_FSIZE_QUOTA_UNBOUNDED for unbounded*/
+	uint32_t max_segment_time;				/**< maximum duration of segment file in miliseconds, 0 for unbounded*/
+	int index_fd;							/**< index file listing segment files, -1 if data are not segmented*/
+	unsigned int segment_no;				/**< number of current segment file*/
+	off64_t segment_size;					/**< size of current segment file (buffered data included)*/
+	uint32_t segment_first;					/**< offset of the first packet in segment in miliseconds*/
+	uint32_t segment_last;					/**< offset of the last packet in segment in miliseconds*/
+	uint32_t segment_records;				/**< count of packets in segment*/
+	int next_fd;							/**< next segment file opened in advance, -1 if not opened*/
+	struct rtp_task segment_task;			/**< background task opening next segment file*/
+	char segment_hdr[RTP_SEGMENT_HDR_LEN];	/**< rtpdump headers written at start of every segment file*/
+	size_t segment_hdr_len;					/**< length of rtpdump headers*/
 
-	pthread_t *rtp_executor;				/**< thread that handles stream*/
-	pthread_mutex_t stream_mutex;			/**< locking mutex to access stream_info*/
+	int seek_fd;							/**< seek index file, -1 if seek index is not written*/
+	uint32_t seek_interval;					/**< time in miliseconds between entries of seek index, 0 for none*/
+	uint32_t seek_packets;					/**< count of packets between entries of seek index, 0 for none*/
+	uint32_t seek_last;						/**< offset of the last entry of seek index in miliseconds*/
+	uint32_t seek_count;					/**< count of packets since the last entry of seek index*/
+	struct rtp_seek_entry seek_buf[RTP_SEEK_BUF_ENTRIES];	/**< entries of seek index not written yet*/
+	unsigned int seek_len;					/**< count of entries in seek_buf*/
+	struct rtp_seek_entry flush_seek[RTP_SEEK_BUF_ENTRIES];	/**< entries of seek index written by flush_task*/
+	unsigned int flush_seek_len;			/**< count of entries in flush_seek*/
+
+	struct rtp_worker *worker;				/**< worker that handles stream, NULL if stream is not running*/
+	struct rtp_stream *next;				/**< next stream in list of streams of worker*/
+	struct rtp_stream *prev;				/**< previous stream in list of streams of worker*/
+	struct rtp_endpoint endpoints[RTP_STREAM_ENDPOINTS + RTP_MAX_SHARDS - 1];	/**< sockets registered in workers*/
+	struct rtp_worker *shard_workers[RTP_MAX_SHARDS - 1];	/**< workers of additional RTP sockets of video session*/
+	uint64_t shard_downloaded;				/**< data received by additional sockets not counted yet, added by their workers*/
+	int capture;							/**< 1 when stream is received by packet capture*/
+
+	struct rtp_writer *writer;				/**< writer that writes stream to file, NULL if stream is not running*/
+	struct rtp_stream *wnext;				/**< next stream in list of streams of writer*/
+	struct rtp_stream *wprev;				/**< previous stream in list of streams of writer*/
+	struct rtp_ring ring;					/**< queue of received packets between worker and writer*/
+	struct rtp_ring shard_rings[RTP_MAX_SHARDS - 1];		/**< queues of packets of additional RTP sockets*/
+	struct rtp_merge_cursor merge[RTP_MAX_SHARDS];		/**< records of rings being merged by writer*/
+
+	uint32_t info_seq;						/**< sequence counter protecting stream_info (see rtp_seqlock.h)*/
 	struct rtp_stream_info stream_info;		/**< informations about stream*/
 	double first_rtp;						/**< time of the first rtp packet, if first rtp packet was not received, has value -1*/
+	struct rtp_ssrc_table sources;			/**< statistics of RTP sources of stream, updated by worker*/
+
+	struct timeval period_start;			/**< start time of current period of speed measurement*/
+	struct timeval last_data;				/**< time when data were received last time*/
+	ssize_t period_downloaded_size;			/**< amount of data downloaded in current period in bytes*/
 };
 
 /**
@@ -70,20 +207,30 @@ struct rtp_stream_info rtp_get_stream_info(struct rtp_stream *stream);
  * \param rtp_audio_port Port of RTP audio session. Must be odd.
  * \param output Path to output file. If file doesnt exist, will be created, if
  * exists, will be truncated to zero length.
- * *\param max_fsize_quota Maximum permited file size, where RTP stream is stored
- * (when reached new file is created)
+ * \param config Options of stream (maximum size and duration of segment file).
  * \return Pointer to structure rtp_stream that represents stream.
  */
 struct rtp_stream *rtp_stream_init(char *ip, uint16_t rtp_video_port,
-								   uint16_t rtp_audio_port, char *output);
+								   uint16_t rtp_audio_port, char *output,
+								   const struct rtp_stream_config *config);
 
 /**
- * Creates and runs new thread of RTP stream.
+ * Runs RTP stream. Stream is assigned to one of workers, which will receive its data.
+ * On failure, stream is closed.
  * \param stream Stream which will be run.
  * \return 0 on success, -1 otherwise.
  */
 int rtp_stream_run(struct rtp_stream *stream);
 
+/**
+ * Updates statistics of stream. Called by worker after data were read from stream
+ * and periodically on idle stream.
+ * \param stream Stream which statistics will be updated.
+ * \param downloaded_size Size of data downloaded since last update in bytes.
+ * \param now Current time.
+ */
+void rtp_stream_update(struct rtp_stream *stream, ssize_t downloaded_size, struct timeval *now);
+
 
 /**
  * Closes rtp_stream.
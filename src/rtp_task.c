@@ -0,0 +1,157 @@
+/*
+ * rtp_task.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+#define _THREAD_SAFE        //additional objects for thread environment
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "rtp_store.h"
+#include "log.h"
+#include "rtp_task.h"
+
+//Queues of tasks, each served by its own background thread.
+enum {
+    QUEUE_FILES = 0,                        //opening and writing files
+    QUEUE_SYNC = 1,                         //syncing files to disk
+    QUEUE_COUNT = 2
+};
+
+//Structure that represents queue of tasks served by background thread.
+struct task_queue {
+    pthread_t thread;                       //background thread
+    struct rtp_task *head;                  //the first task in queue
+    struct rtp_task *tail;                  //the last task in queue
+    pthread_cond_t cond;                    //signals new task in queue
+};
+
+static struct task_queue *queues = NULL;    //queues of background threads, NULL if not running
+static int running = 0;                     //1 while background threads should run
+static pthread_mutex_t task_mutex = PTHREAD_MUTEX_INITIALIZER;  //locking mutex to access queues
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;     //signals done task
+
+//Execution handler of background thread.
+static void *rtp_task_handler(void *param)
+{
+    struct task_queue *queue = (struct task_queue *) param;
+    pthread_mutex_lock(&task_mutex);
+    while(1) {
+        while(queue->head == NULL && running)
+            pthread_cond_wait(&(queue->cond), &task_mutex);
+        if(queue->head == NULL)
+            break;
+
+        struct rtp_task *task = queue->head;
+        queue->head = task->next;
+        if(queue->head == NULL)
+            queue->tail = NULL;
+        task->state = RTP_TASK_RUNNING;
+        pthread_mutex_unlock(&task_mutex);
+
+        task->run(task);
+
+        pthread_mutex_lock(&task_mutex);
+        __atomic_store_n(&(task->state), RTP_TASK_IDLE, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&done_cond);
+    }
+    pthread_mutex_unlock(&task_mutex);
+
+    return NULL;
+}
+
+//Stops background threads of the first count queues and frees queues.
+static void stop_queues(unsigned int count)
+{
+    unsigned int i;
+    pthread_mutex_lock(&task_mutex);
+    running = 0;
+    for(i = 0; i < count; i++)
+        pthread_cond_signal(&(queues[i].cond));
+    pthread_mutex_unlock(&task_mutex);
+
+    for(i = 0; i < count; i++)
+        pthread_join(queues[i].thread, NULL);
+    for(i = 0; i < QUEUE_COUNT; i++)
+        pthread_cond_destroy(&(queues[i].cond));
+    free(queues);
+    queues = NULL;
+}
+
+int rtp_task_init(void)
+{
+    if(queues != NULL) {
+        rtp_print_log(RTP_ERROR, "Background threads are already running\n");
+        return -1;
+    }
+
+    queues = (struct task_queue *) malloc(QUEUE_COUNT * sizeof(struct task_queue));
+    if(queues == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of background threads failed\n");
+        return -1;
+    }
+
+    unsigned int i;
+    for(i = 0; i < QUEUE_COUNT; i++) {
+        queues[i].head = NULL;
+        queues[i].tail = NULL;
+        pthread_cond_init(&(queues[i].cond), NULL);
+    }
+    running = 1;
+    for(i = 0; i < QUEUE_COUNT; i++) {
+        if(pthread_create(&(queues[i].thread), NULL, rtp_task_handler, &(queues[i])) != 0) {
+            rtp_print_log(RTP_ERROR, "Creating background thread failed\n");
+            stop_queues(i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void rtp_task_close(void)
+{
+    if(queues == NULL)
+        return;
+    stop_queues(QUEUE_COUNT);
+}
+
+//Submits task to queue of background thread, task is run by calling thread when background
+//threads are not running.
+static void submit(struct rtp_task *task, unsigned int queue_no)
+{
+    pthread_mutex_lock(&task_mutex);
+    if(!running) {
+        pthread_mutex_unlock(&task_mutex);
+        task->run(task);
+        return;
+    }
+
+    struct task_queue *queue = &(queues[queue_no]);
+    task->next = NULL;
+    task->state = RTP_TASK_QUEUED;
+    if(queue->tail != NULL)
+        queue->tail->next = task;
+    else
+        queue->head = task;
+    queue->tail = task;
+    pthread_cond_signal(&(queue->cond));
+    pthread_mutex_unlock(&task_mutex);
+}
+
+void rtp_task_submit(struct rtp_task *task)
+{
+    submit(task, QUEUE_FILES);
+}
+
+void rtp_task_submit_sync(struct rtp_task *task)
+{
+    submit(task, QUEUE_SYNC);
+}
+
+void rtp_task_wait(struct rtp_task *task)
+{
+    pthread_mutex_lock(&task_mutex);
+    while(task->state != RTP_TASK_IDLE)
+        pthread_cond_wait(&done_cond, &task_mutex);
+    pthread_mutex_unlock(&task_mutex);
+}
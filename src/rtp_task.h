@@ -0,0 +1,82 @@
+/*
+ * rtp_task.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_TASK_H_
+#define RTP_TASK_H_
+
+#include <stddef.h>
+
+/**
+ * Module of background tasks. Slow file system operations (opening and preallocating
+ * files) are run by background thread, so writers are not stalled by them. Syncing of
+ * files to disk is run by another background thread, so long fdatasync() doesn't delay
+ * other tasks.
+ */
+
+/**
+ * Enumeration that represents states of task.
+ */
+typedef enum {
+	RTP_TASK_IDLE = 0,					/**< task is not submitted or it is done*/
+	RTP_TASK_QUEUED = 1,				/**< task waits in queue*/
+	RTP_TASK_RUNNING = 2				/**< task is run by background thread*/
+} rtp_task_state_t;
+
+/**
+ * Structure that represents background task. It is embedded in structure, that task
+ * works with, so submitting task doesn't allocate memory.
+ */
+struct rtp_task {
+	void (*run)(struct rtp_task *task);	/**< function run by background thread*/
+	struct rtp_task *next;				/**< next task in queue*/
+	rtp_task_state_t state;				/**< state of task*/
+};
+
+/**
+ * Returns pointer to structure of type type, that contains member member pointed by ptr.
+ */
+#define rtp_container_of(ptr, type, member) ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+/**
+ * Creates and runs background threads.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_task_init(void);
+
+/**
+ * Runs all queued tasks and stops background threads.
+ */
+void rtp_task_close(void);
+
+/**
+ * Submits task to background thread. When background thread is not running, task is run
+ * by calling thread. Task must not be queued or running.
+ * \param task Task that will be run.
+ */
+void rtp_task_submit(struct rtp_task *task);
+
+/**
+ * Submits task syncing files to disk to background thread of syncs. When background thread
+ * is not running, task is run by calling thread. Task must not be queued or running.
+ * \param task Task that will be run.
+ */
+void rtp_task_submit_sync(struct rtp_task *task);
+
+/**
+ * Returns 1 when task is done (it is not queued or running), 0 otherwise.
+ */
+static inline int rtp_task_done(struct rtp_task *task)
+{
+	return __atomic_load_n(&(task->state), __ATOMIC_ACQUIRE) == RTP_TASK_IDLE;
+}
+
+/**
+ * Waits until task is done.
+ * \param task Task to wait for.
+ */
+void rtp_task_wait(struct rtp_task *task);
+
+#endif /* RTP_TASK_H_ */
@@ -0,0 +1,308 @@
+/*
+ * rtp_uring.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>                       //POLLIN
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "rtp_store.h"
+#include "rtp_uring.h"
+#include "log.h"
+
+//Count of entries of completion queue per entry of submission queue. Every multishot
+//request posts many completions.
+#define CQ_FACTOR 16
+
+//Group of buffer ring.
+#define BUF_GROUP 0
+
+//Maximum count of retries of io_uring_enter() failed temporarily while waiting for completions.
+#define ENTER_RETRIES 8
+
+//Time in microseconds between retries of io_uring_enter(), multiplied by count of retries.
+#define ENTER_RETRY_TIME 100
+
+static inline int sys_uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int sys_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                                  unsigned int flags, void *arg, size_t argsz)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static inline int sys_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+//Maps rings of io_uring. Returns 0 on success, -1 otherwise.
+static int map_rings(struct rtp_uring *uring, struct io_uring_params *p)
+{
+    size_t cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    uring->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+    if(cq_ring_size > uring->sq_ring_size)                      //IORING_FEAT_SINGLE_MMAP
+        uring->sq_ring_size = cq_ring_size;
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          uring->fd, IORING_OFF_SQ_RING);
+    if(uring->sq_ring == MAP_FAILED) {
+        uring->sq_ring = NULL;
+        return -1;
+    }
+    uring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = (struct io_uring_sqe *) mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if(uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        return -1;
+    }
+
+    char *sq = (char *) uring->sq_ring;
+    char *cq = sq;                                              //rings share one mapping
+    uring->sq_entries = p->sq_entries;
+    uring->sq_head = (unsigned int *) (sq + p->sq_off.head);
+    uring->sq_tail = (unsigned int *) (sq + p->sq_off.tail);
+    uring->sq_array = (unsigned int *) (sq + p->sq_off.array);
+    uring->cq_mask = *(unsigned int *) (cq + p->cq_off.ring_mask);
+    uring->cq_head = (unsigned int *) (cq + p->cq_off.head);
+    uring->cq_tail = (unsigned int *) (cq + p->cq_off.tail);
+    uring->cqes = (struct io_uring_cqe *) (cq + p->cq_off.cqes);
+    return 0;
+}
+
+//Allocates buffers and registers buffer ring. Returns 0 on success, -1 otherwise.
+static int setup_buffers(struct rtp_uring *uring, unsigned int buf_size)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    uring->buf_size = (RTP_URING_DATA_OFFSET + buf_size + 63) & ~63U;
+    if(posix_memalign((void **) &(uring->br), page, RTP_URING_BUFS * sizeof(struct io_uring_buf)) != 0) {
+        uring->br = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    uring->bufs = (char *) malloc((size_t) RTP_URING_BUFS * uring->buf_size);
+    if(uring->bufs == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(uring->br, 0, RTP_URING_BUFS * sizeof(struct io_uring_buf));
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) uring->br;
+    reg.ring_entries = RTP_URING_BUFS;
+    reg.bgid = BUF_GROUP;
+    if(sys_uring_register(uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -1;
+
+    unsigned int i;
+    for(i = 0; i < RTP_URING_BUFS; i++) {
+        struct io_uring_buf *buf = &(uring->br->bufs[i]);
+        buf->addr = (uint64_t) (uintptr_t) (uring->bufs + (size_t) i * uring->buf_size);
+        buf->len = uring->buf_size;
+        buf->bid = i;
+    }
+    __atomic_store_n(&(uring->br->tail), (uint16_t) RTP_URING_BUFS, __ATOMIC_RELEASE);
+
+    memset(&(uring->msg), 0, sizeof(uring->msg));               //no address, fixed space for control
+    uring->msg.msg_controllen = RTP_URING_CTRL_LEN;
+    return 0;
+}
+
+int rtp_uring_init(struct rtp_uring *uring, unsigned int entries, unsigned int buf_size)
+{
+    memset(uring, 0, sizeof(*uring));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_R_DISABLED | IORING_SETUP_SINGLE_ISSUER
+              | IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = entries * CQ_FACTOR;
+
+    uring->fd = sys_uring_setup(entries, &p);
+    if(uring->fd < 0)
+        return -1;
+    if(!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)
+       || !(p.features & IORING_FEAT_NODROP)) {
+        errno = EOPNOTSUPP;
+        goto ON_ERROR;
+    }
+
+    if(map_rings(uring, &p) == -1 || (buf_size > 0 && setup_buffers(uring, buf_size) == -1))
+        goto ON_ERROR;
+    return 0;
+
+    ON_ERROR:;
+    int err = errno;
+    rtp_uring_free(uring);
+    errno = err;
+    return -1;
+}
+
+void rtp_uring_free(struct rtp_uring *uring)
+{
+    if(uring->sqes != NULL)
+        munmap(uring->sqes, uring->sqes_size);
+    if(uring->sq_ring != NULL)
+        munmap(uring->sq_ring, uring->sq_ring_size);
+    if(uring->fd >= 0)
+        close(uring->fd);                                       //buffers are not used by kernel anymore
+    free(uring->bufs);
+    free(uring->br);
+    uring->sqes = NULL;
+    uring->sq_ring = NULL;
+    uring->bufs = NULL;
+    uring->br = NULL;
+    uring->fd = -1;
+}
+
+int rtp_uring_enable(struct rtp_uring *uring)
+{
+    if(sys_uring_register(uring->fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) < 0) {
+        rtp_print_log(RTP_ERROR, "Enabling io_uring failed:%s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//Submits queued requests and waits for min_complete completions. Returns 0 on success
+//(or elapsed timeout), -1 otherwise.
+static int submit(struct rtp_uring *uring, unsigned int min_complete, unsigned int flags,
+                  void *arg, size_t argsz)
+{
+    unsigned int pending = *(uring->sq_tail) - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    if(sys_uring_enter(uring->fd, pending, min_complete, flags, arg, argsz) >= 0)
+        return 0;
+    return errno == ETIME ? 0 : -1;
+}
+
+//Returns 1 when io_uring_enter() failed temporarily with error err (interrupted, completion
+//queue is overflowed and completions must be reaped first, or kernel lacks resources).
+static inline int transient(int err)
+{
+    return err == EINTR || err == EBUSY || err == EAGAIN;
+}
+
+//Returns free entry of submission queue, NULL when queue is full even after submitting.
+static struct io_uring_sqe *get_sqe(struct rtp_uring *uring)
+{
+    unsigned int tail = *(uring->sq_tail);
+    if(tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->sq_entries) {
+        if(submit(uring, 0, 0, NULL, 0) == -1 && !transient(errno))
+            rtp_print_log(RTP_WARN, "Submitting io_uring requests failed:%s\n", strerror(errno));
+        if(tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->sq_entries)
+            return NULL;
+    }
+
+    unsigned int index = tail & (uring->sq_entries - 1);
+    struct io_uring_sqe *sqe = &(uring->sqes[index]);
+    memset(sqe, 0, sizeof(*sqe));
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+int rtp_uring_recv(struct rtp_uring *uring, int sockfd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(uring);
+    if(sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sockfd;
+    sqe->addr = (uint64_t) (uintptr_t) &(uring->msg);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int rtp_uring_poll(struct rtp_uring *uring, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(uring);
+    if(sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int rtp_uring_cancel(struct rtp_uring *uring, uint64_t target, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(uring);
+    if(sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int rtp_uring_write(struct rtp_uring *uring, int fd, const void *buf, unsigned int len, uint64_t offset,
+                    uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(uring);
+    if(sqe == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int rtp_uring_complete(struct rtp_uring *uring, unsigned int count)
+{
+    unsigned int retries = 0;
+    while(1) {
+        unsigned int ready = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE) - *(uring->cq_head);
+        unsigned int queued = *(uring->sq_tail) - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+        if(ready >= count && queued == 0)
+            return 0;
+        if(submit(uring, ready >= count ? 0 : count - ready, IORING_ENTER_GETEVENTS, NULL, 0) == 0) {
+            retries = 0;
+            continue;
+        }
+        if(!transient(errno) || ++retries > ENTER_RETRIES) {
+            rtp_print_log(RTP_ERROR, "io_uring_enter() failed:%s\n", strerror(errno));
+            return -1;
+        }
+        usleep(retries * ENTER_RETRY_TIME);
+    }
+}
+
+int rtp_uring_wait(struct rtp_uring *uring, int timeout)
+{
+    struct __kernel_timespec ts = {
+        .tv_sec = timeout / 1000,
+        .tv_nsec = (timeout % 1000) * 1000000L
+    };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t) (uintptr_t) &ts;
+
+    unsigned int min_complete = rtp_uring_peek(uring) == NULL ? 1 : 0;
+    //after temporary failure, caller reaps completions and waits again
+    if(submit(uring, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) == -1
+       && !transient(errno)) {
+        rtp_print_log(RTP_ERROR, "io_uring_enter() failed:%s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
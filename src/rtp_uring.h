@@ -0,0 +1,190 @@
+/*
+ * rtp_uring.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_URING_H_
+#define RTP_URING_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+/**
+ * Module of io_uring used by workers with engine RTP_ENGINE_URING. Ring is driven by raw
+ * system calls. Sockets are read by multishot recvmsg into buffers of buffer ring provided
+ * to kernel, so one submission receives datagrams until it is cancelled and one
+ * io_uring_enter() both submits requests and reaps completions of many datagrams.
+ * Writers with group commit use io_uring without buffer ring to write output buffers of
+ * many files by one io_uring_enter().
+ *
+ * Buffer filled by kernel starts with struct io_uring_recvmsg_out followed by control
+ * messages (RTP_URING_CTRL_LEN bytes) and data of datagram.
+ */
+
+/**
+ * Count of buffers of buffer ring of one io_uring (power of 2).
+ */
+#define RTP_URING_BUFS 256
+
+/**
+ * Size of space for control messages of datagram in buffer.
+ */
+#define RTP_URING_CTRL_LEN 64
+
+/**
+ * Offset of data of datagram in buffer.
+ */
+#define RTP_URING_DATA_OFFSET (sizeof(struct io_uring_recvmsg_out) + RTP_URING_CTRL_LEN)
+
+/**
+ * Structure that represents io_uring with one buffer ring.
+ */
+struct rtp_uring {
+	int fd;									/**< file descriptor of io_uring*/
+	unsigned int sq_entries;				/**< count of entries of submission queue*/
+	unsigned int *sq_head;					/**< head of submission queue, moved by kernel*/
+	unsigned int *sq_tail;					/**< tail of submission queue*/
+	unsigned int *sq_array;					/**< indexes of submitted entries*/
+	struct io_uring_sqe *sqes;				/**< entries of submission queue*/
+	unsigned int cq_mask;					/**< mask of index of completion queue*/
+	unsigned int *cq_head;					/**< head of completion queue*/
+	unsigned int *cq_tail;					/**< tail of completion queue, moved by kernel*/
+	struct io_uring_cqe *cqes;				/**< entries of completion queue*/
+	void *sq_ring;							/**< mapped submission and completion queue rings*/
+	size_t sq_ring_size;					/**< size of mapped rings*/
+	size_t sqes_size;						/**< size of mapped entries of submission queue*/
+
+	struct io_uring_buf_ring *br;			/**< buffer ring provided to kernel*/
+	char *bufs;								/**< memory of buffers*/
+	unsigned int buf_size;					/**< size of one buffer*/
+	struct msghdr msg;						/**< template of received message (size of control messages)*/
+};
+
+/**
+ * Creates io_uring with buffer ring. Ring is created disabled, so it can be created by
+ * other thread than the one, that submits requests.
+ * \param uring Io_uring that will be initialized.
+ * \param entries Count of entries of submission queue.
+ * \param buf_size Maximum size of data of datagram, 0 for io_uring without buffer ring.
+ * \return 0 on success, -1 otherwise (errno is set).
+ */
+int rtp_uring_init(struct rtp_uring *uring, unsigned int entries, unsigned int buf_size);
+
+/**
+ * Frees io_uring and its buffers.
+ * \param uring Io_uring that will be freed.
+ */
+void rtp_uring_free(struct rtp_uring *uring);
+
+/**
+ * Enables io_uring. Must be called by thread, that will submit requests.
+ * \param uring Io_uring that will be enabled.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_uring_enable(struct rtp_uring *uring);
+
+/**
+ * Queues multishot recvmsg of socket into buffers of buffer ring.
+ * \param uring Io_uring.
+ * \param sockfd Socket that will be read.
+ * \param user_data Value passed in all completions of request.
+ * \return 0 on success, -1 when submission queue is full.
+ */
+int rtp_uring_recv(struct rtp_uring *uring, int sockfd, uint64_t user_data);
+
+/**
+ * Queues multishot poll of readability of file descriptor.
+ * \param uring Io_uring.
+ * \param fd File descriptor that will be polled.
+ * \param user_data Value passed in all completions of request.
+ * \return 0 on success, -1 when submission queue is full.
+ */
+int rtp_uring_poll(struct rtp_uring *uring, int fd, uint64_t user_data);
+
+/**
+ * Queues cancellation of request.
+ * \param uring Io_uring.
+ * \param target User data of request that will be cancelled.
+ * \param user_data Value passed in completion of cancellation.
+ * \return 0 on success, -1 when submission queue is full.
+ */
+int rtp_uring_cancel(struct rtp_uring *uring, uint64_t target, uint64_t user_data);
+
+/**
+ * Queues write of data to file at position offset.
+ * \param uring Io_uring.
+ * \param fd File that will be written.
+ * \param buf Data, they must not be changed until write is completed.
+ * \param len Size of data.
+ * \param offset Position in file.
+ * \param user_data Value passed in completion of request.
+ * \return 0 on success, -1 when submission queue is full.
+ */
+int rtp_uring_write(struct rtp_uring *uring, int fd, const void *buf, unsigned int len, uint64_t offset,
+                    uint64_t user_data);
+
+/**
+ * Submits queued requests and waits until count completions are not reaped. Temporary
+ * failures of io_uring_enter() are retried a bounded number of times.
+ * \param uring Io_uring.
+ * \param count Count of completions waited for.
+ * \return 0 on success, -1 otherwise (also when kernel keeps refusing requests).
+ */
+int rtp_uring_complete(struct rtp_uring *uring, unsigned int count);
+
+/**
+ * Submits queued requests and waits for at least one completion or timeout.
+ * \param uring Io_uring.
+ * \param timeout Maximum time of waiting in miliseconds.
+ * \return 0 on success (also when timeout elapsed), -1 otherwise.
+ */
+int rtp_uring_wait(struct rtp_uring *uring, int timeout);
+
+/**
+ * Returns the oldest completion not reaped yet, NULL when completion queue is empty.
+ */
+static inline struct io_uring_cqe *rtp_uring_peek(struct rtp_uring *uring)
+{
+    unsigned int head = *(uring->cq_head);
+    if(head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &(uring->cqes[head & uring->cq_mask]);
+}
+
+/**
+ * Marks the oldest completion as reaped.
+ */
+static inline void rtp_uring_seen(struct rtp_uring *uring)
+{
+    __atomic_store_n(uring->cq_head, *(uring->cq_head) + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns buffer filled by kernel for completion cqe, NULL if completion has no buffer.
+ */
+static inline char *rtp_uring_buffer(struct rtp_uring *uring, const struct io_uring_cqe *cqe)
+{
+    if(!(cqe->flags & IORING_CQE_F_BUFFER))
+        return NULL;
+    return uring->bufs + (size_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT) * uring->buf_size;
+}
+
+/**
+ * Gives buffer of completion cqe back to kernel.
+ */
+static inline void rtp_uring_recycle(struct rtp_uring *uring, const struct io_uring_cqe *cqe)
+{
+    if(!(cqe->flags & IORING_CQE_F_BUFFER))
+        return;
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    uint16_t tail = uring->br->tail;
+    struct io_uring_buf *buf = &(uring->br->bufs[tail & (RTP_URING_BUFS - 1)]);
+    buf->addr = (uint64_t) (uintptr_t) (uring->bufs + (size_t) bid * uring->buf_size);
+    buf->len = uring->buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&(uring->br->tail), (uint16_t) (tail + 1), __ATOMIC_RELEASE);
+}
+
+#endif /* RTP_URING_H_ */
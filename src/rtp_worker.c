@@ -0,0 +1,709 @@
+/*
+ * rtp_worker.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+#define _THREAD_SAFE        //additional objects for thread environment
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <string.h>                     //strerror()
+#include <errno.h>
+#include <sys/time.h>                   //gettimeofday()
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "rtp_store.h"
+#include "log.h"
+#include "rtp_stream_thread.h"
+#include "rtp_network.h"
+#include "rtp_worker.h"
+#include "rtp_writer.h"
+
+//Maximum count of events returned by one epoll_wait()
+#define MAX_EVENTS 64
+
+//Time in miliseconds between two updates of idle streams.
+#define TICK_TIME 1000
+
+//Count of entries of submission queue of io_uring.
+#define URING_ENTRIES 256
+
+//User data of completions of io_uring, which don't belong to endpoint.
+#define URING_WAKE 0                            //poll of wake up event
+#define URING_CANCEL 1                          //cancellation of receiving
+
+static struct rtp_worker *workers = NULL;   //pool of workers
+static unsigned int nworkers = 0;           //count of workers in pool
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;  //locking mutex to assign streams
+static struct rtp_worker *capture_worker = NULL;                //worker of streams received by capture
+
+//Updates statistics of all streams served by worker.
+static inline void tick_streams(struct rtp_worker *worker, struct timeval *now)
+{
+    struct rtp_stream *stream;
+    for(stream = worker->streams; stream != NULL; stream = stream->next)
+        rtp_stream_update(stream, 0, now);
+    if(worker->capture != NULL) {
+        unsigned int drops = rtp_capture_drops(worker->capture);
+        if(drops > 0)
+            rtp_print_log(RTP_WARN, "Capture dropped %u datagrams, ring was full\n", drops);
+    }
+}
+
+//Accounts size bytes received by worker from socket of endpoint.
+static inline void account_received(struct rtp_endpoint *ep, ssize_t size, struct timeval *now)
+{
+    if(ep->shard == 0)
+        rtp_stream_update(ep->stream, size, now);
+    else                                                                //stream belongs to other worker
+        __atomic_fetch_add(&(ep->stream->shard_downloaded), size, __ATOMIC_RELAXED);
+}
+
+//Accounts size bytes received from socket of endpoint in batch and wakes up its writer.
+static inline void account_batch(struct rtp_endpoint *ep, ssize_t size, struct timeval *now)
+{
+    account_received(ep, size, now);
+    rtp_writer_notify(ep->stream->writer);
+}
+
+//Handles all datagrams in ring of capture of worker.
+static void handle_capture(struct rtp_worker *worker, struct timeval *now)
+{
+    struct rtp_endpoint *last = NULL;                                   //accounting is deferred per socket
+    ssize_t received = 0;
+    struct rtp_capture_packet packet;
+
+    while(rtp_capture_next(worker->capture, &packet)) {
+        if(packet.ep != last && last != NULL) {
+            account_batch(last, received, now);
+            received = 0;
+        }
+        last = packet.ep;
+        received += read_from_capture(packet.ep, packet.data, packet.len, &(packet.tstamp));
+    }
+    if(last != NULL)
+        account_batch(last, received, now);
+}
+
+//Execution handler of worker.
+static void *rtp_worker_handler(void *param)
+{
+    struct rtp_worker *worker = (struct rtp_worker *) param;
+    struct epoll_event events[MAX_EVENTS];
+
+    struct timeval last_tick;                           //time of last update of idle streams
+    gettimeofday(&last_tick, NULL);
+    rtp_print_log(RTP_DEBUG, "Starting main loop of worker\n");
+
+    while(worker->running) {
+        int nevents = epoll_wait(worker->epollfd, events, MAX_EVENTS, TICK_TIME);
+        if(nevents == -1 && errno != EINTR) {
+            rtp_print_log(RTP_ERROR, "epoll_wait() failed:%s\n", strerror(errno));
+            break;
+        }
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        pthread_mutex_lock(&(worker->worker_mutex));                    //critical section
+        int i;
+        for(i = 0; i < nevents; i++) {
+            struct rtp_endpoint *ep = (struct rtp_endpoint *) events[i].data.ptr;
+            if(ep == NULL) {                                            //wake up by wait_round() or worker_close()
+                uint64_t foo;
+                if(read(worker->wakefd, &foo, sizeof(foo)) == -1)
+                    rtp_print_log(RTP_WARN, "Reading wake up event failed:%s\n", strerror(errno));
+                continue;
+            }
+            if(events[i].data.ptr == (void *) worker->capture) {
+                handle_capture(worker, &now);
+                continue;
+            }
+            account_received(ep, read_from_sock(ep, &(worker->batch)), &now);
+        }
+
+        if((now.tv_sec - last_tick.tv_sec) * 1000 + (now.tv_usec - last_tick.tv_usec) / 1000 >= TICK_TIME) {
+            tick_streams(worker, &now);
+            last_tick = now;
+        }
+        worker->epoch++;                                                //events of this round are handled
+        pthread_cond_broadcast(&(worker->epoch_cond));
+        pthread_mutex_unlock(&(worker->worker_mutex));                  //out crit. section
+    }
+
+    pthread_mutex_lock(&(worker->worker_mutex));                        //nobody waits for next round
+    worker->running = 0;
+    pthread_cond_broadcast(&(worker->epoch_cond));
+    pthread_mutex_unlock(&(worker->worker_mutex));
+    return NULL;
+}
+
+//Queues command of endpoint for worker (start or stop receiving). Called with worker_mutex held.
+static inline void queue_command(struct rtp_worker *worker, struct rtp_endpoint *ep)
+{
+    if(ep->queued)
+        return;
+    ep->queued = 1;
+    ep->cmd_next = worker->uring_cmds;
+    worker->uring_cmds = ep;
+}
+
+//Submits commands queued for worker. Returns 1 when cancellation was submitted.
+static int run_commands(struct rtp_worker *worker)
+{
+    int cancelled = 0;
+    while(worker->uring_cmds != NULL) {
+        struct rtp_endpoint *ep = worker->uring_cmds;
+        int ret;
+        if(ep->cancel)
+            ret = rtp_uring_cancel(worker->uring, (uint64_t) (uintptr_t) ep, URING_CANCEL);
+        else
+            ret = rtp_uring_recv(worker->uring, ep->sockfd, (uint64_t) (uintptr_t) ep);
+        if(ret == -1)                                                   //queue is full, next round
+            break;
+        if(ep->cancel)
+            cancelled = 1;
+        else
+            ep->armed = 1;
+        worker->uring_cmds = ep->cmd_next;
+        ep->queued = 0;
+    }
+    return cancelled;
+}
+
+//Handles all completions of io_uring of worker. Returns 1 when receiving from some socket
+//was stopped on request.
+static int handle_completions(struct rtp_worker *worker, struct timeval *now)
+{
+    struct rtp_uring *uring = worker->uring;
+    struct rtp_endpoint *last = NULL;                                   //accounting is deferred per socket
+    ssize_t received = 0;
+    int stopped = 0;
+    struct io_uring_cqe *cqe;
+
+    while((cqe = rtp_uring_peek(uring)) != NULL) {
+        if(cqe->user_data == URING_WAKE) {
+            uint64_t foo;
+            if(read(worker->wakefd, &foo, sizeof(foo)) == -1 && errno != EAGAIN)
+                rtp_print_log(RTP_WARN, "Reading wake up event failed:%s\n", strerror(errno));
+            if(!(cqe->flags & IORING_CQE_F_MORE) && rtp_uring_poll(uring, worker->wakefd, URING_WAKE) == -1)
+                rtp_print_log(RTP_WARN, "Polling wake up event failed\n");
+            rtp_uring_seen(uring);
+            continue;
+        }
+        if(cqe->user_data == URING_CANCEL) {
+            rtp_uring_seen(uring);
+            continue;
+        }
+
+        struct rtp_endpoint *ep = (struct rtp_endpoint *) (uintptr_t) cqe->user_data;
+        char *buf = rtp_uring_buffer(uring, cqe);
+        if(cqe->res > 0 && buf != NULL) {
+            if(ep != last && last != NULL) {
+                account_batch(last, received, now);
+                received = 0;
+            }
+            last = ep;
+            received += read_from_uring(ep, buf, (unsigned int) cqe->res, now);
+        }
+        else if(cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+            rtp_print_log(RTP_WARN, "Receiving from socket(FD=%d) failed:%s\n", ep->sockfd, strerror(-cqe->res));
+        }
+        rtp_uring_recycle(uring, cqe);
+
+        if(!(cqe->flags & IORING_CQE_F_MORE)) {                         //receiving of socket stopped
+            ep->armed = 0;
+            if(ep->cancel)
+                stopped = 1;
+            else                                                        //e.g. all buffers were used
+                queue_command(worker, ep);
+        }
+        rtp_uring_seen(uring);
+    }
+
+    if(last != NULL)
+        account_batch(last, received, now);
+    return stopped;
+}
+
+//Execution handler of worker with engine RTP_ENGINE_URING.
+static void *rtp_worker_uring_handler(void *param)
+{
+    struct rtp_worker *worker = (struct rtp_worker *) param;
+    if(rtp_uring_enable(worker->uring) == -1 || rtp_uring_poll(worker->uring, worker->wakefd, URING_WAKE) == -1) {
+        rtp_print_log(RTP_ERROR, "Starting io_uring of worker failed\n");
+        return NULL;
+    }
+
+    struct timeval last_tick;                           //time of last update of idle streams
+    gettimeofday(&last_tick, NULL);
+    rtp_print_log(RTP_DEBUG, "Starting io_uring loop of worker\n");
+
+    while(worker->running) {
+        if(rtp_uring_wait(worker->uring, TICK_TIME) == -1)
+            break;
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        pthread_mutex_lock(&(worker->worker_mutex));                    //critical section
+        int signal = handle_completions(worker, &now);
+        signal |= run_commands(worker);
+        if((now.tv_sec - last_tick.tv_sec) * 1000 + (now.tv_usec - last_tick.tv_usec) / 1000 >= TICK_TIME) {
+            tick_streams(worker, &now);
+            last_tick = now;
+        }
+        if(signal)
+            pthread_cond_broadcast(&(worker->uring_cond));
+        pthread_mutex_unlock(&(worker->worker_mutex));                  //out crit. section
+    }
+
+    return NULL;
+}
+
+//Creates io_uring of worker. Worker uses epoll when io_uring is not available.
+static void worker_uring_init(struct rtp_worker *worker, const struct rtp_store_config *config)
+{
+    worker->uring = NULL;
+    if(config->engine != RTP_ENGINE_URING)
+        return;
+
+    struct rtp_uring *uring = (struct rtp_uring *) malloc(sizeof(struct rtp_uring));
+    if(uring == NULL) {
+        rtp_print_log(RTP_WARN, "Malloc of io_uring failed, epoll is used\n");
+        return;
+    }
+    if(rtp_uring_init(uring, URING_ENTRIES, sizeof(((RD_buffer_t *) NULL)->p.data)) == -1) {
+        rtp_print_log(RTP_WARN, "io_uring is not available (%s), epoll is used\n", strerror(errno));
+        free(uring);
+        return;
+    }
+    if(pthread_cond_init(&(worker->uring_cond), NULL) != 0) {
+        rtp_print_log(RTP_WARN, "Initializing condition of worker failed, epoll is used\n");
+        rtp_uring_free(uring);
+        free(uring);
+        return;
+    }
+    worker->uring = uring;
+}
+
+//Frees io_uring of worker.
+static void worker_uring_free(struct rtp_worker *worker)
+{
+    if(worker->uring == NULL)
+        return;
+    pthread_cond_destroy(&(worker->uring_cond));
+    rtp_uring_free(worker->uring);
+    free(worker->uring);
+    worker->uring = NULL;
+}
+
+//Wakes up worker.
+static inline void wake_worker(struct rtp_worker *worker)
+{
+    uint64_t one = 1;
+    if(write(worker->wakefd, &one, sizeof(one)) == -1)
+        rtp_print_log(RTP_WARN, "Waking up worker failed:%s\n", strerror(errno));
+}
+
+//Starts receiving from socket of endpoint by worker. Returns 0 on success, -1 otherwise.
+static int watch_endpoint(struct rtp_worker *worker, struct rtp_endpoint *ep)
+{
+    if(worker->capture != NULL) {                                       //datagrams are matched by address
+        struct rtp_session *session = ep->session_type == RTP_VIDEO ? &(ep->stream->video_session)
+                                                                    : &(ep->stream->audio_session);
+        pthread_mutex_lock(&(worker->worker_mutex));
+        int ret = rtp_capture_add(worker->capture, session->addr, session->port + ep->is_rtcp, ep);
+        pthread_mutex_unlock(&(worker->worker_mutex));
+        return ret;
+    }
+    if(worker->uring != NULL) {                                         //receive is submitted by worker
+        pthread_mutex_lock(&(worker->worker_mutex));
+        ep->cancel = 0;
+        queue_command(worker, ep);
+        pthread_mutex_unlock(&(worker->worker_mutex));
+        wake_worker(worker);
+        return 0;
+    }
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = (void *) ep
+    };
+    if(epoll_ctl(worker->epollfd, EPOLL_CTL_ADD, ep->sockfd, &event) == -1) {
+        rtp_print_log(RTP_ERROR, "Registering socket(FD=%d) in worker failed:%s\n", ep->sockfd, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//Waits until worker finishes its current round of handling events, so events returned by
+//epoll_wait() before sockets were removed from epoll set are handled.
+static void wait_round(struct rtp_worker *worker)
+{
+    pthread_mutex_lock(&(worker->worker_mutex));
+    uint64_t epoch = worker->epoch;
+    pthread_mutex_unlock(&(worker->worker_mutex));
+    wake_worker(worker);
+
+    pthread_mutex_lock(&(worker->worker_mutex));
+    while(worker->epoch == epoch && worker->running)
+        pthread_cond_wait(&(worker->epoch_cond), &(worker->worker_mutex));
+    pthread_mutex_unlock(&(worker->worker_mutex));
+}
+
+//Stops receiving from sockets of count endpoints eps by worker. Function returns after
+//worker handled pending events of sockets, with io_uring after it reaped the last completion
+//of every socket.
+static void unwatch_endpoints(struct rtp_worker *worker, struct rtp_endpoint *eps, unsigned int count)
+{
+    unsigned int i;
+    if(worker->capture != NULL) {
+        pthread_mutex_lock(&(worker->worker_mutex));
+        for(i = 0; i < count; i++)
+            rtp_capture_remove(worker->capture, &eps[i]);
+        pthread_mutex_unlock(&(worker->worker_mutex));
+        return;
+    }
+    if(worker->uring == NULL) {
+        for(i = 0; i < count; i++)                  //socket, that was not registered, is ignored
+            epoll_ctl(worker->epollfd, EPOLL_CTL_DEL, eps[i].sockfd, NULL);
+        wait_round(worker);
+        return;
+    }
+
+    pthread_mutex_lock(&(worker->worker_mutex));
+    for(i = 0; i < count; i++) {
+        eps[i].cancel = 1;
+        queue_command(worker, &eps[i]);
+    }
+    pthread_mutex_unlock(&(worker->worker_mutex));
+    wake_worker(worker);
+
+    pthread_mutex_lock(&(worker->worker_mutex));
+    for(i = 0; i < count; i++) {
+        while(eps[i].armed || eps[i].queued)
+            pthread_cond_wait(&(worker->uring_cond), &(worker->worker_mutex));
+    }
+    pthread_mutex_unlock(&(worker->worker_mutex));
+}
+
+//Initializes worker and runs its thread. Capture worker gets its capture, other NULL.
+static int worker_init(struct rtp_worker *worker, const struct rtp_store_config *config,
+                       struct rtp_capture *capture)
+{
+    worker->capture = capture;
+    worker->streams = NULL;
+    worker->nstreams = 0;
+    worker->nshards = 0;
+    worker->running = 1;
+    worker->epoch = 0;
+    worker->wakefd = -1;
+    worker->uring_cmds = NULL;
+
+    if(rtp_recv_batch_init(&(worker->batch), config->recv_batch) == -1)
+        return -1;
+    worker_uring_init(worker, config);
+
+    worker->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if(worker->epollfd == -1) {
+        rtp_print_log(RTP_ERROR, "epoll_create1() failed:%s\n", strerror(errno));
+        worker_uring_free(worker);
+        rtp_recv_batch_free(&(worker->batch));
+        return -1;
+    }
+
+    worker->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(worker->wakefd == -1) {
+        rtp_print_log(RTP_ERROR, "eventfd() failed:%s\n", strerror(errno));
+        goto ON_ERROR;
+    }
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = NULL
+    };
+    if(epoll_ctl(worker->epollfd, EPOLL_CTL_ADD, worker->wakefd, &event) == -1) {
+        rtp_print_log(RTP_ERROR, "Registering wake up event failed:%s\n", strerror(errno));
+        goto ON_ERROR;
+    }
+
+    if(capture != NULL) {
+        event.data.ptr = (void *) capture;
+        if(epoll_ctl(worker->epollfd, EPOLL_CTL_ADD, capture->fd, &event) == -1) {
+            rtp_print_log(RTP_ERROR, "Registering capture in worker failed:%s\n", strerror(errno));
+            goto ON_ERROR;
+        }
+    }
+
+    if(pthread_mutex_init(&(worker->worker_mutex), NULL) != 0) {
+        rtp_print_log(RTP_ERROR, "Initializing worker mutex failed\n");
+        goto ON_ERROR;
+    }
+    if(pthread_cond_init(&(worker->epoch_cond), NULL) != 0) {
+        rtp_print_log(RTP_ERROR, "Initializing condition of worker failed\n");
+        pthread_mutex_destroy(&(worker->worker_mutex));
+        goto ON_ERROR;
+    }
+
+    void *(*handler)(void *) = worker->uring != NULL ? rtp_worker_uring_handler : rtp_worker_handler;
+    if(pthread_create(&(worker->thread), NULL, handler, (void *) worker) != 0) {
+        rtp_print_log(RTP_ERROR, "Creating worker thread failed\n");
+        pthread_cond_destroy(&(worker->epoch_cond));
+        pthread_mutex_destroy(&(worker->worker_mutex));
+        goto ON_ERROR;
+    }
+
+    return 0;
+
+    ON_ERROR:
+    if(worker->wakefd != -1)
+        close(worker->wakefd);
+    close(worker->epollfd);
+    worker_uring_free(worker);
+    rtp_recv_batch_free(&(worker->batch));
+    return -1;
+}
+
+//Stops thread of worker and frees its resources.
+static void worker_close(struct rtp_worker *worker)
+{
+    worker->running = 0;
+    wake_worker(worker);
+    pthread_join(worker->thread, NULL);
+
+    pthread_cond_destroy(&(worker->epoch_cond));
+    pthread_mutex_destroy(&(worker->worker_mutex));
+    close(worker->wakefd);
+    close(worker->epollfd);
+    worker_uring_free(worker);
+    rtp_recv_batch_free(&(worker->batch));
+}
+
+//Creates capture worker, which receives streams by packet capture on interface of config.
+static int capture_init(const struct rtp_store_config *config)
+{
+    struct rtp_store_config epoll_config = *config;         //ring of capture is polled by epoll
+    epoll_config.engine = RTP_ENGINE_EPOLL;
+
+    struct rtp_capture *capture = (struct rtp_capture *) malloc(sizeof(struct rtp_capture));
+    struct rtp_worker *worker = (struct rtp_worker *) malloc(sizeof(struct rtp_worker));
+    if(capture == NULL || worker == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of capture worker failed\n");
+        goto ON_ERROR;
+    }
+    //whole block is handled at once, half of queue of stream leaves space for writer
+    if(rtp_capture_init(capture, config->capture_interface, config->queue_size / 2) == -1)
+        goto ON_ERROR;
+    if(worker_init(worker, &epoll_config, capture) == -1) {
+        rtp_capture_free(capture);
+        goto ON_ERROR;
+    }
+
+    capture_worker = worker;
+    rtp_print_log(RTP_DEBUG, "Capture worker on interface %s initialized\n", config->capture_interface);
+    return 0;
+
+    ON_ERROR:
+    free(capture);
+    free(worker);
+    return -1;
+}
+
+int rtp_worker_pool_init(const struct rtp_store_config *config)
+{
+    unsigned int count = config->workers;
+    if(workers != NULL) {
+        rtp_print_log(RTP_ERROR, "Worker pool is already initialized\n");
+        return -1;
+    }
+
+    if(count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (unsigned int) cpus : 1;
+    }
+
+    workers = (struct rtp_worker *) malloc(count * sizeof(struct rtp_worker));
+    if(workers == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of worker pool failed\n");
+        return -1;
+    }
+
+    for(nworkers = 0; nworkers < count; nworkers++) {
+        if(worker_init(&workers[nworkers], config, NULL) == -1) {
+            rtp_worker_pool_close();
+            return -1;
+        }
+    }
+
+    if(config->capture_interface != NULL && capture_init(config) == -1) {
+        rtp_worker_pool_close();
+        return -1;
+    }
+
+    rtp_print_log(RTP_DEBUG, "Worker pool with %u workers initialized\n", nworkers);
+    return 0;
+}
+
+void rtp_worker_pool_close(void)
+{
+    unsigned int i;
+    for(i = 0; i < nworkers; i++)
+        worker_close(&workers[i]);
+    if(capture_worker != NULL) {
+        worker_close(capture_worker);
+        rtp_capture_free(capture_worker->capture);
+        free(capture_worker->capture);
+        free(capture_worker);
+        capture_worker = NULL;
+    }
+
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+}
+
+//Returns 1 when worker already serves socket of stream, that is assigned to worker before
+//additional RTP socket number shard.
+static inline int serves_stream(struct rtp_worker *worker, struct rtp_stream *stream, unsigned int shard)
+{
+    unsigned int i;
+    if(worker == stream->worker)
+        return 1;
+    for(i = 1; i < shard; i++) {
+        if(worker == stream->shard_workers[i - 1])
+            return 1;
+    }
+    return 0;
+}
+
+//Assigns additional RTP socket number shard of stream to the least loaded worker, which
+//doesn't serve other socket of stream, if there is such worker.
+static int add_shard(struct rtp_stream *stream, unsigned int shard)
+{
+    pthread_mutex_lock(&pool_mutex);
+    struct rtp_worker *worker = NULL;
+    unsigned int best = 0;
+    unsigned int i;
+    for(i = 0; i < nworkers; i++) {
+        unsigned int load = workers[i].nstreams + workers[i].nshards;
+        if(serves_stream(&workers[i], stream, shard))
+            load += UINT_MAX / 2;                           //other workers are preferred
+        if(worker == NULL || load < best) {
+            worker = &workers[i];
+            best = load;
+        }
+    }
+    worker->nshards++;
+    stream->shard_workers[shard - 1] = worker;
+    pthread_mutex_unlock(&pool_mutex);
+
+    if(watch_endpoint(worker, &(stream->endpoints[RTP_STREAM_ENDPOINTS + shard - 1])) == -1)
+        return -1;
+
+    rtp_print_log(RTP_DEBUG, "Socket %u of stream assigned to worker %ld\n", shard, (long) (worker - workers));
+    return 0;
+}
+
+//Unregisters additional RTP sockets of sharded stream from their workers.
+static void remove_shards(struct rtp_stream *stream)
+{
+    unsigned int i;
+    for(i = 1; i < stream->video_session.shards; i++) {
+        struct rtp_worker *worker = stream->shard_workers[i - 1];
+        if(worker == NULL)
+            continue;
+        unwatch_endpoints(worker, &(stream->endpoints[RTP_STREAM_ENDPOINTS + i - 1]), 1);
+
+        pthread_mutex_lock(&pool_mutex);
+        pthread_mutex_lock(&(worker->worker_mutex));            //pending events were handled by unwatch_endpoints()
+        worker->nshards--;
+        pthread_mutex_unlock(&(worker->worker_mutex));
+        pthread_mutex_unlock(&pool_mutex);
+        stream->shard_workers[i - 1] = NULL;
+    }
+}
+
+int rtp_worker_add_stream(struct rtp_stream *stream)
+{
+    pthread_mutex_lock(&pool_mutex);
+    if(workers == NULL) {
+        pthread_mutex_unlock(&pool_mutex);
+        rtp_print_log(RTP_ERROR, "Worker pool is not initialized\n");
+        return -1;
+    }
+
+    struct rtp_worker *worker = &workers[0];           //the least loaded worker
+    unsigned int i;
+    for(i = 1; i < nworkers; i++) {
+        if(workers[i].nstreams + workers[i].nshards < worker->nstreams + worker->nshards)
+            worker = &workers[i];
+    }
+    if(stream->capture) {
+        worker = capture_worker;
+        if(worker == NULL) {
+            pthread_mutex_unlock(&pool_mutex);
+            rtp_print_log(RTP_ERROR, "Packet capture is not configured (capture_interface)\n");
+            return -1;
+        }
+    }
+
+    //stream must be in list of worker before its first event arrives
+    pthread_mutex_lock(&(worker->worker_mutex));
+    stream->worker = worker;
+    stream->prev = NULL;
+    stream->next = worker->streams;
+    if(worker->streams != NULL)
+        worker->streams->prev = stream;
+    worker->streams = stream;
+    worker->nstreams++;
+    pthread_mutex_unlock(&(worker->worker_mutex));
+    pthread_mutex_unlock(&pool_mutex);
+
+    for(i = 0; i < RTP_STREAM_ENDPOINTS; i++) {
+        if(watch_endpoint(worker, &(stream->endpoints[i])) == -1) {
+            rtp_worker_remove_stream(stream);
+            return -1;
+        }
+    }
+
+    for(i = 1; i < stream->video_session.shards; i++) {
+        if(add_shard(stream, i) == -1) {
+            rtp_worker_remove_stream(stream);
+            return -1;
+        }
+    }
+
+    rtp_print_log(RTP_DEBUG, "Stream assigned to worker %ld\n", (long) (worker - workers));
+    return 0;
+}
+
+void rtp_worker_remove_stream(struct rtp_stream *stream)
+{
+    struct rtp_worker *worker = stream->worker;
+    if(worker == NULL)
+        return;
+
+    remove_shards(stream);
+    unwatch_endpoints(worker, stream->endpoints, RTP_STREAM_ENDPOINTS);
+
+    /* unwatch_endpoints() waited until worker finished round of events returned by epoll_wait()
+     * before sockets were removed (with io_uring for the last completions), so no event of this
+     * stream is pending in the worker. The mutex serializes unlinking with tick_streams(). */
+    pthread_mutex_lock(&pool_mutex);
+    pthread_mutex_lock(&(worker->worker_mutex));
+    if(stream->prev != NULL)
+        stream->prev->next = stream->next;
+    else
+        worker->streams = stream->next;
+    if(stream->next != NULL)
+        stream->next->prev = stream->prev;
+    worker->nstreams--;
+    pthread_mutex_unlock(&(worker->worker_mutex));
+    pthread_mutex_unlock(&pool_mutex);
+
+    stream->next = NULL;
+    stream->prev = NULL;
+    stream->worker = NULL;
+}
@@ -0,0 +1,73 @@
+/*
+ * rtp_worker.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_WORKER_H_
+#define RTP_WORKER_H_
+
+#include <pthread.h>
+#include "rtp_stream_thread.h"
+#include "rtp_network.h"
+#include "rtp_uring.h"
+#include "rtp_capture.h"
+
+/**
+ * Module of worker threads. Fixed pool of worker threads, each one with its own
+ * epoll set (or io_uring with engine RTP_ENGINE_URING), receives data of all streams. Every stream is served by exactly one worker,
+ * additional RTP sockets of sharded stream are served by other workers. Streams received
+ * by packet capture are served by one extra capture worker.
+ */
+
+/**
+ * Structure that represents worker thread.
+ */
+struct rtp_worker {
+	pthread_t thread;						/**< worker thread*/
+	int epollfd;							/**< epoll set of sockets served by worker*/
+	int wakefd;								/**< eventfd used to wake up worker on closing*/
+	volatile int running;					/**< 1 while worker should run, 0 otherwise*/
+	pthread_mutex_t worker_mutex;			/**< held by worker while handling events, serializes removal of streams*/
+	uint64_t epoch;							/**< count of iterations of worker loop, increased with worker_mutex held*/
+	pthread_cond_t epoch_cond;				/**< signalled when epoch increased or worker stopped*/
+	struct rtp_stream *streams;				/**< list of streams served by worker*/
+	unsigned int nstreams;					/**< count of streams served by worker*/
+	unsigned int nshards;					/**< count of additional sockets of sharded streams served by worker*/
+	struct rtp_recv_batch batch;			/**< receive buffers of worker*/
+	struct rtp_uring *uring;				/**< io_uring of worker, NULL for engine RTP_ENGINE_EPOLL*/
+	pthread_cond_t uring_cond;				/**< signalled when worker stopped receiving from socket (io_uring)*/
+	struct rtp_endpoint *uring_cmds;		/**< sockets, which receiving should be started or stopped by worker*/
+	struct rtp_capture *capture;			/**< packet capture of capture worker, NULL for other workers*/
+};
+
+/**
+ * Creates and runs pool of worker threads.
+ * \param config Configuration of RtpStore (count of workers, size of receive batch, engine).
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_worker_pool_init(const struct rtp_store_config *config);
+
+/**
+ * Stops all worker threads and frees pool. All streams must be removed first.
+ */
+void rtp_worker_pool_close(void);
+
+/**
+ * Assigns stream to the least loaded worker and registers its sockets into worker's epoll set.
+ * Every additional RTP socket of sharded stream is assigned to the least loaded other worker.
+ * Stream received by packet capture is assigned to capture worker.
+ * \param stream Stream that will be served by worker.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_worker_add_stream(struct rtp_stream *stream);
+
+/**
+ * Unregisters sockets of stream from its workers. Function waits until events of its sockets
+ * returned to workers before unregistration are handled, so workers don't touch stream anymore
+ * when it returns.
+ * \param stream Stream that should be removed from its worker.
+ */
+void rtp_worker_remove_stream(struct rtp_stream *stream);
+
+#endif /* RTP_WORKER_H_ */
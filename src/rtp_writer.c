@@ -0,0 +1,382 @@
+/*
+ * rtp_writer.c
+ *
+ *  Created on: Oct 17, 2026
+ */
+#define _THREAD_SAFE        //additional objects for thread environment
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>                     //strerror()
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include "rtp_store.h"
+#include "log.h"
+#include "rtp_stream_thread.h"
+#include "rtp_foutput.h"
+#include "rtp_ring.h"
+#include "rtp_writer.h"
+
+//Maximum time in miliseconds, that writer sleeps without being woken up.
+#define IDLE_TIME 1000
+
+//Maximum count of files written by one submission of group commit.
+#define GROUP_ENTRIES 512
+
+static struct rtp_writer *writers = NULL;   //pool of writers
+static unsigned int nwriters = 0;           //count of writers in pool
+static uint32_t ring_size = RTP_QUEUE_SIZE_DEFAULT;             //size of ring of stream
+static rtp_queue_policy_t ring_policy = RTP_QUEUE_DROP_NEWEST;  //policy of full ring
+static unsigned int group_latency = 0;                          //latency bound of group commit, 0 if not used
+static size_t group_bytes = RTP_GROUP_COMMIT_BYTES_DEFAULT;     //byte bound of group commit
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;  //locking mutex to assign streams
+
+//Writes records of all streams served by writer. Returns size of written records.
+static inline ssize_t drain_streams(struct rtp_writer *writer)
+{
+    ssize_t written = 0;
+    struct rtp_stream *stream;
+    for(stream = writer->streams; stream != NULL; stream = stream->wnext)
+        written += rtp_drain_stream_output(stream, 0);
+    return written;
+}
+
+//Writes output buffers of all streams served by writer, which have data. Every GROUP_ENTRIES
+//files are written by one submission of io_uring, files are written one by one without it.
+static void write_group(struct rtp_writer *writer)
+{
+    struct rtp_stream *group[GROUP_ENTRIES];
+    struct rtp_stream *stream = writer->streams;
+    while(stream != NULL) {
+        unsigned int count = 0;
+        for(; stream != NULL && count < GROUP_ENTRIES; stream = stream->wnext) {
+            struct iovec iov;
+            off64_t offset;
+            int fd = rtp_prepare_stream_write(stream, &iov, &offset);
+            if(fd == -1)
+                continue;
+            if(writer->uring.fd < 0
+               || rtp_uring_write(&(writer->uring), fd, iov.iov_base, iov.iov_len, offset, count) == -1) {
+                rtp_complete_stream_write(stream, 0);
+                continue;
+            }
+            group[count++] = stream;
+        }
+        if(count == 0)
+            continue;
+
+        unsigned int i;
+        if(rtp_uring_complete(&(writer->uring), count) == -1) {
+            //data are written to the same positions, so writing them again is harmless
+            rtp_print_log(RTP_WARN, "Group commit by io_uring failed, files are written one by one\n");
+            rtp_uring_free(&(writer->uring));
+            for(i = 0; i < count; i++)
+                rtp_complete_stream_write(group[i], 0);
+            continue;
+        }
+        for(i = 0; i < count; i++) {
+            struct io_uring_cqe *cqe = rtp_uring_peek(&(writer->uring));
+            rtp_complete_stream_write(group[cqe->user_data], cqe->res);
+            rtp_uring_seen(&(writer->uring));
+        }
+    }
+}
+
+//Group commit. Writes output buffers of all streams served by writer, when the oldest
+//buffered data are older than latency bound or their size reaches byte bound. Returns time
+//in miliseconds until the next group commit.
+static int commit_streams(struct rtp_writer *writer, uint64_t now)
+{
+    int timeout = IDLE_TIME;
+    uint64_t oldest = now;
+    size_t pending = 0;
+    struct rtp_stream *stream;
+    for(stream = writer->streams; stream != NULL; stream = stream->wnext) {
+        uint64_t since;
+        size_t len = rtp_pending_stream_output(stream, &since);
+        if(len > 0) {
+            pending += len;
+            if(since < oldest)
+                oldest = since;
+        }
+        int held = rtp_held_stream_output(stream);
+        if(held >= 0 && held < timeout)
+            timeout = held;
+    }
+    if(pending == 0)
+        return timeout;
+
+    uint64_t age = now - oldest;
+    if(age < group_latency && pending < group_bytes)
+        return (int) (group_latency - age) < timeout ? (int) (group_latency - age) : timeout;
+
+    write_group(writer);
+    return timeout;
+}
+
+//Writes output buffers of streams served by writer, which data are older than flush
+//interval, and syncs output files by durability policy of streams. Returns time in
+//miliseconds until the next output buffer should be written or file synced.
+static inline int flush_streams(struct rtp_writer *writer)
+{
+    uint64_t now = rtp_clock_ms();
+    int timeout = group_latency > 0 ? commit_streams(writer, now) : IDLE_TIME;
+    struct rtp_stream *stream;
+    for(stream = writer->streams; stream != NULL; stream = stream->wnext) {
+        int next = group_latency > 0 ? -1 : rtp_flush_stream_output(stream, now);
+        if(next >= 0 && next < timeout)
+            timeout = next;
+        next = rtp_sync_stream_output(stream, now);
+        if(next >= 0 && next < timeout)
+            timeout = next;
+    }
+    return timeout;
+}
+
+//Returns 1 if ring of any stream served by writer contains records, which can be moved,
+//0 otherwise. Records of sharded stream queued behind record held back by merge can't be
+//moved before the held one.
+static inline int streams_pending(struct rtp_writer *writer)
+{
+    struct rtp_stream *stream;
+    for(stream = writer->streams; stream != NULL; stream = stream->wnext) {
+        unsigned int shards = stream->video_session.shards;
+        if(shards <= 1) {
+            if(rtp_ring_pending(&(stream->ring)))
+                return 1;
+            continue;
+        }
+        unsigned int i;
+        for(i = 0; i < shards; i++) {
+            struct rtp_ring *ring = i == 0 ? &(stream->ring) : &(stream->shard_rings[i - 1]);
+            if(stream->merge[i].pos == stream->merge[i].len && rtp_ring_pending(ring))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+//Waits until writer is woken up by worker or timeout (in miliseconds) elapses.
+static void writer_sleep(struct rtp_writer *writer, int timeout)
+{
+    __atomic_store_n(&(writer->sleeping), 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);                //pairs with fence in rtp_writer_notify()
+
+    pthread_mutex_lock(&(writer->writer_mutex));
+    int pending = streams_pending(writer);
+    pthread_mutex_unlock(&(writer->writer_mutex));
+
+    if(!pending && writer->running) {
+        struct pollfd pfd = {
+            .fd = writer->wakefd,
+            .events = POLLIN
+        };
+        if(poll(&pfd, 1, timeout) > 0) {
+            uint64_t foo;
+            if(read(writer->wakefd, &foo, sizeof(foo)) == -1)
+                rtp_print_log(RTP_WARN, "Reading wake up event failed:%s\n", strerror(errno));
+        }
+    }
+    __atomic_store_n(&(writer->sleeping), 0, __ATOMIC_RELAXED);
+}
+
+//Execution handler of writer.
+static void *rtp_writer_handler(void *param)
+{
+    struct rtp_writer *writer = (struct rtp_writer *) param;
+    rtp_print_log(RTP_DEBUG, "Starting main loop of writer\n");
+    if(writer->uring.fd >= 0 && rtp_uring_enable(&(writer->uring)) == -1)
+        rtp_uring_free(&(writer->uring));
+
+    while(writer->running) {
+        pthread_mutex_lock(&(writer->writer_mutex));                    //critical section
+        ssize_t written = drain_streams(writer);
+        int timeout = flush_streams(writer);
+        pthread_mutex_unlock(&(writer->writer_mutex));                  //out crit. section
+
+        if(written == 0)
+            writer_sleep(writer, timeout);
+    }
+
+    return NULL;
+}
+
+//Wakes up writer given as parameter. Called by worker, when ring of stream is full.
+static void on_ring_full(void *param)
+{
+    rtp_writer_notify((struct rtp_writer *) param);
+}
+
+//Initializes writer and runs its thread.
+static int writer_init(struct rtp_writer *writer)
+{
+    writer->streams = NULL;
+    writer->nstreams = 0;
+    writer->running = 1;
+    writer->sleeping = 0;
+    writer->uring.fd = -1;
+
+    writer->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(writer->wakefd == -1) {
+        rtp_print_log(RTP_ERROR, "eventfd() failed:%s\n", strerror(errno));
+        return -1;
+    }
+
+    if(group_latency > 0 && rtp_uring_init(&(writer->uring), GROUP_ENTRIES, 0) == -1) {
+        rtp_print_log(RTP_WARN, "io_uring is not available (%s), group commit writes files one by one\n",
+                      strerror(errno));
+        writer->uring.fd = -1;
+    }
+
+    if(pthread_mutex_init(&(writer->writer_mutex), NULL) != 0) {
+        rtp_print_log(RTP_ERROR, "Initializing writer mutex failed\n");
+        goto ON_ERROR;
+    }
+
+    if(pthread_create(&(writer->thread), NULL, rtp_writer_handler, (void *) writer) != 0) {
+        rtp_print_log(RTP_ERROR, "Creating writer thread failed\n");
+        pthread_mutex_destroy(&(writer->writer_mutex));
+        goto ON_ERROR;
+    }
+
+    return 0;
+
+    ON_ERROR:
+    if(writer->uring.fd >= 0)
+        rtp_uring_free(&(writer->uring));
+    close(writer->wakefd);
+    return -1;
+}
+
+//Stops thread of writer and frees its resources.
+static void writer_close(struct rtp_writer *writer)
+{
+    uint64_t one = 1;
+    writer->running = 0;
+    if(write(writer->wakefd, &one, sizeof(one)) == -1)
+        rtp_print_log(RTP_WARN, "Waking up writer failed:%s\n", strerror(errno));
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_destroy(&(writer->writer_mutex));
+    if(writer->uring.fd >= 0)
+        rtp_uring_free(&(writer->uring));
+    close(writer->wakefd);
+}
+
+int rtp_writer_pool_init(const struct rtp_store_config *config)
+{
+    if(writers != NULL) {
+        rtp_print_log(RTP_ERROR, "Writer pool is already initialized\n");
+        return -1;
+    }
+
+    unsigned int count = config->writers > 0 ? config->writers : 1;
+    ring_size = config->queue_size;
+    ring_policy = config->queue_policy;
+    group_latency = config->group_commit;
+    group_bytes = config->group_commit_bytes;
+
+    writers = (struct rtp_writer *) malloc(count * sizeof(struct rtp_writer));
+    if(writers == NULL) {
+        rtp_print_log(RTP_ERROR, "Malloc of writer pool failed\n");
+        return -1;
+    }
+
+    for(nwriters = 0; nwriters < count; nwriters++) {
+        if(writer_init(&writers[nwriters]) == -1) {
+            rtp_writer_pool_close();
+            return -1;
+        }
+    }
+
+    rtp_print_log(RTP_DEBUG, "Writer pool with %u writers initialized\n", nwriters);
+    return 0;
+}
+
+void rtp_writer_pool_close(void)
+{
+    unsigned int i;
+    for(i = 0; i < nwriters; i++)
+        writer_close(&writers[i]);
+
+    free(writers);
+    writers = NULL;
+    nwriters = 0;
+}
+
+int rtp_writer_add_stream(struct rtp_stream *stream)
+{
+    pthread_mutex_lock(&pool_mutex);
+    if(writers == NULL) {
+        pthread_mutex_unlock(&pool_mutex);
+        rtp_print_log(RTP_ERROR, "Writer pool is not initialized\n");
+        return -1;
+    }
+
+    unsigned int i;
+    for(i = 0; i < stream->video_session.shards; i++) {        //ring of every RTP socket of group
+        struct rtp_ring *ring = i == 0 ? &(stream->ring) : &(stream->shard_rings[i - 1]);
+        if(rtp_ring_init(ring, ring_size, ring_policy) == -1) {
+            while(i-- > 0)
+                rtp_ring_free(i == 0 ? &(stream->ring) : &(stream->shard_rings[i - 1]));
+            pthread_mutex_unlock(&pool_mutex);
+            return -1;
+        }
+    }
+
+    struct rtp_writer *writer = &writers[0];           //the least loaded writer
+    for(i = 1; i < nwriters; i++) {
+        if(writers[i].nstreams < writer->nstreams)
+            writer = &writers[i];
+    }
+    for(i = 0; i < stream->video_session.shards; i++) {
+        struct rtp_ring *ring = i == 0 ? &(stream->ring) : &(stream->shard_rings[i - 1]);
+        ring->on_full = on_ring_full;
+        ring->on_full_arg = (void *) writer;
+    }
+
+    pthread_mutex_lock(&(writer->writer_mutex));
+    stream->writer = writer;
+    stream->wprev = NULL;
+    stream->wnext = writer->streams;
+    if(writer->streams != NULL)
+        writer->streams->wprev = stream;
+    writer->streams = stream;
+    writer->nstreams++;
+    pthread_mutex_unlock(&(writer->writer_mutex));
+    pthread_mutex_unlock(&pool_mutex);
+
+    rtp_print_log(RTP_DEBUG, "Stream assigned to writer %ld\n", (long) (writer - writers));
+    return 0;
+}
+
+void rtp_writer_remove_stream(struct rtp_stream *stream)
+{
+    struct rtp_writer *writer = stream->writer;
+    if(writer == NULL)
+        return;
+
+    pthread_mutex_lock(&pool_mutex);
+    pthread_mutex_lock(&(writer->writer_mutex));
+    while(rtp_drain_stream_output(stream, 1) > 0)       //the last records of stream
+        ;
+    if(stream->wprev != NULL)
+        stream->wprev->wnext = stream->wnext;
+    else
+        writer->streams = stream->wnext;
+    if(stream->wnext != NULL)
+        stream->wnext->wprev = stream->wprev;
+    writer->nstreams--;
+    pthread_mutex_unlock(&(writer->writer_mutex));
+    pthread_mutex_unlock(&pool_mutex);
+
+    rtp_ring_free(&(stream->ring));
+    unsigned int i;
+    for(i = 1; i < stream->video_session.shards; i++)
+        rtp_ring_free(&(stream->shard_rings[i - 1]));
+    stream->wnext = NULL;
+    stream->wprev = NULL;
+    stream->writer = NULL;
+}
@@ -0,0 +1,77 @@
+/*
+ * rtp_writer.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef RTP_WRITER_H_
+#define RTP_WRITER_H_
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "rtp_stream_thread.h"
+#include "rtp_uring.h"
+
+/**
+ * Module of writer threads. Workers put received packets into ring of stream and
+ * writers drain rings to output files, so disk stalls don't block receiving.
+ * Every stream is served by exactly one writer. With group commit, writer writes output
+ * buffers of all its streams together by one submission of io_uring.
+ */
+
+/**
+ * Structure that represents writer thread.
+ */
+struct rtp_writer {
+	pthread_t thread;						/**< writer thread*/
+	int wakefd;								/**< eventfd used to wake up sleeping writer*/
+	volatile int running;					/**< 1 while writer should run, 0 otherwise*/
+	int sleeping;							/**< 1 while writer waits for data, 0 otherwise*/
+	pthread_mutex_t writer_mutex;			/**< held by writer while draining rings, serializes removal of streams*/
+	struct rtp_stream *streams;				/**< list of streams served by writer*/
+	unsigned int nstreams;					/**< count of streams served by writer*/
+	struct rtp_uring uring;					/**< io_uring of group commit, fd is -1 if not used*/
+};
+
+/**
+ * Creates and runs pool of writer threads.
+ * \param config Configuration of RtpStore (count of writers, size and policy of rings, group commit).
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_writer_pool_init(const struct rtp_store_config *config);
+
+/**
+ * Stops all writer threads and frees pool. All streams must be removed first.
+ */
+void rtp_writer_pool_close(void);
+
+/**
+ * Creates ring of stream and assigns stream to the least loaded writer.
+ * \param stream Stream that will be served by writer.
+ * \return 0 on success, -1 otherwise.
+ */
+int rtp_writer_add_stream(struct rtp_stream *stream);
+
+/**
+ * Writes all records remaining in ring of stream, removes stream from its writer and
+ * frees ring. Worker of stream must be removed first.
+ * \param stream Stream that should be removed from its writer.
+ */
+void rtp_writer_remove_stream(struct rtp_stream *stream);
+
+/**
+ * Wakes up writer, when it is sleeping. Called by worker after it put packets into ring.
+ * \param writer Writer that should be woken up.
+ */
+static inline void rtp_writer_notify(struct rtp_writer *writer)
+{
+    uint64_t one = 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);                //pairs with fence in writer before sleeping
+    if(__atomic_load_n(&(writer->sleeping), __ATOMIC_RELAXED)
+       && __atomic_exchange_n(&(writer->sleeping), 0, __ATOMIC_ACQ_REL))
+        if(write(writer->wakefd, &one, sizeof(one)) == -1)
+            return;
+}
+
+#endif /* RTP_WRITER_H_ */